@@ -0,0 +1,259 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "SerialPort.hpp"
+#include "RelayBoard.hpp"
+#include "LcusProtocol.hpp"
+#include "RelayEmulator.hpp"
+#include "stringtools.hpp"
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <map>
+#include <cmath>
+#include <stdexcept>
+
+//Measure the round trip of the relay commands through SerialPort and RelayDriver against the relay emulator or a real LCUS board
+//Every command type is sent for the given iterations at every baud rate, the latency percentiles, the throughput and the errors are printed as JSON
+//The emulated board is a pseudo terminal which ignores the baud rate, therefore it is measured once without any baud
+
+namespace
+{
+    struct Settings
+    {
+        std::string                 device;         //empty to use the emulator
+        std::vector <unsigned int>  bauds           {};             //empty for the default ones of the real board
+        unsigned int                iterations      {1000};
+        unsigned int                answerWaitMs    {1000};
+        unsigned int                latencyMs       {0};
+        uint8_t                     channels        {8};
+    };
+    
+    struct Measure
+    {
+        unsigned int                    baud;       //0 for the emulator
+        std::string                     command;
+        std::vector <double>            latenciesUs;
+        double                          totalS;
+        std::map <std::string, unsigned int> errors;
+    };
+    
+    const char* errorName (RelayDriver::Error e)
+    {
+        switch (e)
+        {
+            case RelayDriver::NO:       return "NO";
+            case RelayDriver::NORECV:   return "NORECV";
+            case RelayDriver::NOSEND:   return "NOSEND";
+            case RelayDriver::WRNGCRC:  return "WRNGCRC";
+            case RelayDriver::WRNGREL:  return "WRNGREL";
+            case RelayDriver::WRNGCOM:  return "WRNGCOM";
+            case RelayDriver::WRNGSTA:  return "WRNGSTA";
+        }
+        return "UNKNOWN";
+    }
+    
+    double percentile (const std::vector <double>& sorted, double p)
+    {
+        if (sorted.empty ()) return 0;
+        const size_t rank = static_cast <size_t> (std::ceil (p * static_cast <double> (sorted.size ())));
+        return sorted [rank > 0 ? rank - 1 : 0];
+    }
+    
+    //The single commands go through sendCommand, which reads the feedback by recvCommand, the batch commands every channel by sendCommands
+    Measure run (RelayDriver& relay, unsigned int baud, const std::string& command, unsigned int iterations, uint8_t channels)
+    {
+        Measure measure {baud, command, {}, 0, {}};
+        measure.latenciesUs.reserve (iterations);
+        
+        const auto begin = std::chrono::steady_clock::now ();
+        
+        for (unsigned int i = 0; i < iterations; ++ i)
+        {
+            const auto start = std::chrono::steady_clock::now ();
+            
+            if (command == "batch")
+            {
+                std::vector <RelayDriver::Request> requests;
+                for (uint8_t c = 1; c <= channels; ++ c) requests.push_back ({c, (i + c) % 2 ? RelayDriver::ON_CHECK : RelayDriver::OFF_CHECK});
+                
+                for (const RelayDriver::Result& result : relay.sendCommands (requests)) if (result.error != RelayDriver::NO) ++ measure.errors [errorName (result.error)];
+            }
+            else 
+            {
+                relay.sendCommand (1, RelayDriver::stringToCommand (command));
+                if (relay.lastError () != RelayDriver::NO) ++ measure.errors [errorName (relay.lastError ())];
+            }
+            
+            measure.latenciesUs.push_back (std::chrono::duration <double, std::micro> (std::chrono::steady_clock::now () - start).count ());
+        }
+        
+        measure.totalS = std::chrono::duration <double> (std::chrono::steady_clock::now () - begin).count ();
+        std::sort (measure.latenciesUs.begin (), measure.latenciesUs.end ());
+        
+        return measure;
+    }
+    
+    void printJson (std::ostream& out, const Settings& settings, const std::vector <Measure>& measures)
+    {
+        out << std::fixed << std::setprecision (1);
+        out << "{\n";
+        out << "  \"device\": \"" << (settings.device.empty () ? "emulator" : settings.device) << "\",\n";
+        out << "  \"iterations\": " << settings.iterations << ",\n";
+        out << "  \"answer_wait_ms\": " << settings.answerWaitMs << ",\n";
+        out << "  \"emulator_latency_ms\": " << settings.latencyMs << ",\n";
+        out << "  \"results\": [\n";
+        
+        for (size_t m = 0; m < measures.size (); ++ m)
+        {
+            const Measure& measure = measures [m];
+            const size_t samples = measure.latenciesUs.size ();
+            
+            unsigned int errors = 0;
+            for (const auto& e : measure.errors) errors += e.second;
+            
+            out << "    {\"baud\": " << (measure.baud ? std::to_string (measure.baud) : "null") << ", \"command\": \"" << measure.command << "\", \"samples\": " << samples;
+            out << ", \"p50_us\": " << percentile (measure.latenciesUs, 0.50);
+            out << ", \"p90_us\": " << percentile (measure.latenciesUs, 0.90);
+            out << ", \"p99_us\": " << percentile (measure.latenciesUs, 0.99);
+            out << ", \"max_us\": " << (samples ? measure.latenciesUs.back () : 0);
+            out << ", \"commands_per_s\": " << (measure.totalS > 0 ? static_cast <double> (samples) / measure.totalS : 0);
+            out << ", \"errors\": " << errors;
+            out << ", \"error_rate\": " << std::setprecision (4) << (samples ? static_cast <double> (errors) / static_cast <double> (samples) : 0) << std::setprecision (1);
+            out << ", \"error_kinds\": {";
+            
+            bool first = true;
+            for (const auto& e : measure.errors)
+            {
+                out << (first ? "" : ", ") << "\"" << e.first << "\": " << e.second;
+                first = false;
+            }
+            
+            out << "}}" << (m + 1 < measures.size () ? "," : "") << "\n";
+        }
+        
+        out << "  ]\n";
+        out << "}\n";
+    }
+    
+    void printHelp ()
+    {
+        std::cout << "bench_relay measures the round trip of the relay commands and prints the results as JSON\n";
+        std::cout << "bench_relay [-d device] [-b bauds] [-n iterations] [-w answer_wait_ms] [-l latency_ms] [-c channels] [-o output]\n";
+        std::cout << "-d device: the serial port of a real LCUS relay board, by default an emulated board is used\n";
+        std::cout << "-b bauds: comma separated baud rates of the real board, default 9600,115200, the emulated board ignores the baud rate\n";
+        std::cout << "-n iterations: commands of every type for every baud rate, default 1000\n";
+        std::cout << "-w answer_wait_ms: the maximum wait for the relay feedback, default 1000\n";
+        std::cout << "-l latency_ms: the reply latency of the emulated board, default 0\n";
+        std::cout << "-c channels: the channels driven by the batch commands, default 8\n";
+        std::cout << "-o output: the JSON file to write, default the standard output\n";
+    }
+}
+
+int main (int argc, char** argv)
+{
+    Settings    settings;
+    std::string output;
+    
+    try
+    {
+        int opt;
+        while ((opt = getopt (argc, argv, "d:b:n:w:l:c:o:h")) != -1)
+        {
+            switch (opt)
+            {
+                case 'd':
+                    settings.device = std::string (optarg);
+                    break;
+                case 'b':
+                    settings.bauds.clear ();
+                    for (const std::string& b : split (std::string (optarg), ',')) settings.bauds.push_back (static_cast <unsigned int> (std::stoul (b)));
+                    break;
+                case 'n':
+                    settings.iterations = static_cast <unsigned int> (std::stoul (optarg));
+                    break;
+                case 'w':
+                    settings.answerWaitMs = static_cast <unsigned int> (std::stoul (optarg));
+                    break;
+                case 'l':
+                    settings.latencyMs = static_cast <unsigned int> (std::stoul (optarg));
+                    break;
+                case 'c':
+                    settings.channels = static_cast <uint8_t> (std::min (std::stoul (optarg), 255UL));
+                    break;
+                case 'o':
+                    output = std::string (optarg);
+                    break;
+                default:
+                    printHelp ();
+                    return opt == 'h' ? 0 : 1;
+            }
+        }
+        
+        if (settings.device.empty () and settings.bauds.size ()) throw std::invalid_argument ("The baud rates require a real board (-d), the emulated one ignores them");
+        
+        //the port of the emulated board is opened at a nominal baud rate which is not reported
+        const bool baudless = settings.device.empty ();
+        if (settings.bauds.empty ()) settings.bauds = baudless ? std::vector <unsigned int> {9600} : std::vector <unsigned int> {9600, 115200};
+        
+        std::unique_ptr <RelayEmulator> emulator;
+        if (settings.device.empty ()) 
+        {
+            emulator = std::make_unique <RelayEmulator> (settings.channels);
+            emulator->setLatency (settings.latencyMs);
+        }
+        
+        const std::string path = emulator ? emulator->getPath () : settings.device;
+        std::vector <Measure> measures;
+        
+        for (unsigned int baud : settings.bauds)
+        {
+            SerialPort port (path, baud, 1);
+            RelayBoard <LcusProtocol> relay (LcusProtocol (port), settings.channels, settings.answerWaitMs);
+            
+            for (const char* command : {"off", "on", "offc", "onc", "notc", "check", "batch"}) 
+            {
+                std::cerr << "Measuring " << command << (baudless ? std::string (" on the emulator") : " at " + std::to_string (baud) + " baud") << '\n';
+                measures.push_back (run (relay, baudless ? 0 : baud, command, settings.iterations, settings.channels));
+            }
+        }
+        
+        if (output.empty ()) printJson (std::cout, settings, measures);
+        else
+        {
+            std::ofstream file (output);
+            if (not file) throw std::invalid_argument ("It was not possible to write the output file: " + output);
+            printJson (file, settings, measures);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what () << '\n';
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef BATDEVICE_H
+#define BATDEVICE_H
+
+#include "RelayDriver.hpp"
+#include "ConfigReader.hpp"
+#include "StateFile.hpp"
+#include "LogWriter.hpp"
+#include "BatterySource.hpp"
+#include "SampleHistory.hpp"
+#include "HistoryStore.hpp"
+#include "RollupStore.hpp"
+#include "SessionJournal.hpp"
+#include "ProfileSchedules.hpp"
+#include "ChargeRateEstimator.hpp"
+#include <string>
+#include <memory>
+
+//A battery with its own relay channel, profiles, schedules, command and state files
+//Many devices can share the same relay driver and log writer
+//The profiles are referred by address from the state files and the schedules, therefore a device cannot be copied or moved
+class BatDevice
+{
+    public:
+        //Create a device with the given name reading its settings from the given configuration
+        //The relay and the log writer must exist as long as the device
+        //If a files directory is given, the battery, command and state files are taken from there instead of the configuration, it is used for simulation
+        //If the history is read only, its files are not created nor written, it is used by the command line queries while batguard runs
+        //throws an exception if any setting is wrong
+                            BatDevice (const std::string& name, const ConfigReader&, RelayDriver&, LogWriter&, const std::string& filesDirectory = "", bool readOnlyHistory = false);
+        
+                            BatDevice (const BatDevice&) = delete;
+        BatDevice&          operator = (const BatDevice&) = delete;
+        
+        //Returns the template of all the properties defining a device
+        static std::vector <Configuration> configurationTemplate ();
+        
+        //Returns the device name, it is empty if the configuration file does not define any device section
+        const std::string&  getName () const;
+        
+        //Returns the relay channel driving the device charger
+        uint8_t             getRelayChannel () const;
+        
+        //Returns the path of the command file
+        const std::string&  getCommandFileName () const;
+        
+        //Returns true if the command file was written since the last cycle read or cleaned it
+        bool                isCommandPending () const;
+        
+        //Returns the path of the state file
+        const std::string&  getStateFileName () const;
+        
+        //Returns the paths of the battery capacity files
+        std::vector <std::string> getBatteryPaths () const;
+        
+        //Returns the name of the power supply feeding the charger, for instance AC
+        const std::string&  getAcSupply () const;
+        
+        //Returns the history of the last battery samples
+        const SampleHistory& getHistory () const;
+        
+        //Returns the history file, nullptr if historypath is not defined
+        const HistoryStore* getStore () const;
+        
+        //Load the state saved at the previous run, if keepstate is enabled
+        void                restoreState ();
+        
+        //Take the current profile, the charger and scheduler state and the rate measurements from the device it replaces after a reload
+        void                adoptStateOf (BatDevice&);
+        
+        //The first half of a cycle: read the command file and the battery capacity and compute the charger state
+        //Returns the command to send to the relay channel, many devices can send their commands at once
+        RelayDriver::Request beginCycle ();
+        
+        //The second half of a cycle: check the result of the relay command, record the history and plan the next cycle from the given time in ms of the monotonic clock
+        void                endCycle (long long nowMs, const RelayDriver::Result&);
+        
+        //Returns the ms to wait from the given time before the next cycle is due, 0 if it is already due
+        unsigned long       msToNextCycle (long long nowMs) const;
+        
+        //Makes the next cycle due at once, for instance when the battery or the charger power supply changed
+        void                requestCycle ();
+        
+        //Set the charger as required at batguard exit
+        void                applyExitState ();
+        
+        //Send the give command to the relay channel
+        //If the command provides a feedback, it is reporte as string
+        std::string         sendCommandRelay (const std::string &);
+        
+        //Returns a string containing the battery capacity
+        std::string         getBatteryCapacity () const;
+        
+        //Returns a string with all the available charge profiles
+        std::string         getChargeProfiles () const;
+        
+        //Returns a string with the command file content
+        std::string         getUserCommand ();
+        
+        //Returns a string with the state file content
+        std::string         getLastState ();
+        
+        //Returns a string with the schedules
+        std::string         getProfileSchedules () const;
+        
+        //Returns a table of the battery history summaries from fromMs to toMs by steps of stepMs
+        //throws an exception if the step is not a multiple of a minute or the interval is empty
+        std::string         getHistorySummary (long long fromMs, long long toMs, long long stepMs) const;
+        
+        //Returns a table of the charging sessions overlapping the time from fromMs to toMs
+        std::string         getSessions (long long fromMs, long long toMs) const;
+        
+    private:
+        static constexpr long long transitionMarginMs = 50;
+        static constexpr size_t    maxHistorySize = 100000;
+        
+        const std::string       name;
+        RelayDriver&            relayDriver;
+        LogWriter&              logWriter;
+        ChargeProfiles          profiles;
+        StateFile               userCommand;
+        StateFile               lastState;
+        ProfileSchedules        schedules;
+        BatterySource           batterySource;
+        ChargeRateEstimator     rateEstimator;
+        std::string             acSupply;
+        SampleHistory           history;
+        std::unique_ptr <HistoryStore> store;
+        std::unique_ptr <RollupStore> rollups;
+        std::unique_ptr <SessionJournal> sessions;
+        
+        unsigned int            sleepTime;
+        bool                    adaptivePolling;
+        unsigned int            minSleepTime;
+        unsigned int            maxSleepTime;
+        bool                    checkFeedback;
+        bool                    chargerAtNO;
+        uint8_t                 relayChannel;
+        bool                    chargerExtLast;
+        bool                    chargerExtState;
+        bool                    keepState;
+        
+        const ChargeProfile*    currentProfile;
+        bool                    chargerState;
+        SessionJournal::Cause   chargerCause;
+        bool                    profileChanged;
+        long long               nextCycleMs;
+        
+        unsigned long computeTimeout () const;
+        unsigned int computeAdaptiveSleep () const;
+        RelayDriver::Request relayRequest () const;
+        RelayDriver::Result sendRelayCommand ();
+        void        checkRelayResult (const RelayDriver::Result&);
+        void        appendRecord (const RelayDriver::Result&);
+        void        trackSession (SessionJournal::Cause);
+        double      batteryEnergyWh () const;
+        size_t      profileIndex () const;
+        void        computeChargerState ();
+        void        selectCurrentProfile ();
+        void        writeState ();
+        bool        log (LogWriter::Level, const std::string&);
+        
+        void        loadSettings (const ConfigReader&);
+        
+        static void checkSettings (const ConfigReader&);
+        static std::string filePath (const ConfigReader&, const std::string& property, const std::string& directory, const std::string& fileName);
+        static size_t historySize (const ConfigReader&);
+        static std::vector <std::string> batteryFilePaths (const ConfigReader&, const std::string& directory);
+        static std::string onlineFilePath (const ConfigReader&, const std::string& directory);
+        static void loadProfiles (const ConfigReader&, ChargeProfiles&);
+        static void loadSchedules (const ConfigReader&, const ChargeProfiles&, ProfileSchedules&);
+};
+
+#endif //BATDEVICE_H
@@ -23,29 +23,42 @@
 #ifndef BATGUARD_H
 #define BATGUARD_H
 
+#include "BatDevice.hpp"
 #include "RelayDriver.hpp"
+#include "SerialPort.hpp"
 #include "ConfigReader.hpp"
-#include "StateFile.hpp"
 #include "LogWriter.hpp"
-#include "CapacityReader.hpp"
-#include "ProfileSchedules.hpp"
+#include "Simulation.hpp"
 #include <string>
+#include <list>
+#include <memory>
+#include <functional>
+
+class EventLoop;
+class UeventListener;
 
 class BatGuard
 {
     public:
-        //Create a batguard object, read all configuration parameters to set up serial port
-        explicit            BatGuard (const std::string& cnf);
+        //Create a batguard object, read all configuration parameters to set up serial port and the devices
+        //If a trace file is given, the battery trace is simulated on a virtual clock against an emulated relay, the relay changes are printed and the log is written next to the trace
+        //If the history is read only, its files are only queried, for instance while another batguard writes them, and start () cannot be called
+        explicit            BatGuard (const std::string& cnf, const std::string& simulationTrace = "", bool readOnlyHistory = false);
         
-        //Start the end-less loop to check the battery charge and set the relay accordingly
+        //Start the end-less loop to check the battery charge of every device and set their relays accordingly
+        //If the trace is simulated, the loop runs without any wait until the end of the trace
         void                start ();
         
-        //At the next polling time the run () method will close and the log file is immediately closed
+        //The start () loop will close at its next wake up, SIGINT and SIGTERM wake it up immediately
         void                stop ();
         
         //returns true if the run () is in execution
         bool                isRunning () const;
         
+        //Restrict the following requests to the device with the given name, the empty name selects all of them
+        //throws an exception if the device is not defined
+        void                selectDevice (const std::string&);
+        
         //Ad a message into the log file, if log was enabled
         //It is logged with error priority
         //return true if the message was added
@@ -56,10 +69,10 @@ class BatGuard
         std::string         sendCommandRelay (const std::string &);
         
         //Returns a string containing the battery capacity
-        std::string         getBatteryCapacity () const;
+        std::string         getBatteryCapacity ();
         
         //Returns a string with all the available charge profiles
-        std::string         getChargeProfiles () const;
+        std::string         getChargeProfiles ();
         
         //Returns a string with the command file content
         std::string         getUserCommand ();
@@ -68,42 +81,55 @@ class BatGuard
         std::string         getLastState ();     
         
         //Returns a string with the schedules
-        std::string         getProfileSchedules () const;
+        std::string         getProfileSchedules ();
+        
+        //Returns a table of the battery history summaries from fromMs to toMs by steps of stepMs
+        std::string         getHistorySummary (long long fromMs, long long toMs, long long stepMs);
+        
+        //Returns the charging sessions of the devices overlapping the time from fromMs to toMs
+        std::string         getSessions (long long fromMs, long long toMs);
         
         //Return batguard name and version
         static const std::string nameVersion ;
         
     private:
-        const ConfigReader      configReader;
-        SerialPort              serialPort;
-        RelayDriver             relayDriver;
-        ChargeProfiles          profiles;
-        StateFile               userCommand;
-        StateFile               lastState;
-        ProfileSchedules        schedules;
+        const std::string       configFileName;
+        std::unique_ptr <Simulation> simulation;
+        const bool              readOnlyHistory;
+        ConfigReader            configReader;
+        const std::string       relayProtocol;
+        const uint8_t           modbusAddress;
+        const std::string       relayPath;
+        std::unique_ptr <SerialPort> serialPort;    //not used by the hidraw relays
+        std::unique_ptr <RelayDriver> relayDriver;
         LogWriter               logWriter;
-        CapacityReader          capacityReader;
+        std::list <BatDevice>   devices;
         
-        const unsigned int      sleepTime;
-        const bool              checkFeedback;
-        
-        const ChargeProfile*    currentProfile;
+        uint8_t                 relayChannels;
+        bool                    probeUsedOnly;
+        bool                    relayProbed;
+        unsigned long           relayDisconnections;   //the ones already logged
+        std::string             selectedDevice;
         bool                    running;
-        bool                    chargerState;
-        bool                    profileChanged;
-        const bool              chargerAtNO;        
-        const uint8_t           relayChannel;
-        const bool				chargerExtLast;
-        const bool 				chargerExtState;
-        const bool              keepState;
-        
-        void 		sendRelayCommand ();
-        void        computeChargerState ();
-        void        selectCurrentProfile ();
-        void        loadProfiles ();
-        void        loadSchedules ();
-        void        readState ();
-        void        writeState ();
+        
+        void        runEventLoop ();
+        void        runSimulation ();
+        unsigned long runDevices (bool all);
+        void        reload ();
+        void        probeRelay (const std::list <BatDevice>&);
+        bool        updateRelayLink (EventLoop&);
+        void        watchCommandFiles (EventLoop&);
+        void        watchSupplies (UeventListener&);
+        void        requestSupplyCycles (const std::string& supply);
+        std::string collectFromDevices (const std::function <std::string (BatDevice&)>&);
+        
+        static std::vector <Configuration> configurationTemplate ();
+        static ConfigReader readConfiguration (const std::string&);
+        static void checkSettings (const ConfigReader&);
+        static std::unique_ptr <RelayDriver> createRelayDriver (const std::string& protocol, const std::string& path, SerialPort*, uint8_t modbusAddress);
+        static void loadDevices (const std::string&, RelayDriver&, LogWriter&, std::list <BatDevice>&, const std::string& filesDirectory, bool readOnlyHistory);
+        static uint8_t maxRelayChannel (const std::list <BatDevice>&);
+        static std::vector <uint8_t> usedRelayChannels (const std::list <BatDevice>&);
 };
 
 #endif //BATGUARD_H
@@ -0,0 +1,107 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef BATTERYREADER_H
+#define BATTERYREADER_H
+
+#include "CapacityReader.hpp"
+#include <string>
+#include <array>
+
+//A snapshot of the battery attributes taken in a single pass
+struct BatterySample
+{
+    enum class Status {UNKNOWN, CHARGING, DISCHARGING, NOTCHARGING, FULL};
+    
+    double      capacity;       //state of charge in percent, with sub-percent resolution when the energy or charge is available
+    Status      status;
+    double      rate;           //instantaneous rate in percent per second, positive while charging, 0 if not available
+    bool        rateValid;      //true if the battery reports its current or power
+    int         acOnline;       //1 if the charger power supply is online, 0 if offline, -1 if not available
+    double      energyNow;      //energy stored in uWh, 0 if not available
+    double      energyFull;     //energy stored when full in uWh, 0 if not available
+    bool        valid;          //false if the capacity could not be read and the last one is reported
+};
+
+//Read the battery attributes from the power supply directory keeping all the files open
+//Only the capacity file is required, the others are used if they exist:
+//status, energy_now, energy_full, charge_now, charge_full, current_now, power_now, voltage_now and the online file of the charger power supply
+class BatteryReader
+{
+    public:
+        //Create a BatteryReader from the path of the battery capacity, usually /sys/class/power_supply/BAT0/capacity
+        //The other battery attributes are looked for in the same directory, the charger online flag at the given path
+        //throws an exception if the capacity file cannot be read or its content is not a capacity
+        explicit            BatteryReader (const std::string& capacityPath, const std::string& onlinePath = "");
+        
+        //The files are closed when the object is destroyed
+                            ~BatteryReader ();
+        
+                            BatteryReader (const BatteryReader&) = delete;
+        BatteryReader&      operator = (const BatteryReader&) = delete;
+                            BatteryReader (BatteryReader&&);
+        BatteryReader&      operator = (BatteryReader&&);
+        
+        //Read all the attributes and returns the new sample
+        //if the capacity cannot be read, for instance the battery was removed, the last capacity is reported and all the files are reopened at the next call
+        const BatterySample& readSample ();
+        
+        //returns the last sample read
+        const BatterySample& getSample () const;
+        
+        //returns the capacity difference between last two samples
+        double              deltaCapacity () const;
+        
+        //returns a string representing the last sample
+        std::string         toString () const;
+        
+        //returns the path of the battery capacity file
+        const std::string&  getPath () const;
+        
+        //returns the capacity as string with one decimal only if it is not an integer
+        static std::string  capacityToString (double);
+        
+        //returns the path of the online file of the given power supply sharing the same directory of the battery capacity file
+        //for instance /sys/class/power_supply/BAT0/capacity and AC give /sys/class/power_supply/AC/online
+        static std::string  onlinePath (const std::string& capacityPath, const std::string& supply);
+        
+    private:
+        enum Attribute {STATUS, ENERGYNOW, ENERGYFULL, CHARGENOW, CHARGEFULL, CURRENTNOW, POWERNOW, VOLTAGENOW, ONLINE, ATTRIBUTES};
+        
+        CapacityReader                      capacityReader;
+        std::array <std::string, ATTRIBUTES> paths;
+        std::array <int, ATTRIBUTES>        descs;
+        bool                                attributesOpen;     //the missing attributes are tried again only after the battery was lost
+        BatterySample                       sample;
+        double                              prevCapacity;
+        
+        void                openAttributes ();
+        void                closeAttributes ();
+        bool                readNumber (Attribute, long long&) const;
+        BatterySample::Status readStatus () const;
+        void                computeSample ();
+        
+        //parse an integer from the given characters without any allocation, returns false if there is not a number
+        static bool         parseNumber (const char* begin, const char* end, long long&);
+};
+
+#endif //BATTERYREADER_H
@@ -0,0 +1,66 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef BATTERYSOURCE_H
+#define BATTERYSOURCE_H
+
+#include "BatteryReader.hpp"
+#include <string>
+#include <vector>
+
+//Many batteries charged by the same charger, for instance the BAT0 and BAT1 of a dual battery laptop, seen as a single one
+//The capacity is weighted by the energy of each battery when all of them report it, otherwise it is the average
+class BatterySource
+{
+    public:
+        //Create a source reading all the given battery capacity files, the charger online flag is read from the given path
+        //throws an exception if no path is given or any battery cannot be read
+        explicit            BatterySource (const std::vector <std::string>& capacityPaths, const std::string& onlinePath = "");
+        
+        //Read all the batteries and returns their combination
+        //the batteries which cannot be read are left out, the sample is not valid only if none can be read
+        const BatterySample& readSample ();
+        
+        //returns the last combined sample
+        const BatterySample& getSample () const;
+        
+        //returns the combined capacity difference between last two samples
+        double              deltaCapacity () const;
+        
+        //returns the readers of every battery with their last sample
+        const std::vector <BatteryReader>& getPacks () const;
+        
+        //returns the paths of the battery capacity files
+        std::vector <std::string> getPaths () const;
+        
+        //returns a string representing the combined sample followed by the sample of each battery if they are many
+        std::string         toString () const;
+        
+    private:
+        std::vector <BatteryReader> packs;
+        BatterySample               sample;
+        double                      prevCapacity;
+        
+        void                combine ();
+};
+
+#endif //BATTERYSOURCE_H
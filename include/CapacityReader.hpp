@@ -31,24 +31,46 @@ class CapacityReader
     public:
         //Create a CapacityReader, requires the path to the battery
         //It is usually: /sys/class/power_supply/BAT0/capacity
+        //The file is kept open and read again at every sample
+        //throws an exception if the file cannot be read or its content is not a capacity
         explicit            CapacityReader (const std::string& path);
         
+        //The file is closed when the object is destroyed
+                            ~CapacityReader ();
+        
+                            CapacityReader (const CapacityReader&) = delete;
+        CapacityReader&     operator = (const CapacityReader&) = delete;
+                            CapacityReader (CapacityReader&&);
+        CapacityReader&     operator = (CapacityReader&&);
+        
         //returns the capacity from 0 to 100 as integer
+        //if the file cannot be read, for instance the battery was removed, the last capacity read is returned and the file is reopened at the next call
         uint8_t             readCapacity ();
         
+        //returns true if the last readCapacity read the file correctly
+        bool                isReadValid () const;
+        
         //returns the charge difference between last two readings
         int                 deltaCapacity () const;
         
         //returns a string representing the current battery charge
         std::string         toString () const;
         
+        //returns the path of the battery capacity file
+        const std::string&  getPath () const;
+        
     private:
-        const std::string   capacityPath;
+        std::string         capacityPath;
+        int                 capacityDesc;
         int                 prevCapacity;
         int                 currCapacity;
+        bool                readValid;
         
-        void                computeCapacity ();
+        bool                computeCapacity ();
+        bool                readValue (int&);
         
+        //parse an integer from the given characters without any allocation, returns false if there is not a number
+        static bool         parseInteger (const char* begin, const char* end, int&);
 };
 
 #endif //CAPACITYREADER_H
@@ -0,0 +1,69 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#ifndef CHARGERATEESTIMATOR_H
+#define CHARGERATEESTIMATOR_H
+
+#include <string>
+#include <array>
+
+//Estimate the battery charge and discharge rates from timestamped capacity samples 
+//The rates are smoothed with an exponentially weighted moving average kept separately for charger on and off
+class ChargeRateEstimator
+{
+    public:
+        //Create an estimator where each new rate measurement has the given weight (0 to 1] on the smoothed one
+                            ChargeRateEstimator (double weight = 0.3);
+        
+        //Add a capacity sample taken at the given monotonic time in seconds
+        //charging is the charger state during the interval since the previous sample
+        //the rate is measured only when the capacity changes, since the capacity is quantized a slope between two equal readings is meaningless
+        void                addSample (double capacity, double seconds, bool charging);
+        
+        //returns true if a rate was already measured for the given charger state
+        bool                hasRate (bool charging) const;
+        
+        //returns the smoothed rate in percent per second for the given charger state, 0 if not yet measured
+        double              rate (bool charging) const;
+        
+        //returns the seconds predicted for the capacity to reach the target from the last sample with the given charger state
+        //returns a negative value if the rate is unknown or the capacity moves away from the target
+        double              secondsToReach (double target, bool charging) const;
+        
+        //returns a string representing the measured rates
+        std::string         toString () const;
+        
+        //returns the current time of the monotonic clock in seconds
+        static double       monotonicSeconds ();
+        
+    private:
+        double                  weight;
+        std::array <double, 2>  rates;
+        std::array <bool, 2>    measured;
+        double                  lastCapacity;
+        double                  anchorCapacity;
+        double                  anchorSeconds;
+        bool                    anchorCharging;
+        bool                    anchored;
+};
+
+#endif //CHARGERATEESTIMATOR_H
@@ -0,0 +1,70 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <atomic>
+#include <ctime>
+#include <string>
+
+//Source of the wall and monotonic time used by batguard
+//By default the system clocks are read, once a virtual clock is started the time moves forward only when advance is called
+//The virtual time can be read from any thread
+class Clock
+{
+    public:
+        //returns the wall clock time in seconds since the epoch
+        static time_t       wallTime ();
+        
+        //returns the wall clock time in ms since the epoch
+        static long long    wallMs ();
+        
+        //returns the monotonic clock time in ms, it is not related to the wall clock time
+        static long long    monotonicMs ();
+        
+        //replace the system clocks with a virtual clock starting at the given wall clock time
+        static void         startVirtual (time_t start);
+        
+        //go back to the system clocks
+        static void         stopVirtual ();
+        
+        //move the virtual clock forward by the given ms, it does nothing if the virtual clock was not started
+        static void         advance (unsigned long ms);
+        
+        //returns true if the virtual clock was started
+        static bool         isVirtual ();
+        
+        //returns the time given as seconds since the epoch or as local date: YYYY-MM-DD, YYYY-MM-DD HH:MM or YYYY-MM-DD HH:MM:SS
+        //throws an exception if the text is not a time
+        static time_t       parseTime (const std::string&);
+        
+        //returns the given time as local date: YYYY-MM-DD HH:MM:SS
+        static std::string  formatTime (time_t);
+        
+    private:
+        static std::atomic <bool>       virtualClock;
+        static std::atomic <long long>  virtualStartMs;
+        static std::atomic <long long>  virtualElapsedMs;
+};
+
+#endif //CLOCK_H
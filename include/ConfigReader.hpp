@@ -73,7 +73,13 @@ class ConfigReader
         //requires a vector of configurations as template of all the valid properties and their default values and uniqueness read the Configuration constructor for more details 
         //if a property without default values is not found it throws an exception
         //if a property with default values is not found it is added from the initializer 
-                                    ConfigReader (const std::vector <Configuration> & defaultAndAllowedConfigurations, const std::string & configFileName);
+        //the file may be divided in sections by lines containing only a section name within square brackets: [name]
+        //only the lines of the given section are read, the empty name selects the lines before the first section
+                                    ConfigReader (const std::vector <Configuration> & defaultAndAllowedConfigurations, const std::string & configFileName, const std::string & section = "");
+        
+        //returns the names of the sections of the given configuration file in the order they are defined
+        //throws an exception if a section name is not valid or it is defined twice
+        static std::vector <std::string> readSectionNames (const std::string & configFileName);
         
         //selects the first configuration with the given name, there may be more than one but the first is selected
         //throws an exception if the propert is not found
@@ -142,7 +148,7 @@ class ConfigReader
         std::vector <bool>          getNextListOfBoolDescription (size_t length, size_t index0=1) const;    
              
     private:
-        const std::vector<Configuration>    configurations;
+        std::vector<Configuration>          configurations;
         mutable size_t                      selectedConfig;
         mutable size_t                      selectedValue;
         mutable bool                        selected;
@@ -151,7 +157,8 @@ class ConfigReader
         void                                setConfiguration (size_t) const;
         bool                                selectConfiguration (size_t, const std::string&) const;
         
-        static std::vector<Configuration>   readConfigFile (const std::vector <Configuration> &, const std::string &);
+        static std::vector<Configuration>   readConfigFile (const std::vector <Configuration> &, const std::string &, const std::string &);
+        static bool                         isSectionHeader (const std::string &);
         int                                 stringToInteger (const std::string&) const;
         bool                                stringToBool (const std::string&) const;
         void                                setTrue (std::vector <bool>&, const size_t beg, const size_t end) const;
@@ -0,0 +1,100 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <signal.h>
+
+class EventLoop
+{
+    public:
+        //Events which can wake up the loop
+        enum Event
+        {
+            TIMEOUT,        //the time set by setTimeout elapsed
+            TERMINATE,      //SIGINT or SIGTERM was received
+            RELOAD,         //SIGHUP was received
+            FILECHANGE,     //one of the watched files was written or replaced
+            READABLE,       //one of the watched descriptors has data to read
+        };
+        
+        //Create an event loop waiting on a timer, on the signals and on the watched files at the same time
+        //SIGINT, SIGTERM and SIGHUP are blocked and delivered through wait instead of the signal handlers until the object is destroyed
+        //throws an exception if any of the kernel objects cannot be created
+        explicit            EventLoop ();
+        
+        //Close all the descriptors and restore the previous signal mask
+                            ~EventLoop ();
+        
+        //Watch the given file: any write or replacement wakes up the loop with FILECHANGE
+        //The parent directory is watched so that also the files replaced by editors or not yet existing are detected
+        //returns false if the parent directory cannot be watched
+        bool                watchFile (const std::string& path);
+        
+        //Watch the given descriptor: when it has data to read the loop wakes up with READABLE
+        //The caller must read all the data otherwise the loop wakes up again at once
+        //returns false if the descriptor cannot be watched
+        bool                watchDescriptor (int fd);
+        
+        //Watch the given device to show up: its creation, replacement or permission change wakes up the loop with FILECHANGE
+        //The nearest existing directory of the device is watched, only the entry leading to the device is noticed
+        //Calling it again for the same device and directory does nothing
+        //returns false if no directory can be watched
+        bool                watchDevice (const std::string& path);
+        
+        //Stop watching the device, the files watched in its directory are still watched
+        void                unwatchDevice ();
+        
+        //Stop watching all the files and the device
+        void                clearWatches ();
+        
+        //Arm the timer to elapse after the given milliseconds, the previous setting is replaced
+        void                setTimeout (unsigned long ms);
+        
+        //Wait without using any CPU until the first event happens, then returns it 
+        Event               wait ();
+        
+        //Discard the pending file changes, to be used before the watched files are read anyway
+        void                discardFileChanges ();
+        
+    private:
+        sigset_t                                    previousMask;
+        const int                                   epollDesc;
+        const int                                   timerDesc;
+        const int                                   signalDesc;
+        const int                                   inotifyDesc;
+        std::vector <std::pair <int, std::string>>  watchedFiles;
+        int                                         deviceWatch;
+        std::string                                 deviceDirectory;
+        std::string                                 deviceEntry;
+        
+        int             openSignalDescriptor ();
+        bool            addDescriptor (int);
+        void            closeDescriptors ();
+        bool            readFileChanges ();
+};
+
+#endif //EVENTLOOP_H
@@ -0,0 +1,81 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef HIDRAWPROTOCOL_H
+#define HIDRAWPROTOCOL_H
+
+#include "RelayDriver.hpp"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+//The protocol of the USB HID relay boards (16c0:05df) through the Linux hidraw device
+//Every command is a feature report written to the board, the states of all the channels are read together by a single feature report
+//The reports are synchronous, therefore the feedbacks are already available when sendFrames returns
+class HidrawProtocol
+{
+    public:
+        static constexpr unsigned int reportLength = 9;    //the report number followed by 8 bytes
+        static constexpr uint8_t      maxChannels = 8;
+        
+        //Open the given hidraw device
+        //throws an exception if it cannot be opened
+        explicit        HidrawProtocol (const std::string& path);
+        
+                        HidrawProtocol (HidrawProtocol&&) noexcept;
+                        HidrawProtocol (const HidrawProtocol&) = delete;
+        HidrawProtocol& operator= (const HidrawProtocol&) = delete;
+        
+                        ~HidrawProtocol ();
+        
+        //Queue the report of the command, the read of the states if it requires a feedback
+        bool            queueFrame (uint8_t channel, RelayDriver::Command, bool state);
+        
+        //Write the reports queued, then read the states if required
+        bool            sendFrames (unsigned int answerWaitMs);
+        
+        //Returns the next state read by sendFrames
+        bool            nextFeedback (uint8_t& channel, bool& state);
+        
+        //Nothing arrives after sendFrames, it returns false
+        bool            waitFeedback (std::chrono::steady_clock::time_point deadline);
+        
+        //Returns the number of state reads failed
+        unsigned long   frameErrors () const;
+        
+    private:
+        struct Feedback
+        {
+            uint8_t     channel;
+            bool        state;
+        };
+        
+        int                     fd;
+        std::vector <Feedback>  writes;
+        bool                    readRequired;
+        std::vector <Feedback>  feedbacks;
+        size_t                  nextState;
+        unsigned long           errors;
+};
+
+#endif //HIDRAWPROTOCOL_H
@@ -0,0 +1,123 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//A time series of fixed size records about the battery and the relay, stored in a memory mapped file
+//The file begins with a header indexing the segments, each one holding a fixed number of records
+//The records are only appended, when all the segments are full the oldest one is reused
+//The file survives the restarts and can be read by other processes while it is written
+class HistoryStore
+{
+    public:
+        //The state of a device at the end of a cycle
+        struct Record
+        {
+            int64_t     wallMs;         //wall time in ms, never decreasing along the file
+            float       capacity;       //battery capacity in percent
+            float       rate;           //battery rate in percent per hour
+            uint8_t     charger;        //1 if the charger is enabled
+            uint8_t     profile;        //index of the current profile
+            uint8_t     relay;          //command returned by the relay
+            uint8_t     relayError;     //error of the relay if the command returned is an error
+            int8_t      acOnline;       //1 if the charger power supply is online, 0 offline, -1 not available
+            uint8_t     valid;          //1 if the battery was read
+            uint8_t     rateValid;      //1 if the battery reported its rate
+            uint8_t     padding [9];
+        };
+        
+        static constexpr uint32_t recordsPerSegment = 8192;
+        static constexpr uint32_t maxSegments = 160;
+        
+        //Open the store at the given path, it is created if it does not exist and it is not read only
+        //throws an exception if the file cannot be opened or it is not a store
+        explicit            HistoryStore (const std::string& path, bool readOnly = false);
+        
+        //Unmap and close the file
+                            ~HistoryStore ();
+        
+                            HistoryStore (const HistoryStore&) = delete;
+        HistoryStore&       operator = (const HistoryStore&) = delete;
+        
+        //Append a record, its time is raised to the one of the last record if it is older
+        //throws an exception if the file is read only or it cannot grow
+        void                append (const Record&);
+        
+        //returns the number of records stored
+        size_t              size () const;
+        
+        //Append to the given vector the records with time from fromMs included to toMs excluded
+        //returns the number of records added
+        size_t              query (long long fromMs, long long toMs, std::vector <Record>&) const;
+        
+        //Copy the last record in the given one, returns false if the store is empty
+        bool                last (Record&) const;
+        
+        //returns the path of the store file
+        const std::string&  getPath () const;
+        
+    private:
+        //the readers in other processes rely on count, lastMs and segments, the writer updates them atomically after the data they describe
+        struct Segment
+        {
+            int64_t     firstMs;
+            int64_t     lastMs;
+            uint32_t    count;
+            uint32_t    reserved;
+        };
+        
+        struct Header
+        {
+            char        magic [8];
+            uint32_t    version;
+            uint32_t    recordSize;
+            uint32_t    segmentRecords;
+            uint32_t    segmentSlots;
+            uint32_t    firstSegment;   //index of the oldest segment
+            uint32_t    segments;       //number of segments in use
+            Segment     index [maxSegments];
+        };
+        
+        static constexpr size_t headerBytes = 4096;
+        static constexpr size_t segmentBytes = recordsPerSegment * sizeof (Record);
+        static_assert (sizeof (Record) == 32, "The record size is part of the file format");
+        static_assert (sizeof (Header) <= headerBytes, "The header must fit its page");
+        
+        const std::string       path;
+        const bool              readOnly;
+        int                     fileDesc;
+        Header*                 header;
+        mutable std::vector <Record*> segmentMaps;
+        
+        Record*             mapSegment (uint32_t slot) const;
+        void                unmapAll ();
+        void                initHeader ();
+        void                checkHeader () const;
+        const Segment&      segmentAt (uint32_t order) const;
+};
+
+#endif //HISTORYSTORE_H
@@ -0,0 +1,64 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef LCUSFRAMEPARSER_H
+#define LCUSFRAMEPARSER_H
+
+#include "SerialPort.hpp"
+#include <cstdint>
+
+//Incremental parser of the frames of the LCUS relay boards: header 0xA0, channel, state and checksum
+//The frames are looked for directly in the read buffer of the serial port, a partial frame is left there until the rest arrives
+//The bytes out of a frame are skipped up to the next header, a frame with wrong checksum is dropped resyncing on the following header
+class LcusFrameParser
+{
+    public:
+        //A frame received from the relay board
+        struct Frame
+        {
+            uint8_t     channel;
+            uint8_t     state;
+        };
+        
+        static constexpr unsigned int frameLength = 4;
+        static constexpr uint8_t      header = 0xA0;
+        
+                        LcusFrameParser ();
+        
+        //Consume the read buffer of the given port up to the first complete frame
+        //returns true if a frame was found, false if the buffer is empty or holds only the beginning of a frame
+        bool            nextFrame (SerialPort&, Frame&);
+        
+        //Returns the number of frames dropped due to the wrong checksum
+        unsigned long   checksumErrors () const;
+        
+        //Returns the number of bytes skipped because out of any frame
+        unsigned long   skippedBytes () const;
+        
+        //Returns the checksum of a frame made by the given first bytes
+        static uint8_t  checksum (const uint8_t*);
+        
+    private:
+        unsigned long   wrongChecksums;
+        unsigned long   skipped;
+};
+
+#endif //LCUSFRAMEPARSER_H
@@ -0,0 +1,61 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef LCUSPROTOCOL_H
+#define LCUSPROTOCOL_H
+
+#include "RelayDriver.hpp"
+#include "SerialPort.hpp"
+#include "LcusFrameParser.hpp"
+#include <chrono>
+#include <cstdint>
+
+//The protocol of the LCUS relay boards: a 4 bytes frame for every command, the ones with feedback are answered by a frame with the channel state
+//The frames are queued in the write buffer of the serial port and written together, the feedbacks are matched by channel
+class LcusProtocol
+{
+    public:
+        explicit        LcusProtocol (SerialPort&);
+        
+        //Queue the frame of the command, when the write buffer is full it is sent to make room for it
+        bool            queueFrame (uint8_t channel, RelayDriver::Command, bool state);
+        
+        //Write all the frames queued
+        bool            sendFrames (unsigned int answerWaitMs);
+        
+        //Returns the next feedback frame already in the read buffer
+        bool            nextFeedback (uint8_t& channel, bool& state);
+        
+        //Wait for more bytes up to the deadline, returns false if nothing arrived
+        bool            waitFeedback (std::chrono::steady_clock::time_point deadline);
+        
+        //Returns the number of frames dropped due to the wrong checksum
+        unsigned long   frameErrors () const;
+        
+        //Wait for more bytes in the read buffer of the given port up to the deadline, returns false if nothing arrived
+        static bool     waitBytes (SerialPort&, std::chrono::steady_clock::time_point deadline);
+        
+    private:
+        SerialPort&     serialPort;
+        LcusFrameParser parser;
+};
+
+#endif //LCUSPROTOCOL_H
@@ -46,6 +46,11 @@ class LogWriter
         //The log file is permanently open, therefore it is closed in the distructor
                         ~LogWriter ();
         
+        //Apply new settings with the same meaning of the constructor ones
+        //The log file is reopened and its lines counted only if the path changed or the log was disabled
+        //throws an exception without changing anything if the settings are wrong or the new file cannot be opened
+        void            reconfigure (const std::string& path, uint8_t maxErrLvl, uint8_t maxFlushLvl, unsigned int maxToFlsLns, unsigned int maxLogLines);
+        
         //Add a new log message to the tail
         //If the message level is higher than the current maxErrLvl is scrapped
         //returns true if the message has a level allowing its wrote 
@@ -59,15 +64,16 @@ class LogWriter
         
     private:
         char                dateCharArray [128];
-        const std::string   logFileName;
+        std::string         logFileName;
         std::ofstream       logFile;
-        const uint8_t       maxErrLvl;
-        const uint8_t       maxFlushLvl;
-        const unsigned int  maxToFlsLns;
+        uint8_t             maxErrLvl;
+        uint8_t             maxFlushLvl;
+        unsigned int        maxToFlsLns;
         unsigned int        toFlsLns;
-        const unsigned int  maxLogLns;
+        unsigned int        maxLogLns;
         unsigned int        logLns;                
                 
+        static void     checkLevels (uint8_t maxErrLvl, uint8_t maxFlushLvl);
         void            computeDate ();
         void            open ();
         unsigned int    countLogLines ();     
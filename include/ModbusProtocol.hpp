@@ -0,0 +1,88 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef MODBUSPROTOCOL_H
+#define MODBUSPROTOCOL_H
+
+#include "RelayDriver.hpp"
+#include "SerialPort.hpp"
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+//The protocol of the Modbus RTU relay modules: every channel is a coil, channel 1 is the coil 0
+//The commands are written by Write Single Coil (0x05), the states required by the feedbacks are read together by a single Read Coils (0x01)
+//RTU frames are delimited by the line silence, therefore a write is sent only after the echo of the previous one or its transmission time
+class ModbusProtocol
+{
+    public:
+        static constexpr uint8_t    readCoils = 0x01;
+        static constexpr uint8_t    writeCoil = 0x05;
+        
+                        ModbusProtocol (SerialPort&, uint8_t address);
+        
+        //Queue the coil write of the command, the read of its state if it requires a feedback
+        bool            queueFrame (uint8_t channel, RelayDriver::Command, bool state);
+        
+        //Write the coils queued one by one, then request the states to read
+        bool            sendFrames (unsigned int answerWaitMs);
+        
+        //Returns the next state provided by the read reply already in the read buffer
+        bool            nextFeedback (uint8_t& channel, bool& state);
+        
+        //Wait for more bytes up to the deadline, returns false if nothing arrived
+        bool            waitFeedback (std::chrono::steady_clock::time_point deadline);
+        
+        //Returns the number of replies dropped due to the wrong CRC or reporting an exception
+        unsigned long   frameErrors () const;
+        
+        //Returns the Modbus CRC-16 of the given bytes, its low byte is sent first
+        static uint16_t crc16 (const uint8_t*, size_t);
+        
+    private:
+        //A coil reply holds address, function, byte count, up to 32 bytes of states and the CRC
+        static constexpr unsigned int maxReplyLength = 37;
+        
+        struct Feedback
+        {
+            uint8_t     channel;
+            bool        state;
+        };
+        
+        SerialPort&             serialPort;
+        const uint8_t           address;
+        std::vector <Feedback>  writes;         //the coils to write with their state
+        uint8_t                 firstRead;      //the range of channels to read, 0 if there is not any
+        uint8_t                 lastRead;
+        uint8_t                 pendingFirst;   //the range of channels of the read waiting for its reply, 0 if there is not any
+        uint8_t                 pendingCount;
+        uint8_t                 echoed;         //the channel of the last write echo received
+        std::vector <Feedback>  feedbacks;
+        size_t                  nextState;
+        unsigned long           errors;
+        
+        bool            sendFrame (uint8_t function, uint8_t channel, uint16_t value);
+        bool            nextReply ();
+        void            waitSilence (unsigned int characters) const;
+};
+
+#endif //MODBUSPROTOCOL_H
@@ -75,6 +75,9 @@ struct ProfileSchedule
     //struct tm happens in a day of month, month of year and day of week allowed
     bool                doesInclude (const struct tm* ) const;
     
+    //return true if the given struct tm happens in a day of month, month of year and day of week allowed, the time of the day is not checked
+    bool                doesIncludeDay (const struct tm* ) const;
+    
     //return true if the given schedule has some day of month, month of year, day of week in common and
     //the given schedule from or to is between this schedule from - to but they refer to different profiles therefore there is an ambiguity 
     bool                doesOverlap (const ProfileSchedule& ) const;
@@ -102,6 +105,11 @@ class ProfileSchedules
         //returns nullptr if no schedule is triggered
         const ProfileSchedule*  getScheduleTriggered (time_t = 0) const;  
         
+        //return the first instant after the given time (0 means now) at which the triggered schedule changes
+        //the search is limited to the given number of days ahead, the default covers a leap year cycle
+        //returns 0 if the scheduler is disabled or there is not any change within the days searched
+        time_t                  getNextTransition (time_t = 0, unsigned int maxDays = 4 * 366) const;
+        
         //returns a string containing all the schedules
         std::string             toString () const;
         
@@ -0,0 +1,75 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef RELAYBOARD_H
+#define RELAYBOARD_H
+
+#include "RelayDriver.hpp"
+#include <utility>
+
+//A relay device speaking the given protocol: LcusProtocol, ModbusProtocol or HidrawProtocol
+//The protocol is a template parameter, therefore its frame building and parsing are called directly and can be inlined
+//Only the frames of a batch go through the virtual functions of RelayDriver, the bytes never do
+template <class Protocol>
+class RelayBoard final : public RelayDriver
+{
+    public:
+        //Create a RelayBoard to manage a relay device with the given number of channels through the given protocol
+        //It looks like if more relay than available are configured there is not any error obviously the ones not available are not managed by the commands
+        //For the requests requiring an answer, it is possible specify the maximum time (in ms) to wait for it, the answer is read as soon as it arrives
+        //If the time is 0, the relay feedback is not checked
+        explicit RelayBoard (Protocol&& p, uint8_t channels = 8, unsigned int answaitms = 1000) :
+            RelayDriver (answaitms),
+            protocol    {std::move (p)}
+        {
+            probeChannels (channels);
+        }
+        
+        unsigned long frameErrors () const override
+        {
+            return protocol.frameErrors ();
+        }
+        
+    private:
+        Protocol    protocol;
+        
+        bool queueFrame (uint8_t channel, Command command, bool state) override
+        {
+            return protocol.queueFrame (channel, command, state);
+        }
+        
+        bool sendFrames (unsigned int answerWaitMs) override
+        {
+            return protocol.sendFrames (answerWaitMs);
+        }
+        
+        bool nextFeedback (uint8_t& channel, bool& state) override
+        {
+            return protocol.nextFeedback (channel, state);
+        }
+        
+        bool waitFeedback (std::chrono::steady_clock::time_point deadline) override
+        {
+            return protocol.waitFeedback (deadline);
+        }
+};
+
+#endif //RELAYBOARD_H
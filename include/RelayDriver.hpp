@@ -23,11 +23,13 @@
 #ifndef RELAYDRIVER_H
 #define RELAYDRIVER_H
 
-#include "SerialPort.hpp"
-#include <array>
+#include <string>
 #include <vector>
+#include <chrono>
 #include <cstdint>
 
+//The management of a relay device common to all the protocols: expected states, verify interval, batches and feedbacks
+//The protocol is provided by RelayBoard, the frames reach it through the protected virtual functions called once per frame
 class RelayDriver
 {
     public:        
@@ -56,22 +58,66 @@ class RelayDriver
             WRNGSTA,        //the relay feedback provides a different state than required 
         };
 
-        //Create an RelayDriver to manage a relay device with the given number of channels linked to the given serial port
-        //It looks like if more relay than available are configured there is not any error obviously the ones not available are not managed by the commands
-        //For the requests requiring an answer, it is possible specify the delay (in ms) to wait before check
-        //If the delay is 0, the relay feedback is not checked
-        explicit            RelayDriver (SerialPort&, uint8_t channels=8, unsigned int answaitms = 15);
+        //A command for a relay channel
+        struct Request
+        {
+            uint8_t     channel;
+            Command     command;
+        };
+        
+        //The outcome of a command for a relay channel: the feedback ON/OFF, NONE if not required or ERROR with its error
+        struct Result
+        {
+            uint8_t     channel;
+            Command     feedback;
+            Error       error;
+        };
+        
+        virtual             ~RelayDriver ();
         
         //Send the Command at the given relayChannel
         //If the command requires a feedback, the relay status ON/OFF is reported, otherwise NONE  
         Command             sendCommand (uint8_t channel, Command);
         
+        //Send the commands of many channels at once then collect the feedbacks matching them by channel, therefore the answer wait is paid only once
+        //A command setting a channel in the state already confirmed is not sent and its feedback is the confirmed state, until the verify interval elapses
+        //After the verify interval a command with feedback is replaced by a check, to catch the manual changes without driving the relay
+        //The results are in the same order of the requests, the last error is the one of the last failed command
+        //throws an exception if a channel is out of range or it appears twice
+        std::vector <Result> sendCommands (const std::vector <Request>&);
+        
         //Check if there is a relay feedback: ON/OFF
+        //The frames already received are used first, then it waits for the frame of the last channel commanded up to the answer wait
+        //The bytes of a partial frame are kept for the next call
         Command             recvCommand ();
         
+        //Set the number of channels managed then read the state of each of them from the relay device
+        //It must be called again every time the serial port is reopened
+        void                probeChannels (uint8_t channels);
+        
+        //Set the number of channels managed without reading their state, all of them are supposed off
+        void                setChannels (uint8_t channels);
+        
+        //Set the seconds after which the confirmed state of a channel is verified again by sendCommands, 0 sends every command
+        void                setVerifyInterval (unsigned int seconds);
+        
+        //Returns the number of frames sent to the relay
+        unsigned long       sentFrames () const;
+        
+        //Returns the number of frames not sent by sendCommands because the channel was already in the required state
+        unsigned long       suppressedFrames () const;
+        
+        //Read the state of the given channels from the relay device
+        //All the check requests are sent at once, then the answers are collected by channel number until all arrived or the answer wait expires
+        //returns the number of channels which answered, the state of the others is supposed off
+        unsigned int        probeChannels (const std::vector <uint8_t>& channels);
+        
         //Returns the last lastError happened
         Error               lastError () const;
         
+        //Returns the number of feedback frames dropped because corrupted or reporting an error
+        virtual unsigned long frameErrors () const = 0;
+        
         //Convert an lastError to a string
         static std::string  errorToString (Error);
         
@@ -87,22 +133,39 @@ class RelayDriver
         //Convert relay status true/false and feedback true/false to command
         static Command      relayFeedbackToCommand (bool relay, bool feedback);              
         
-    private:
-        static constexpr unsigned int               messageLength = 4;
+    protected:
+        //For the requests requiring an answer, it is possible specify the maximum time (in ms) to wait for it, the answer is read as soon as it arrives
+        //If the time is 0, the relay feedback is not checked
+        explicit            RelayDriver (unsigned int answaitms);
         
-        const uint8_t                               maxRelayChannels; //one more than the real number because [0] is not used!!!!
+        //Queue the frame driving the channel by the command, the state expected after it is given as well
+        //returns false if the frame could not be queued
+        virtual bool        queueFrame (uint8_t channel, Command, bool state) = 0;
+        
+        //Send all the frames queued, the ones with feedback may wait up to the given time for the relay to accept them
+        //returns false if they could not be sent
+        virtual bool        sendFrames (unsigned int answerWaitMs) = 0;
+        
+        //Returns the next feedback among the ones already received, false if there is not any
+        virtual bool        nextFeedback (uint8_t& channel, bool& state) = 0;
+        
+        //Wait for more feedbacks up to the deadline, returns false if nothing arrived
+        virtual bool        waitFeedback (std::chrono::steady_clock::time_point deadline) = 0;
+        
+    private:
+        uint8_t                                     maxRelayChannels; //one more than the real number because [0] is not used!!!!
         std::vector <bool>                          relayStates;
-        SerialPort&                                 serialPort;        
-        std::array <uint8_t, messageLength>         message;        
         const unsigned int                          answerWaitMs;
         Error                                       error;
         uint8_t                                     relayChannel;
+        std::vector <long long>                     confirmedMs;    //when the state of every channel was confirmed, -1 if it is not
+        long long                                   verifyIntervalMs;
+        unsigned long                               sent;
+        unsigned long                               suppressed;
         
-        bool            sendMessage ();
-        bool            recvMessage ();        
-        void            addCRC ();
-        uint8_t         computeCRC ();
-        bool            checkCRC ();
+        bool            queueCommand (uint8_t channel, Command);
+        bool            recvFeedback (uint8_t& channel, bool& state);
+        void            expectState (uint8_t channel, Command);
 };
 
 #endif //RELAYDRIVER_H
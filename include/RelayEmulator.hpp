@@ -0,0 +1,116 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef RELAYEMULATOR_H
+#define RELAYEMULATOR_H
+
+#include <string>
+#include <array>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+//Emulate an LCUS relay board behind a pseudo terminal which can be opened as a serial port through its path
+//The frames are answered by a background thread as the real board does, the wrong frames and the ones of missing channels are ignored
+//A misbehaving board can be emulated: late, dropped, corrupted or split replies and stuck relays
+//Every change of a relay state is recorded with the wall time of the Clock
+class RelayEmulator
+{
+    public:
+        //A relay state change
+        struct Action
+        {
+            long long   wallMs;
+            uint8_t     channel;
+            bool        state;
+        };
+        
+        //Create the pseudo terminal of a board with the given number of channels and start answering, all the relays are off
+        //throws an exception if the pseudo terminal cannot be created
+        explicit            RelayEmulator (uint8_t channels = 255);
+        
+        //Stop answering and close the pseudo terminal
+                            ~RelayEmulator ();
+        
+                            RelayEmulator (const RelayEmulator&) = delete;
+        RelayEmulator&      operator = (const RelayEmulator&) = delete;
+        
+        //returns the path of the pseudo terminal to be opened as serial port
+        const std::string&  getPath () const;
+        
+        //returns the state of the given relay channel
+        bool                getState (uint8_t channel) const;
+        
+        //wait until all the frames sent to the emulator were processed
+        void                waitIdle () const;
+        
+        //returns the relay state changes recorded since the previous call
+        std::vector <Action> takeActions ();
+        
+        //Set the time waited before every reply
+        void                setLatency (unsigned int ms);
+        
+        //Do not send one reply out of the given number, 0 sends all of them
+        void                setDropEvery (unsigned int replies);
+        
+        //Send a wrong checksum in one reply out of the given number, 0 corrupts none of them
+        void                setCorruptEvery (unsigned int replies);
+        
+        //Send every reply in two halves a couple of milliseconds apart
+        void                setSplitReplies (bool);
+        
+        //A stuck relay keeps its state whatever is commanded, the replies report the real state
+        void                setStuck (uint8_t channel, bool);
+        
+        //returns the number of valid frames received
+        unsigned long       receivedFrames () const;
+        
+    private:
+        static constexpr unsigned int   messageLength = 4;
+        static constexpr unsigned int   splitPauseUs = 2000;
+        
+        const uint8_t                   channels;
+        int                             masterDesc;
+        int                             slaveDesc;
+        int                             stopPipe [2];
+        std::string                     path;
+        std::array <bool, 256>          states;
+        std::array <bool, 256>          stuck;
+        unsigned int                    latencyMs;
+        unsigned int                    dropEvery;
+        unsigned int                    corruptEvery;
+        bool                            splitReplies;
+        unsigned long                   replies;
+        unsigned long                   received;
+        std::vector <Action>            actions;
+        mutable std::mutex              mutex;
+        std::atomic <bool>              busy;
+        std::thread                     worker;
+        
+        void            serve ();
+        void            processFrame (const std::array <uint8_t, messageLength>&);
+        void            closeDescriptors ();
+};
+
+#endif //RELAYEMULATOR_H
@@ -0,0 +1,130 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef ROLLUPSTORE_H
+#define ROLLUPSTORE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Summaries of the battery samples by minute, hour and day updated at every new sample
+//Each level is a fixed ring of buckets in a memory mapped file, a bucket is found directly from its time
+//The minutes are kept for a week, the hours for a year and the days for ten years
+//The hours and days follow the local time
+class RollupStore
+{
+    public:
+        enum Level {MINUTE, HOUR, DAY, LEVELS};
+        
+        static constexpr size_t maxProfiles = 8;
+        
+        //The summary of the samples in a time interval
+        struct Bucket
+        {
+            int64_t     startMs;                        //begin of the interval, 0 if there are no samples
+            double      sumCapacity;                    //sum of the capacities of the samples
+            uint32_t    samples;                        //number of valid samples
+            float       minCapacity;
+            float       maxCapacity;
+            float       coveredSeconds;                 //seconds between samples accounted in the interval
+            float       chargingSeconds;                //seconds with the charger enabled
+            float       profileSeconds [maxProfiles];   //seconds spent in each of the first profiles
+            float       chargedPercent;                 //capacity gained
+            float       dischargedPercent;              //capacity lost
+            float       energyInWh;                     //energy gained, if the battery reports its energy
+            float       energyOutWh;                    //energy lost, if the battery reports its energy
+            uint32_t    reserved;
+        };
+        
+        //Open the rollups at the given path, they are created if the file does not exist and it is not read only
+        //throws an exception if the file cannot be opened or it is not a rollup file
+        explicit            RollupStore (const std::string& path, bool readOnly = false);
+        
+        //Unmap and close the file
+                            ~RollupStore ();
+        
+                            RollupStore (const RollupStore&) = delete;
+        RollupStore&        operator = (const RollupStore&) = delete;
+        
+        //Add a sample to the buckets of all the levels
+        //The time from the previous sample is accounted to its charger state and profile, up to an hour to skip the time batguard was not running
+        //The energy is in Wh, negative if not available
+        void                add (long long wallMs, double capacity, double energyWh, bool charger, size_t profile, bool valid);
+        
+        //returns the summaries of the intervals of the given step from fromMs included to toMs excluded
+        //the begin is rounded down to the minute, the coarsest level whose buckets fit the intervals is used, the intervals without samples are not returned
+        //throws an exception if the step is not a multiple of a minute or the interval is empty
+        std::vector <Bucket> query (long long fromMs, long long toMs, long long stepMs) const;
+        
+        //returns the coarsest level whose buckets fit the intervals of the given step from fromMs to toMs
+        static Level        selectLevel (long long fromMs, long long toMs, long long stepMs);
+        
+        //returns the begin of the bucket of the given level containing the given time
+        static long long    bucketStart (Level, long long ms);
+        
+        //returns the begin of the bucket following the one beginning at the given time
+        static long long    nextBucket (Level, long long startMs);
+        
+        //returns the step in ms from a text with a unit: 15m, 2h, 1d or seconds without unit
+        //throws an exception if the text is not a step
+        static long long    parseStep (const std::string&);
+        
+        //returns the path of the rollup file
+        const std::string&  getPath () const;
+        
+    private:
+        struct Header
+        {
+            char        magic [8];
+            uint32_t    version;
+            uint32_t    bucketSize;
+            uint32_t    slots [LEVELS];
+            uint32_t    reserved;
+            int64_t     lastMs;
+            float       lastCapacity;
+            float       lastEnergyWh;
+            uint8_t     lastCharger;
+            uint8_t     lastProfile;
+            uint8_t     lastValid;
+            uint8_t     padding [5];
+        };
+        
+        static constexpr uint32_t   levelSlots [LEVELS] = {7 * 24 * 60, 366 * 24, 3660};
+        static constexpr size_t     headerBytes = 4096;
+        static_assert (sizeof (Bucket) == 88, "The bucket size is part of the file format");
+        
+        const std::string   path;
+        const bool          readOnly;
+        int                 fileDesc;
+        size_t              fileBytes;
+        Header*             header;
+        Bucket*             levels [LEVELS];
+        
+        Bucket&             bucketFor (Level, long long ms);
+        const Bucket*       findBucket (Level, long long startMs) const;
+        
+        static uint64_t     bucketNumber (Level, long long startMs);
+        static void         merge (Bucket& into, const Bucket&);
+};
+
+#endif //ROLLUPSTORE_H
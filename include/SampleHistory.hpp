@@ -0,0 +1,94 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef SAMPLEHISTORY_H
+#define SAMPLEHISTORY_H
+
+#include "BatteryReader.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+//A fixed size ring of the last battery samples with their time
+//There is a single writer, the control loop, which never allocates nor waits
+//The readers can be on other threads: they copy the records under a sequence lock and retry if the writer changed them meanwhile
+class SampleHistory
+{
+    public:
+        //A battery sample with the wall time in ms at which it was read
+        struct Record
+        {
+            long long   wallMs;
+            double      capacity;
+            double      rate;
+            int8_t      status;
+            int8_t      acOnline;
+            bool        valid;
+            bool        rateValid;
+            uint8_t     padding [4];
+        };
+        
+        //Create a ring storing the given number of records, it is all allocated here
+        //throws an exception if the size is 0
+        explicit            SampleHistory (size_t size);
+        
+                            SampleHistory (const SampleHistory&) = delete;
+        SampleHistory&      operator = (const SampleHistory&) = delete;
+        
+        //Add a record overwriting the oldest one if the ring is full, it must be called by a single thread
+        void                push (const Record&);
+        
+        //returns the maximum number of records
+        size_t              capacity () const;
+        
+        //returns the number of records stored
+        size_t              size () const;
+        
+        //Copy the last records up to the given maximum in the given array, the oldest first
+        //returns the number of records copied
+        size_t              snapshot (Record* out, size_t max) const;
+        
+        //returns all the records stored, the oldest first
+        std::vector <Record> snapshot () const;
+        
+        //Copy the last record in the given one, returns false if the ring is empty
+        bool                last (Record&) const;
+        
+        //returns a record of the given sample read at the given wall time in ms
+        static Record       toRecord (long long wallMs, const BatterySample&);
+        
+    private:
+        static constexpr size_t wordsPerRecord = sizeof (Record) / sizeof (uint64_t);
+        static_assert (sizeof (Record) % sizeof (uint64_t) == 0, "The record must be made of whole words");
+        
+        const size_t                                    length;
+        std::unique_ptr <std::atomic <uint64_t> []>     words;
+        std::atomic <uint64_t>                          sequence;
+        std::atomic <size_t>                            head;
+        std::atomic <size_t>                            count;
+        
+        void                storeRecord (size_t index, const Record&);
+        void                loadRecord (size_t index, Record&) const;
+};
+
+#endif //SAMPLEHISTORY_H
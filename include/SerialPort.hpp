@@ -32,7 +32,9 @@ class SerialPort
     public:
         //open a serial port at the given path
         //with the given baudrate, only standard ones are allowed
-        //with the maximum connection attempts after which throws an error, it waits a second before each trial
+        //with the maximum connection attempts, every attempt after the first one gives the device 2 seconds more to show up
+        //the directory of the device is watched meanwhile, therefore it is opened as soon as it appears
+        //if the device does not show up the port is left closed and it can be opened later by reconnect, any other error throws an exception
         //with the given number of bits
         //with the parity bit
         //with the single stop
@@ -40,17 +42,52 @@ class SerialPort
         //the serial port hardware/low-level driver has a write and a read buffers where data is written just before sending or after reception
         //this call has also its read and write buffers which are read or wrote byte per byte with calls
         //those read/write buffers are filled in/out with their flush calls
+        //the port is non-blocking, the flush calls wait for the port to be ready by poll up to their timeout
                         SerialPort (const std::string& path, const unsigned int baudrate, const uint8_t maxConnAttemp = 10, const uint8_t bits = 8, const bool parity=false, const bool singlestop=true, const bool flowctl=false);
         
         //the serial port is closed when the object is destroyed
                         ~SerialPort ();
         
+        //open the serial port at the given path with the given baudrate keeping the other settings
+        //the current port is closed only once the new one is correctly configured, otherwise an exception is thrown and the current port is kept
+        //the read and write buffers are emptied
+        void            reopen (const std::string& path, const unsigned int baudrate, const uint8_t maxConnAttemp);
+        
+        //returns the path of the serial port
+        const std::string& getPath () const;
+        
+        //returns true if the device is open, otherwise the writes are discarded and nothing is read
+        //the port is closed as soon as a read or a write finds the device hung up or removed, for instance the USB relay unplugged
+        bool            isOpen () const;
+        
+        //open again the device at the same path with the same settings without waiting for it
+        //the read and write buffers are emptied
+        //returns true if the port is open
+        bool            reconnect ();
+        
+        //check without waiting if the device was hung up or removed, then the port is closed
+        //returns true if the port is open
+        bool            checkLink ();
+        
+        //returns the number of times the device was lost while open
+        unsigned long   disconnections () const;
+        
+        //returns the ms from the last loss of the device to its reconnection, -1 if it was never reconnected
+        long long       lastRecoveryMs () const;
+        
+        //returns the total ms spent without the device after it was lost, including the current loss
+        long long       totalDownMs () const;
+        
+        //returns the baud rate of the serial port
+        unsigned int    getBaudRate () const;
+        
         //write a byte in the sending buffer but does not send it
-        //return true if there is space in the buffer for its addition to the queue
+        //return true if there is space in the buffer for its addition to the queue, otherwise the overflow is counted
         //gets the value of the byte to send
         bool            writeByte (uint8_t);
         
         //try to send all the bytes in the output buffer through the serial port, may be hardware/low-level-driver limitations
+        //if the driver buffer is full, it waits up to a second for some room
         //returns the number of byte actually sent
         //consider, there may be pending bytes in the pipe from the previous flush
         unsigned int    writeFlush ();
@@ -64,24 +101,71 @@ class SerialPort
         uint8_t         readByte ();
         
         //fill in the read buffer with all the bytes arrived the the serial port
+        //if nothing arrived, it waits up to a second for the first bytes
         //returns the number of bytes available on the read buffer
         //consider, there may be not-read bytes from the last flush
         unsigned int    readFlush ();
         
+        //fill in the read buffer until it holds at least the given number of bytes or the timeout in ms expires
+        //it returns as soon as the bytes are arrived, a timeout of 0 reads only the bytes already arrived
+        //returns the number of bytes available on the read buffer
+        unsigned int    readFlushUntil (unsigned int minBytes, unsigned int timeoutMs);
+        
         //returns the number of bytes to be read by readByte in the read buffer        
         unsigned int    bytesToRead () const;
         
+        //returns the byte at the given offset from the beginning of the read buffer without removing it
+        //throws an exception if the offset is not lower than bytesToRead
+        uint8_t         peekByte (unsigned int offset) const;
+        
+        //drop the given number of bytes from the beginning of the read buffer
+        //throws an exception if there are less bytes to read
+        void            consume (unsigned int);
+        
+        //returns the number of bytes refused by writeByte because the write buffer was full
+        unsigned long   writeOverflows () const;
+        
+        //returns the number of reads which found the read buffer full, the bytes are left to the serial driver until some room is made
+        unsigned long   readOverflows () const;
+        
     private:
-        const int                               serialDesc;
+        std::string                             serialPath;
+        unsigned int                            baudRate;
+        const uint8_t                           dataBits;
+        const bool                              parityBit;
+        const bool                              singleStop;
+        const bool                              flowControl;
+        int                                     serialDesc;
         static constexpr unsigned int           bufferSize = 128;
-        std::array <uint8_t, bufferSize>        readBuffer;
-        std::array <uint8_t, bufferSize>        writeBuffer;
-        unsigned int                            readBeg;
-        unsigned int                            readEnd;
-        unsigned int                            writeBeg; 
-        unsigned int                            writeEnd;        
+        static constexpr unsigned int           flushTimeoutMs = 1000;
+        static constexpr long long              trialWaitMs = 2000;
+        static_assert ((bufferSize & (bufferSize - 1)) == 0, "The buffer size must be a power of two");
+        
+        //A circular buffer, the positions grow freely and wrap around by the mask, therefore it is empty when they are equal and full when they differ by bufferSize
+        struct Ring
+        {
+            std::array <uint8_t, bufferSize>    data;
+            unsigned int                        head;   //position of the first byte stored
+            unsigned int                        tail;   //position after the last byte stored
+            
+            unsigned int size () const {return tail - head;}
+            unsigned int room () const {return bufferSize - size ();}
+            uint8_t&     at (unsigned int position) {return data [position & (bufferSize - 1)];}
+        };
+        
+        Ring                                    readBuffer;
+        Ring                                    writeBuffer;
+        unsigned long                           writeOverflowCount;
+        unsigned long                           readOverflowCount;
+        unsigned long                           disconnectCount;
+        long long                               downSinceMs;    //when the device was lost, -1 if it is open or it was never opened
+        long long                               lastRecovery;
+        long long                               totalDown;
         
         int      tryToOpen (const std::string&, const uint8_t);
+        bool     waitReady (short events, long long deadlineMs) const;
+        void     markDown ();
+        void     configure (int, const std::string&, const unsigned int);
 };
 
 #endif //SERIALPORT_H
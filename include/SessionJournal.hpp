@@ -0,0 +1,113 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#ifndef SESSIONJOURNAL_H
+#define SESSIONJOURNAL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//A journal of the charging sessions, from the charger turned on to the charger turned off, stored as fixed size records
+//The records are appended after a small header, the last one is still open while the charger is on and it is completed when the charger is turned off
+//An open session survives a restart, it is continued if the charger is still on after the restart
+class SessionJournal
+{
+    public:
+        //The reason of a charger state change
+        enum class Cause : uint8_t {NONE, START, MIN_THRESHOLD, MAX_THRESHOLD, USER_COMMAND, PROFILE_CHANGE, EXIT};
+        
+        static constexpr size_t profileNameSize = 28;
+        
+        //A charging session
+        struct Record
+        {
+            int64_t     startMs;        //wall time in ms of the charger turned on
+            int64_t     endMs;          //wall time in ms of the charger turned off, 0 while the session is open
+            float       startCapacity;  //battery capacity in percent
+            float       endCapacity;
+            float       startEnergyWh;  //battery energy in Wh, negative if not available
+            float       endEnergyWh;
+            Cause       startCause;
+            Cause       endCause;
+            uint8_t     padding [2];
+            char        profile [profileNameSize];  //name of the profile at the session start, truncated if longer
+        };
+        
+        //Open the journal at the given path, it is created if it does not exist and it is not read only
+        //throws an exception if the file cannot be opened or it is not a journal
+        explicit            SessionJournal (const std::string& path, bool readOnly = false);
+        
+        //Close the file
+                            ~SessionJournal ();
+        
+                            SessionJournal (const SessionJournal&) = delete;
+        SessionJournal&     operator = (const SessionJournal&) = delete;
+        
+        //Returns true if the last session is still open
+        bool                isOpen () const;
+        
+        //Append a new open session at the given time, capacity, energy in Wh (negative if not available) and profile name
+        //throws an exception if a session is already open or the file cannot be written
+        void                openSession (long long wallMs, double capacity, double energyWh, const std::string& profile, Cause);
+        
+        //Complete the open session at the given time, capacity and energy in Wh
+        //throws an exception if no session is open or the file cannot be written
+        void                closeSession (long long wallMs, double capacity, double energyWh, Cause);
+        
+        //Returns the number of sessions stored
+        size_t              size () const;
+        
+        //Append to the given vector the sessions overlapping the time from fromMs included to toMs excluded, the open session is still going on
+        //returns the number of sessions added
+        size_t              query (long long fromMs, long long toMs, std::vector <Record>&) const;
+        
+        //Returns the energy delivered by the session in Wh, negative if not available
+        static double       energyDelivered (const Record&);
+        
+        //Returns the cause as string
+        static std::string  causeToString (Cause);
+        
+        //returns the path of the journal file
+        const std::string&  getPath () const;
+        
+    private:
+        struct Header
+        {
+            char        magic [8];
+            uint32_t    version;
+            uint32_t    recordSize;
+        };
+        
+        static constexpr size_t readBlock = 256;
+        static_assert (sizeof (Record) == 64, "The record size is part of the file format");
+        
+        const std::string       path;
+        const bool              readOnly;
+        int                     fileDesc;
+        size_t                  records;
+        Record                  current;
+        
+        size_t              countRecords () const;
+        void                writeRecord (size_t index, const Record&);
+};
+
+#endif //SESSIONJOURNAL_H
@@ -0,0 +1,88 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "RelayEmulator.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <ctime>
+
+//Replay a recorded battery trace on the virtual Clock against an emulated relay
+//The trace file has a sample per line: time, capacity and optionally ac, the lines beginning with # are comments
+//The time is either seconds since the epoch or a local date as YYYY-MM-DD HH:MM[:SS], it must increase line by line
+//The capacity is from 0 to 100, the ac is 1 if the charger was plugged at the recording time, 0 otherwise
+//The capacity is written in a battery file inside a temporary directory which holds also the command and state files of the simulated devices
+class Simulation
+{
+    public:
+        //Read the trace, start the virtual clock at its first sample, create the temporary directory and the relay emulator
+        //The relay changes are written to the given stream as comma separated values
+        //throws an exception if the trace cannot be read or it is not correct
+        explicit            Simulation (const std::string& traceFile, std::ostream& actionsOutput);
+        
+        //Remove the temporary directory
+                            ~Simulation ();
+        
+                            Simulation (const Simulation&) = delete;
+        Simulation&         operator = (const Simulation&) = delete;
+        
+        //returns the path of the relay emulator to be opened as serial port
+        const std::string&  getRelayPath () const;
+        
+        //returns the path of the temporary directory to hold the battery, command and state files
+        const std::string&  getDirectory () const;
+        
+        //returns the path of the log file written next to the trace
+        const std::string&  getLogPath () const;
+        
+        //write the relay changes happened so far, then move the virtual clock forward by the given ms and update the battery file
+        //returns false if the trace ended
+        bool                advance (unsigned long ms);
+        
+        //write the relay changes happened so far
+        void                writeActions ();
+        
+    private:
+        struct Sample
+        {
+            time_t      time;
+            int         capacity;
+            int         ac;     //-1 if not recorded
+        };
+        
+        const std::vector <Sample>  trace;
+        std::ostream&               output;
+        const std::string           logPath;
+        std::string                 directory;
+        std::string                 batteryPath;
+        RelayEmulator               emulator;
+        size_t                      current;
+        
+        void                writeBattery ();
+        
+        static std::vector <Sample> readTrace (const std::string&);
+};
+
+#endif //SIMULATION_H
@@ -64,7 +64,10 @@ class StateFile
         //write on the runfile the name of the given profile index if not SIZE_MAX
         //then write the charger status if not LAST
         //eventually write the scheduler state if not LAST
-        Error                   write (const ChargeProfile* profile = nullptr, State charger = LAST, State scheduler = LAST) const;
+        Error                   write (const ChargeProfile* profile = nullptr, State charger = LAST, State scheduler = LAST);
+        
+        //returns true if the file content is not the one last read or written, for instance because a new command was written
+        bool                    isChangedOnFile () const;
         
         //returns the charger forced status if  if an optional on/off follows the state name
         //the runfile is updated removing the chargerInit value 
@@ -81,6 +84,12 @@ class StateFile
         //return true if the logger requires to be flushed 
         bool                    loggerInit () const;           
         
+        //change the path of the file read and written
+        void                    setFileName (const std::string&);
+        
+        //returns the path of the file read and written
+        const std::string&      getFileName () const;
+        
         //returns a string representing the internal state of the StateFile
         std::string             toString () const;
         
@@ -100,12 +109,13 @@ class StateFile
         static State            boolToState (bool);        
         
     private:
-        const std::string       fileName;
+        std::string             fileName;
         const ChargeProfiles&   chargeProfiles;
         State                   charger;
         State                   scheduler;
         const ChargeProfile*    profile;
         bool                    logger;
+        std::string             content;        //the file content last read or written
         
         void                    resetState ();
 };
@@ -0,0 +1,85 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef UEVENTLISTENER_H
+#define UEVENTLISTENER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+//Listen to the kernel uevents of the power supplies: batteries and chargers
+//Only the supplies watched are considered, their capacity, status and online values are kept to notice which ones changed
+//The values are not used as samples: the battery files give a finer capacity and the uevents are not sent at every capacity change by all the kernels
+class UeventListener
+{
+    public:
+        //Subscribe to the kernel uevents through a netlink socket
+        //throws an exception if the socket cannot be opened, for instance netlink is not available
+        explicit            UeventListener ();
+        
+        //Read the uevents from the given socket instead of the kernel, it is used to inject synthetic uevents
+        //The socket is closed when the object is destroyed
+        explicit            UeventListener (int socketDescriptor);
+        
+        //Close the socket
+                            ~UeventListener ();
+        
+                            UeventListener (const UeventListener&) = delete;
+        UeventListener&     operator = (const UeventListener&) = delete;
+        
+        //Watch the power supply with the given name, for instance BAT0 or AC
+        void                watchSupply (const std::string& name);
+        
+        //Stop watching all the power supplies
+        void                clearSupplies ();
+        
+        //returns the socket descriptor to be waited for reading
+        int                 getDescriptor () const;
+        
+        //Read all the pending uevents without blocking
+        //returns the names of the watched supplies whose capacity, status or online value changed
+        std::vector <std::string> readEvents ();
+        
+        //returns the power supply name from the path of one of its sysfs files: /sys/class/power_supply/BAT0/capacity gives BAT0
+        static std::string  supplyName (const std::string& path);
+        
+    private:
+        //The last values received for a power supply
+        struct Supply
+        {
+            std::string     name;
+            int             capacity;   //-1 if never received
+            std::string     status;     //empty if never received
+            int             online;     //-1 if never received
+        };
+        
+        const int               socketDesc;
+        std::vector <Supply>    supplies;
+        
+        //returns the name of the watched supply changed by the uevent, empty if none
+        std::string         parseEvent (std::string_view);
+        
+        static int          openKernelSocket ();
+};
+
+#endif //UEVENTLISTENER_H
@@ -0,0 +1,745 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "BatDevice.hpp"
+#include "Clock.hpp"
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+
+std::vector <Configuration> BatDevice::configurationTemplate ()
+{
+    return  {
+            Configuration ({"!UNIQUE!", "pollingtime",      "60"}),
+            Configuration ({"!UNIQUE!", "adaptivepolling",  "off",      "10",   "600"}),
+            Configuration ({"!UNIQUE!", "relaychannel",     "1"}),
+            Configuration ({"batterypath",                  "/sys/class/power_supply/BAT0/capacity"}),
+            Configuration ({"!UNIQUE!", "acsupply",         "AC"}),
+            Configuration ({"!UNIQUE!", "feedback",         "on"}),                        
+            Configuration ({"!UNIQUE!", "commandfilepath",  "/etc/batguard/command"}),
+            Configuration ({"!UNIQUE!", "statefilepath",    "/etc/batguard/state"}),
+            Configuration ({"!UNIQUE!", "chargerno",        "true"}),
+            Configuration ({"!UNIQUE!", "chargerexitlast",  "false"}),
+            Configuration ({"!UNIQUE!", "chargerexitstate", "off"}), 
+            Configuration ({"!UNIQUE!", "keepstate",        "true"}),
+            Configuration ({"!UNIQUE!", "historyhours",     "24"}),
+            Configuration ({"!OPTIONAL!",                   "historypath"}),
+            Configuration ({"!OPTIONAL!",                   "schedule"}),                        
+            Configuration ({"profile"})
+            };
+}
+
+std::string BatDevice::filePath (const ConfigReader& configReader, const std::string& property, const std::string& directory, const std::string& fileName)
+{
+    if (directory.empty ()) return configReader.fromConfiguration (property).getNextString ();
+    return directory + "/" + fileName;
+}
+
+size_t BatDevice::historySize (const ConfigReader& configReader)
+{
+    //the history is sized for the shortest sleep, when the polling is adaptive the samples are usually sparser
+    const bool          adaptive = configReader.fromConfiguration ("adaptivepolling").fromValue (0).getNextBool ();
+    const unsigned int  sleep = adaptive ? configReader.fromConfiguration ("adaptivepolling").fromValue (1).getNextUnsignedInt () : configReader.fromConfiguration ("pollingtime").getNextUnsignedInt ();
+    const unsigned long seconds = configReader.fromConfiguration ("historyhours").getNextUnsignedInt () * 3600UL;
+    
+    return std::min (maxHistorySize, std::max (static_cast <size_t> (2), static_cast <size_t> (seconds / std::max (sleep, 1U))));
+}
+
+std::vector <std::string> BatDevice::batteryFilePaths (const ConfigReader& configReader, const std::string& directory)
+{
+    if (directory.size ()) return {directory + "/capacity"};
+    
+    std::vector <std::string> paths;
+    
+    //many battery paths define batteries charged together
+    configReader.selectConfiguration ("batterypath");
+    do
+    {
+        paths.push_back (configReader.getNextString ());
+        
+        if (configReader.hasMoreValues ()) throw std::invalid_argument ("Battery path definition requires 1 argument instead were found " + std::to_string (configReader.numberOfValues ()) + " at " + configReader.currentConfigurationToString ());
+    }
+    while (configReader.gotoNextConfiguration ());
+    
+    return paths;
+}
+
+std::string BatDevice::onlineFilePath (const ConfigReader& configReader, const std::string& directory)
+{
+    if (directory.empty ()) return BatteryReader::onlinePath (configReader.fromConfiguration ("batterypath").getNextString (), configReader.fromConfiguration ("acsupply").getNextString ());
+    return directory + "/online";
+}
+
+BatDevice::BatDevice (const std::string& nm, const ConfigReader& configReader, RelayDriver& rd, LogWriter& lw, const std::string& dir, bool readOnlyHistory) :
+    name                {nm},
+    relayDriver         {rd},
+    logWriter           {lw},
+    profiles            {},
+    userCommand         {filePath (configReader, "commandfilepath", dir, (nm.size () ? nm : "device") + ".command"), profiles},
+    lastState           {filePath (configReader, "statefilepath", dir, (nm.size () ? nm : "device") + ".state"), profiles},
+    schedules           {},
+    batterySource       {batteryFilePaths (configReader, dir), onlineFilePath (configReader, dir)},
+    rateEstimator       {},
+    acSupply            {},
+    history             {historySize (configReader)},
+    store               {},
+    rollups             {},
+    sessions            {},
+    sleepTime           {0},
+    adaptivePolling     {false},
+    minSleepTime        {0},
+    maxSleepTime        {0},
+    checkFeedback       {false}, 
+    chargerAtNO         {false},
+    relayChannel        {0},
+    chargerExtLast      {false},
+    chargerExtState     {false},
+    keepState           {false},
+    currentProfile      {nullptr},               
+    chargerState        {false},
+    chargerCause        {SessionJournal::Cause::START},
+    profileChanged      {false},
+    nextCycleMs         {0}
+{
+    checkSettings (configReader);
+    
+    loadSettings (configReader);
+    
+    loadProfiles (configReader, profiles);
+    
+    currentProfile = profiles.getProfileWithIndex (0);
+    
+    loadSchedules (configReader, profiles, schedules);
+    
+    if (configReader.selectConfiguration ("historypath")) 
+    {
+        const std::string historyPath = filePath (configReader, "historypath", dir, (nm.size () ? nm : "device") + ".history");
+        
+        //the files are created by the running batguard, before that there is nothing to read
+        if (not readOnlyHistory or access (historyPath.c_str (), F_OK) == 0)
+        {
+            store = std::make_unique <HistoryStore> (historyPath, readOnlyHistory);
+            rollups = std::make_unique <RollupStore> (store->getPath () + ".rollup", readOnlyHistory);
+            sessions = std::make_unique <SessionJournal> (store->getPath () + ".sessions", readOnlyHistory);
+        }
+    }
+    
+    //the command file in the files directory does not exist yet
+    if (dir.size ()) userCommand.write ();
+}
+
+void BatDevice::checkSettings (const ConfigReader& cr)
+{
+    const unsigned int minst = cr.fromConfiguration ("adaptivepolling").fromValue (1).getNextUnsignedInt ();
+    const unsigned int maxst = cr.fromConfiguration ("adaptivepolling").fromValue (2).getNextUnsignedInt ();
+    if (minst == 0 or minst > maxst) throw std::invalid_argument ("The adaptive polling requires 0 < min <= max seconds instead it was found min: " + std::to_string (minst) + ", max: " + std::to_string (maxst));
+    
+    //the relay channels are numbered from 1
+    if (cr.fromConfiguration ("relaychannel").getNextUnsignedInt8 () == 0) throw std::invalid_argument ("The relay channel shall be greater than 0");
+    
+    //all the remaining settings are parsed here to rise any exception before they are applied
+    cr.fromConfiguration ("pollingtime").getNextUnsignedInt ();
+    cr.fromConfiguration ("adaptivepolling").fromValue (0).getNextBool ();
+    cr.fromConfiguration ("feedback").getNextBool ();
+    cr.fromConfiguration ("chargerno").getNextBool ();
+    cr.fromConfiguration ("chargerexitlast").getNextBool ();
+    cr.fromConfiguration ("chargerexitstate").getNextBool ();
+    cr.fromConfiguration ("keepstate").getNextBool ();
+    cr.fromConfiguration ("historyhours").getNextUnsignedInt ();
+}
+
+void BatDevice::loadSettings (const ConfigReader& configReader)
+{
+    sleepTime       = configReader.fromConfiguration ("pollingtime").getNextUnsignedInt ();
+    acSupply        = configReader.fromConfiguration ("acsupply").getNextString ();
+    adaptivePolling = configReader.fromConfiguration ("adaptivepolling").fromValue (0).getNextBool ();
+    minSleepTime    = configReader.fromConfiguration ("adaptivepolling").fromValue (1).getNextUnsignedInt ();
+    maxSleepTime    = configReader.fromConfiguration ("adaptivepolling").fromValue (2).getNextUnsignedInt ();
+    checkFeedback   = configReader.fromConfiguration ("feedback").getNextBool ();
+    chargerAtNO     = configReader.fromConfiguration ("chargerno").getNextBool ();
+    relayChannel    = configReader.fromConfiguration ("relaychannel").getNextUnsignedInt8 ();
+    chargerExtLast  = configReader.fromConfiguration ("chargerexitlast").getNextBool ();
+    chargerExtState = configReader.fromConfiguration ("chargerexitstate").getNextBool ();
+    keepState       = configReader.fromConfiguration ("keepstate").getNextBool ();
+}
+
+bool BatDevice::log (LogWriter::Level level, const std::string& mes)
+{
+    //the messages of the named devices are tagged since they share the same log file
+    if (name.size ()) return logWriter.writeMessage (level, "[" + name + "] " + mes);
+    return logWriter.writeMessage (level, mes);
+}
+
+const std::string& BatDevice::getName () const
+{
+    return name;
+}
+
+uint8_t BatDevice::getRelayChannel () const
+{
+    return relayChannel;
+}
+
+const std::string& BatDevice::getCommandFileName () const
+{
+    return userCommand.getFileName ();
+}
+
+bool BatDevice::isCommandPending () const
+{
+    return userCommand.isChangedOnFile ();
+}
+
+const std::string& BatDevice::getStateFileName () const
+{
+    return lastState.getFileName ();
+}
+
+const SampleHistory& BatDevice::getHistory () const
+{
+    return history;
+}
+
+const HistoryStore* BatDevice::getStore () const
+{
+    return store.get ();
+}
+
+std::vector <std::string> BatDevice::getBatteryPaths () const
+{
+    return batterySource.getPaths ();
+}
+
+const std::string& BatDevice::getAcSupply () const
+{
+    return acSupply;
+}
+
+void BatDevice::restoreState ()
+{
+    if (keepState)
+    {
+        const StateFile::Error err = lastState.read ();
+        if (err == StateFile::Error::NO)
+        {
+            if (lastState.profileInit () != nullptr) currentProfile = lastState.profileInit (); 
+            if (lastState.chargerInit () != StateFile::State::LAST) chargerState = StateFile::stateToBool (lastState.chargerInit ());
+            if (lastState.schedulerInit () != StateFile::State::LAST) schedules.setEnable (StateFile::stateToBool (lastState.schedulerInit ()));        
+        }
+        else
+        {
+            log (LogWriter::Level::ERROR, "It was not possible to read the state file due to the following error: " + StateFile::errorToString (err)); 
+        }
+    }        
+}
+
+void BatDevice::adoptStateOf (BatDevice& old)
+{
+    //the profiles do not move in memory when the device is replaced, therefore the current one is searched by name
+    currentProfile = profiles.getProfileWithName (old.currentProfile->name);
+    if (currentProfile == nullptr) 
+    {
+        currentProfile = profiles.getProfileWithIndex (0);
+        log (LogWriter::Level::ERROR, "The current profile " + old.currentProfile->name + " is not defined anymore, it is replaced by: " + currentProfile->toString ());
+    }
+    
+    chargerState = old.chargerState;
+    
+    if (old.schedules.getNumOfSchedules () and schedules.getNumOfSchedules ()) schedules.setEnable (old.schedules.isEnabled ());
+    
+    if (batterySource.getPaths () == old.batterySource.getPaths () and acSupply == old.acSupply)
+    {
+        batterySource = std::move (old.batterySource);
+        rateEstimator = std::move (old.rateEstimator);
+        
+        //the history size may be changed, therefore the records are copied
+        for (const SampleHistory::Record& record : old.history.snapshot ()) history.push (record);
+    }
+    
+    log (LogWriter::Level::BASIC, "The configuration was reloaded, the current profile is: " + currentProfile->toString ());
+}
+
+void BatDevice::writeState ()
+{
+    if  (keepState)
+    {
+        const StateFile::Error err = lastState.read ();        
+        
+        if (err != StateFile::Error::NO or lastState.isChangedRespectTo (currentProfile, StateFile::boolToState (chargerState), StateFile::boolToState (schedules.isEnabled ()))) 
+        {
+            const StateFile::Error erw = lastState.write (currentProfile, StateFile::boolToState (chargerState), StateFile::boolToState (schedules.isEnabled ()));
+            if (erw != StateFile::Error::NO) log (LogWriter::Level::ERROR, "It was not possible to write the state file due to the following error: " + StateFile::errorToString (erw));
+        }        
+    }
+}
+
+void BatDevice::loadProfiles (const ConfigReader& configReader, ChargeProfiles& profiles)
+{
+    configReader.selectConfiguration ("profile"); 
+        
+    //profile is mandatory at least one must be present    
+    do
+    {
+        const std::string   pnm = configReader.getNextString ();
+        const uint8_t       cmi = configReader.getNextUnsignedInt8 ();
+        const uint8_t       cma = configReader.getNextUnsignedInt8 ();
+        const bool          cin = configReader.getNextBool ();
+        
+        if (configReader.hasMoreValues ()) throw std::invalid_argument ("Profile definition requires 4 arguments instead were found " + std::to_string (configReader.numberOfValues ()) + " at " + configReader.currentConfigurationToString ());
+        
+        try
+        {
+            profiles.addProfile (ChargeProfile (pnm, cmi, cma, cin));
+        }
+        catch (const std::invalid_argument& exc)
+        {
+            throw std::invalid_argument (exc.what () + std::string (" during the addition of the profile: ") + configReader.currentConfigurationToString ());                                    
+        }                        
+    }
+    while (configReader.gotoNextConfiguration ());   
+}
+
+void BatDevice::loadSchedules (const ConfigReader& configReader, const ChargeProfiles& profiles, ProfileSchedules& schedules)
+{
+    //schedules are optional, they may miss at all
+    if (configReader.selectConfiguration ("schedule")) 
+    {
+        do
+        {
+            const bool                ena = configReader.getNextBool ();
+            const std::vector <bool>  moy = configReader.getNextListOfBoolDescription (12);
+            const std::vector <bool>  dom = configReader.getNextListOfBoolDescription (31);
+            const std::vector <bool>  dow = configReader.getNextListOfBoolDescription (7);
+            const std::vector <int>   fhm = configReader.getNextListOfInt (2);
+            const std::vector <int>   thm = configReader.getNextListOfInt (2);
+            const std::string         pnm = configReader.getNextString ();
+            
+            if (configReader.hasMoreValues ()) throw std::invalid_argument ("Schedule definition requires 7 arguments instead were found " + std::to_string (configReader.numberOfValues ()) + " at " + configReader.currentConfigurationToString ());
+            
+            try
+            {
+                schedules.addSchedule (ProfileSchedule (ena, moy, dom, dow, HourMin (fhm), HourMin (thm), profiles.getProfileWithName (pnm)));
+            }
+            catch (const std::invalid_argument& exc)
+            {
+                throw std::invalid_argument (exc.what () + std::string (" during the addition of the schedule: ") + configReader.currentConfigurationToString ());
+            }        
+        }
+        while (configReader.gotoNextConfiguration ());
+        
+        schedules.setEnable (true);
+    }    
+}
+
+RelayDriver::Request BatDevice::beginCycle ()
+{
+    selectCurrentProfile ();
+
+    computeChargerState ();
+    
+    return relayRequest ();
+}
+
+void BatDevice::endCycle (long long nowMs, const RelayDriver::Result& result)
+{
+    checkRelayResult (result);
+    
+    if (store) appendRecord (result);
+    
+    if (sessions) trackSession (chargerCause);
+    
+    if (userCommand.loggerInit ()) logWriter.flushMessages ();
+    
+    writeState ();
+    
+    nextCycleMs = nowMs + static_cast <long long> (computeTimeout ());
+}
+
+unsigned long BatDevice::msToNextCycle (long long nowMs) const
+{
+    return nextCycleMs > nowMs ? static_cast <unsigned long> (nextCycleMs - nowMs) : 0;
+}
+
+void BatDevice::requestCycle ()
+{
+    nextCycleMs = 0;
+}
+
+void BatDevice::applyExitState ()
+{
+    if (not chargerExtLast)
+    {
+        chargerState = chargerExtState;
+        
+        sendRelayCommand ();
+        
+        if (sessions) trackSession (SessionJournal::Cause::EXIT);
+    }
+}
+
+unsigned int BatDevice::computeAdaptiveSleep () const
+{
+    //only the threshold which would change the charger state matters: above the max while charging, below the min while discharging
+    const double target = chargerState ? currentProfile->maxCharge : currentProfile->minCharge;
+    double seconds = rateEstimator.secondsToReach (target, chargerState);
+    
+    //until a rate is measured, the instantaneous one reported by the battery is used
+    const BatterySample& sample = batterySource.getSample ();
+    if (seconds < 0.0 and not rateEstimator.hasRate (chargerState) and sample.rateValid and sample.rate != 0.0) seconds = (target - sample.capacity) / sample.rate;
+    
+    //without any rate the polling time is used, still within the adaptive bounds
+    if (seconds < 0.0) return rateEstimator.hasRate (chargerState) ? maxSleepTime : std::min (std::max (sleepTime, minSleepTime), maxSleepTime);
+    
+    //sleeping half of the predicted time makes the sampling denser while the threshold approaches
+    const double half = seconds / 2.0;
+    if (half <= minSleepTime) return minSleepTime;
+    if (half >= maxSleepTime) return maxSleepTime;
+    return static_cast <unsigned int> (half);
+}
+
+unsigned long BatDevice::computeTimeout () const
+{
+    unsigned long timeout = (adaptivePolling ? computeAdaptiveSleep () : sleepTime) * 1000UL;
+    
+    //only the transitions happening before the polling time are of interest
+    const time_t next = schedules.getNextTransition (0, static_cast <unsigned int> (timeout / 86400000UL + 1));
+    
+    if (next)
+    {
+        //the timer runs on the monotonic clock, a small margin ensures the wake up happens after the boundary on the wall clock
+        const long long toNext = static_cast <long long> (next) * 1000LL - Clock::wallMs () + transitionMarginMs;
+        
+        if (toNext >= 0 and static_cast <unsigned long long> (toNext) < timeout) timeout = static_cast <unsigned long> (toNext);
+    }
+    
+    return timeout;
+}
+
+void BatDevice::selectCurrentProfile ()
+{
+    const StateFile::Error usrCmdRd = userCommand.read ();
+    
+    if (usrCmdRd != StateFile::Error::NO) log (LogWriter::Level::ERROR, "The command file was not correctly formed and will be ignored: " + StateFile::errorToString (usrCmdRd));
+    
+    //Once the commands are read, the file is emptied
+    if (usrCmdRd != StateFile::Error::NO or userCommand.isChangedRespectTo ()) userCommand.write ();
+
+    //this must be done soon to allow the scheduler disable and profile change with a single command 
+    if (userCommand.schedulerInit () != StateFile::State::LAST) 
+    {                
+        schedules.setEnable (StateFile::stateToBool (userCommand.schedulerInit ()));
+        log (LogWriter::Level::BASIC, std::string ("The command file required to change the scheduler state to: ") + (userCommand.schedulerInit () == StateFile::State::ON ? "enabled" : "disabled"));                
+    }
+    
+    profileChanged = false;
+    const ProfileSchedule* profileSchedTrig = schedules.getScheduleTriggered ();
+    const ChargeProfile* profileUserComnd = userCommand.profileInit ();
+    if (profileSchedTrig != nullptr)
+    {
+        if (profileSchedTrig->profile != currentProfile) 
+        {
+            profileChanged = true;
+            currentProfile = profileSchedTrig->profile;
+            log (LogWriter::Level::BASIC, "The following schedule triggered: " + profileSchedTrig->toString ());                            
+        }
+        if (profileUserComnd != nullptr and profileUserComnd != currentProfile) log (LogWriter::Level::ERROR, "Since a schedule is triggering, it was ignored the command file to switch to the profile: " + profileUserComnd->toString () + ", disable the scheduler to force a profile");
+    }
+    else 
+    {            
+        if (profileUserComnd != nullptr and profileUserComnd != currentProfile) 
+        {
+            profileChanged = true;
+            currentProfile = profileUserComnd;
+            log (LogWriter::Level::BASIC, "The command file required to change the current profile to: " + currentProfile->toString ());                    
+        }
+    }        
+}    
+
+void BatDevice::computeChargerState ()
+{        
+    const BatterySample& sample = batterySource.readSample ();
+    const double charge = sample.capacity;
+    const std::string chargeText = BatteryReader::capacityToString (charge);
+    
+    history.push (SampleHistory::toRecord (Clock::wallMs (), sample));
+    
+    //every battery which cannot be read is reported, the others are still used
+    for (const BatteryReader& pack : batterySource.getPacks ())
+    {
+        if (not pack.getSample ().valid) log (LogWriter::Level::ERROR, "It was not possible to read the battery capacity file: " + pack.getPath () + (sample.valid ? ", it is left out of the combined capacity" : ", the last capacity read is used: " + chargeText));
+        else if (batterySource.getPacks ().size () > 1) log (LogWriter::Level::FULL, "Battery " + pack.getPath () + " capacity: " + BatteryReader::capacityToString (pack.getSample ().capacity));
+    }
+    
+    //the charger state is still the one applied since the previous sample
+    if (sample.valid) rateEstimator.addSample (charge, ChargeRateEstimator::monotonicSeconds (), chargerState);
+    
+    if (sample.rateValid) log (LogWriter::Level::FULL, "The battery reports a rate of: " + BatteryReader::capacityToString (sample.rate * 3600.0) + "%/h");
+    
+    //the variation is taken from the last two valid records of the history
+    //the fractional capacity has some noise, therefore only variations of at least half percent are reported
+    SampleHistory::Record last [2];
+    const double delta = (history.snapshot (last, 2) == 2 and last [0].valid and last [1].valid) ? last [1].capacity - last [0].capacity : 0.0;
+    
+    if (chargerState)
+    {
+        if (delta <= -0.5) log (LogWriter::Level::ERROR, "The battery capacity is decreasing although the charger is turned on, last capacity variation measured is: " + BatteryReader::capacityToString (delta));
+    }
+    else
+    {
+        if (delta >= 0.5) log (LogWriter::Level::ERROR, "The battery capacity is increasing although the charger is turned off, last capacity variation measured is: " + BatteryReader::capacityToString (delta));
+    }
+        
+    if      (charge < currentProfile->minCharge) 
+    {            
+        if (chargerState == false)  log (LogWriter::Level::BASIC, "Capacity: " + chargeText + " went below the min threshold, the charger is turned on");
+        else                        log (LogWriter::Level::FULL, "Capacity: " + chargeText + " is still below the min threshold, the charger stays on"); 
+
+        if (userCommand.chargerInit () == StateFile::State::OFF) log (LogWriter::Level::ERROR, "Charger-off user-command was ignored because the battery charge is too low, change to a wider charge profile to force the charger state");                                
+        
+        chargerState = true;
+        chargerCause = SessionJournal::Cause::MIN_THRESHOLD;
+    }
+    else if (charge > currentProfile->maxCharge) 
+    {            
+        if (chargerState == true)   log (LogWriter::Level::BASIC, "Capacity: " + chargeText + " went above the max threshold, the charger is turned off");
+        else                        log (LogWriter::Level::FULL, "Capacity: " + chargeText + " is still above the max threshold, the charger stays off"); 
+        
+        if (userCommand.chargerInit () == StateFile::State::ON) log (LogWriter::Level::ERROR, "Charger-on user-command was ignored because the battery charge is too high, change to a wider charge profile profile to force the charger state");
+        
+        chargerState = false;
+        chargerCause = SessionJournal::Cause::MAX_THRESHOLD;
+    }
+    //this order of else if is to allows to change profile and set the charger in a single editing of the command file
+    else if (userCommand.chargerInit () != StateFile::State::LAST) 
+    {
+        chargerState = StateFile::stateToBool (userCommand.chargerInit ());
+        chargerCause = SessionJournal::Cause::USER_COMMAND;
+        
+        log (LogWriter::Level::BASIC, std::string ("The command file forced the charger to: ") + (chargerState ? "enabled" : "disabled"));
+    }
+    else if (profileChanged)
+    {
+        chargerState = currentProfile->startState;
+        chargerCause = SessionJournal::Cause::PROFILE_CHANGE;
+        
+        log (LogWriter::Level::BASIC, std::string ("A profile change forced the charger to its initial state: ") + (chargerState ? "enabled" : "disabled"));            
+    }
+    else
+    {
+        //the charger keeps the state found at start, restored or adopted
+        chargerCause = SessionJournal::Cause::START;
+        
+        log (LogWriter::Level::FULL, std::string ("Capacity: " + chargeText + " is still between min and max thresholds, the charger stays: " + (chargerState ? "enabled" : "disabled"))); 
+    }        
+}
+
+void BatDevice::appendRecord (const RelayDriver::Result& result)
+{
+    const BatterySample& sample = batterySource.getSample ();
+    
+    HistoryStore::Record record {};
+    record.wallMs       = Clock::wallMs ();
+    record.capacity     = static_cast <float> (sample.capacity);
+    record.rate         = static_cast <float> (sample.rate * 3600.0);
+    record.charger      = chargerState;
+    record.profile      = static_cast <uint8_t> (profileIndex ());
+    record.relay        = static_cast <uint8_t> (result.feedback);
+    record.relayError   = static_cast <uint8_t> (result.error);
+    record.acOnline     = static_cast <int8_t> (sample.acOnline);
+    record.valid        = sample.valid;
+    record.rateValid    = sample.rateValid;
+    
+    try
+    {
+        store->append (record);
+        rollups->add (record.wallMs, sample.capacity, batteryEnergyWh (), chargerState, record.profile, sample.valid);
+    }
+    catch (const std::runtime_error& e)
+    {
+        log (LogWriter::Level::ERROR, e.what ());
+    }
+}
+
+void BatDevice::trackSession (SessionJournal::Cause cause)
+{
+    //a session open before a restart goes on if the charger is still on
+    if (chargerState == sessions->isOpen ()) return;
+    
+    const BatterySample& sample = batterySource.getSample ();
+    
+    try
+    {
+        if (chargerState)   sessions->openSession (Clock::wallMs (), sample.capacity, batteryEnergyWh (), currentProfile->name, cause);
+        else                sessions->closeSession (Clock::wallMs (), sample.capacity, batteryEnergyWh (), cause);
+    }
+    catch (const std::runtime_error& e)
+    {
+        log (LogWriter::Level::ERROR, e.what ());
+    }
+}
+
+double BatDevice::batteryEnergyWh () const
+{
+    const BatterySample& sample = batterySource.getSample ();
+    
+    return sample.energyFull > 0.0 ? sample.energyNow / 1000000.0 : -1.0;
+}
+
+size_t BatDevice::profileIndex () const
+{
+    size_t index = 0;
+    while (profiles.getProfileWithIndex (index) != currentProfile) ++ index;
+    return index;
+}
+
+RelayDriver::Request BatDevice::relayRequest () const
+{
+    return {relayChannel, RelayDriver::relayFeedbackToCommand (chargerAtNO == chargerState, checkFeedback)};
+}
+
+RelayDriver::Result BatDevice::sendRelayCommand ()
+{
+    const RelayDriver::Result result = relayDriver.sendCommands ({relayRequest ()}).front ();
+    
+    checkRelayResult (result);
+    
+    return result;
+}
+
+void BatDevice::checkRelayResult (const RelayDriver::Result& result)
+{
+	const bool relayState = (chargerAtNO == chargerState);
+    const RelayDriver::Command feedback = result.feedback;
+
+	if (feedback == RelayDriver::Command::ERROR)
+	{
+		log (LogWriter::Level::ERROR, std::string ("There was an error setting the charger to: ") + (chargerExtState ? "enabled" : "disabled") + ", the command sent to the relay returned the error: " + RelayDriver::errorToString (result.error));
+		
+        //retry to send the last command without feedback because it is ignored
+		relayDriver.sendCommand (relayChannel, RelayDriver::relayFeedbackToCommand (relayState, false));
+	}
+	else if (checkFeedback and RelayDriver::commandToBool (feedback) != relayState) 
+	{
+		log (LogWriter::Level::ERROR, std::string ("There was an error setting the charger to: ") + (chargerExtState ? "enabled" : "disabled") + ", the relay feedback was: " + RelayDriver::commandToString (feedback) + " does not match its required state: " + (relayState ? "enabled" : "disabled"));
+		
+        //retry to send the last command without feedback because it is ignored
+		relayDriver.sendCommand (relayChannel, RelayDriver::relayFeedbackToCommand (relayState, false));
+	}
+}	
+
+std::string BatDevice::sendCommandRelay (const std::string & cmd)
+{
+    RelayDriver::Command c = relayDriver.sendCommand (relayChannel, RelayDriver::stringToCommand (cmd));
+    
+    if (c != RelayDriver::Command::ERROR) return RelayDriver::commandToString (c);
+    
+    return RelayDriver::errorToString (relayDriver.lastError ());
+}
+
+std::string BatDevice::getBatteryCapacity () const
+{
+    return batterySource.toString ();
+}
+
+std::string BatDevice::getChargeProfiles () const
+{
+    return profiles.toString ();
+}
+
+std::string BatDevice::getUserCommand ()
+{
+    StateFile::Error err = userCommand.read ();
+    if (err == StateFile::Error::NO) return userCommand.toString ();
+    return "Error reading the command file: " + StateFile::errorToString (err);
+}
+
+std::string BatDevice::getLastState ()
+{
+    StateFile::Error err = lastState.read ();
+    if (err == StateFile::Error::NO) return lastState.toString ();
+    return "Error reading the state file: " + StateFile::errorToString (err);
+}
+
+std::string BatDevice::getProfileSchedules () const
+{
+    std::string output;
+    if (schedules.getNumOfSchedules ()) output += schedules.toString ();
+    else output += "No schedule is defined\n";
+    
+    const ProfileSchedule* st = schedules.getScheduleTriggered ();
+    if (st != nullptr) output += "There is a schedule triggering: " + st->toString ();
+    else output += "No schedule is triggering.";
+    
+    const time_t next = schedules.getNextTransition ();
+    if (next)
+    {
+        char date [64];
+        strftime (date, sizeof (date), "%Y-%m-%d %H:%M", localtime (& next));
+        output += std::string ("\nThe triggered schedule will change at: ") + date;
+    }
+    return output;
+}
+
+std::string BatDevice::getHistorySummary (long long fromMs, long long toMs, long long stepMs) const
+{
+    if (not rollups) return "The history is not recorded, define historypath in the configuration file and run batguard\n";
+    
+    auto number = [] (double value) {return BatteryReader::capacityToString (value);};
+    
+    std::string res {"time,samples,min,max,mean,charging_h,charged_%,discharged_%,energy_in_Wh,energy_out_Wh"};
+    for (size_t p = 0; p < std::min (profiles.numberOfProfiles (), RollupStore::maxProfiles); ++ p) res += "," + profiles.getProfileWithIndex (p)->name + "_h";
+    res += '\n';
+    
+    for (const RollupStore::Bucket& b : rollups->query (fromMs, toMs, stepMs))
+    {
+        res += Clock::formatTime (static_cast <time_t> (b.startMs / 1000)) + ',' + std::to_string (b.samples) + ',';
+        res += (b.samples ? number (b.minCapacity) + ',' + number (b.maxCapacity) + ',' + number (b.sumCapacity / b.samples) : std::string (",,")) + ',';
+        res += number (b.chargingSeconds / 3600.0) + ',' + number (b.chargedPercent) + ',' + number (b.dischargedPercent) + ',' + number (b.energyInWh) + ',' + number (b.energyOutWh);
+        for (size_t p = 0; p < std::min (profiles.numberOfProfiles (), RollupStore::maxProfiles); ++ p) res += ',' + number (b.profileSeconds [p] / 3600.0);
+        res += '\n';
+    }
+    
+    return res;
+}
+
+std::string BatDevice::getSessions (long long fromMs, long long toMs) const
+{
+    if (not sessions) return "The sessions are not recorded, define historypath in the configuration file and run batguard\n";
+    
+    auto number = [] (double value) {return BatteryReader::capacityToString (value);};
+    
+    std::vector <SessionJournal::Record> records;
+    sessions->query (fromMs, toMs, records);
+    
+    std::string res {"start,end,minutes,start_%,end_%,energy_Wh,profile,start_cause,end_cause\n"};
+    for (const SessionJournal::Record& r : records)
+    {
+        const double energy = SessionJournal::energyDelivered (r);
+        
+        res += Clock::formatTime (static_cast <time_t> (r.startMs / 1000)) + ',';
+        res += (r.endMs ? Clock::formatTime (static_cast <time_t> (r.endMs / 1000)) + ',' + number (static_cast <double> (r.endMs - r.startMs) / 60000.0) : std::string (",")) + ',';
+        res += number (r.startCapacity) + ',' + (r.endMs ? number (r.endCapacity) : std::string ()) + ',' + (energy >= 0.0 ? number (energy) : std::string ()) + ',';
+        res += std::string (r.profile, strnlen (r.profile, SessionJournal::profileNameSize)) + ',' + SessionJournal::causeToString (r.startCause) + ',' + (r.endMs ? SessionJournal::causeToString (r.endCause) : std::string ("open")) + '\n';
+    }
+    
+    return res;
+}
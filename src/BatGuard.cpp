@@ -21,151 +21,302 @@
  */
  
 #include "BatGuard.hpp"
-#include <unistd.h>
+#include "EventLoop.hpp"
+#include "UeventListener.hpp"
+#include "Clock.hpp"
+#include "RelayBoard.hpp"
+#include "LcusProtocol.hpp"
+#include "ModbusProtocol.hpp"
+#include "HidrawProtocol.hpp"
+#include <climits>
+#include <iostream>
+#include <algorithm>
 
 const std::string BatGuard::nameVersion {"batguard version 1.3.6 released on 2025/3/08"};
 
-BatGuard::BatGuard (const std::string& cfn) :
-    configReader    (   {
-                        Configuration ({"!UNIQUE!", "serialpath",       "/dev/ttyRELAY0"}), 
-                        Configuration ({"!UNIQUE!", "serialbaud",       "9600"}),
-                        Configuration ({"!UNIQUE!", "serialtrials",     "5"}), 
-                        Configuration ({"!UNIQUE!", "pollingtime",      "60"}),
-                        Configuration ({"!UNIQUE!", "relaychannel",     "1"}),
-                        Configuration ({"!UNIQUE!", "batterypath",      "/sys/class/power_supply/BAT0/capacity"}),
-                        Configuration ({"!UNIQUE!", "logpath",          "/var/log/batguard.log"}),
-                        Configuration ({"!UNIQUE!", "loglevel",         "2"}),
-                        Configuration ({"!UNIQUE!", "logflush",         "1",        "10"}),
-                        Configuration ({"!UNIQUE!", "logmaxlines",      "1000"}),
-                        Configuration ({"!UNIQUE!", "feedback",         "on"}),                        
-                        Configuration ({"!UNIQUE!", "commandfilepath",  "/etc/batguard/command"}),
-                        Configuration ({"!UNIQUE!", "statefilepath",    "/etc/batguard/state"}),
-                        Configuration ({"!UNIQUE!", "chargerno",        "true"}),
-                        Configuration ({"!UNIQUE!", "chargerexitlast",  "false"}),
-                        Configuration ({"!UNIQUE!", "chargerexitstate", "off"}), 
-                        Configuration ({"!UNIQUE!", "keepstate",        "true"}),
-                        Configuration ({"!OPTIONAL!",                   "schedule"}),                        
-                        Configuration ({"profile"})
-                        }, 
-                        (cfn.size () ? cfn : "/etc/batguard/config")
-                    ),
-    serialPort          {configReader.fromConfiguration ("serialpath").getNextString (), configReader.fromConfiguration ("serialbaud").getNextUnsignedInt (), configReader.fromConfiguration ("serialtrials").getNextUnsignedInt8 ()},
-    relayDriver         {serialPort, configReader.fromConfiguration ("relaychannel").getNextUnsignedInt8 ()},
-    profiles            {},
-    userCommand         {configReader.fromConfiguration ("commandfilepath").getNextString (), profiles},
-    lastState           {configReader.fromConfiguration ("statefilepath").getNextString (), profiles},
-    schedules           {},
-    logWriter           {configReader.fromConfiguration ("logpath").getNextString (), configReader.fromConfiguration ("loglevel").getNextUnsignedInt8 (), configReader.fromConfiguration ("logflush").fromValue (0).getNextUnsignedInt8 (), configReader.fromConfiguration ("logflush").fromValue (1).getNextUnsignedInt (), configReader.fromConfiguration ("logmaxlines").getNextUnsignedInt ()},
-    capacityReader      {configReader.fromConfiguration ("batterypath").getNextString ()},
-    sleepTime           {configReader.fromConfiguration ("pollingtime").getNextUnsignedInt ()},
-    checkFeedback       {configReader.fromConfiguration ("feedback").getNextBool ()}, 
-    currentProfile      {nullptr},               
-    running             {false},
-    chargerState        {false},
-    profileChanged      {false},
-    chargerAtNO         {configReader.fromConfiguration ("chargerno").getNextBool ()},
-    relayChannel        {configReader.fromConfiguration ("relaychannel").getNextUnsignedInt8 ()},
-    chargerExtLast	    {configReader.fromConfiguration ("chargerexitlast").getNextBool ()},
-    chargerExtState	    {configReader.fromConfiguration ("chargerexitstate").getNextBool ()},
-    keepState           {configReader.fromConfiguration ("keepstate").getNextBool ()}
+std::vector <Configuration> BatGuard::configurationTemplate ()
 {
-    loadProfiles ();
+    return  {
+            Configuration ({"!UNIQUE!", "serialpath",       "/dev/ttyRELAY0"}), 
+            Configuration ({"!UNIQUE!", "serialbaud",       "9600"}),
+            Configuration ({"!UNIQUE!", "serialtrials",     "5"}), 
+            Configuration ({"!UNIQUE!", "relayprotocol",    "lcus"}), 
+            Configuration ({"!UNIQUE!", "modbusaddress",    "1"}), 
+            Configuration ({"!UNIQUE!", "probeusedonly",    "off"}), 
+            Configuration ({"!UNIQUE!", "uevent",           "on"}), 
+            Configuration ({"!UNIQUE!", "relayverify",      "300"}), 
+            Configuration ({"!UNIQUE!", "logpath",          "/var/log/batguard.log"}),
+            Configuration ({"!UNIQUE!", "loglevel",         "2"}),
+            Configuration ({"!UNIQUE!", "logflush",         "1",        "10"}),
+            Configuration ({"!UNIQUE!", "logmaxlines",      "1000"})
+            };
+}
+
+ConfigReader BatGuard::readConfiguration (const std::string& fileName)
+{
+    std::vector <Configuration> properties = configurationTemplate ();
+    
+    //without device sections the whole file describes both the common settings and a single device
+    if (ConfigReader::readSectionNames (fileName).empty ()) 
+    {
+        for (const Configuration& c : BatDevice::configurationTemplate ()) properties.push_back (c);
+    }
     
-    loadSchedules ();
+    return ConfigReader (properties, fileName);
+}
 
-    readState ();
+BatGuard::BatGuard (const std::string& cfn, const std::string& trace, bool roh) :
+    configFileName      {cfn.size () ? cfn : "/etc/batguard/config"},
+    simulation          {trace.size () ? std::make_unique <Simulation> (trace, std::cout) : nullptr},
+    readOnlyHistory     {roh},
+    configReader        {readConfiguration (configFileName)},
+    relayProtocol       {simulation ? "lcus" : configReader.fromConfiguration ("relayprotocol").getNextString ()},
+    modbusAddress       {configReader.fromConfiguration ("modbusaddress").getNextUnsignedInt8 ()},
+    relayPath           {simulation ? simulation->getRelayPath () : configReader.fromConfiguration ("serialpath").getNextString ()},
+    serialPort          {relayProtocol == "hidraw" ? nullptr : std::make_unique <SerialPort> (relayPath, configReader.fromConfiguration ("serialbaud").getNextUnsignedInt (), configReader.fromConfiguration ("serialtrials").getNextUnsignedInt8 ())},
+    relayDriver         {createRelayDriver (relayProtocol, relayPath, serialPort.get (), modbusAddress)},
+    logWriter           {simulation ? simulation->getLogPath () : configReader.fromConfiguration ("logpath").getNextString (), configReader.fromConfiguration ("loglevel").getNextUnsignedInt8 (), configReader.fromConfiguration ("logflush").fromValue (0).getNextUnsignedInt8 (), configReader.fromConfiguration ("logflush").fromValue (1).getNextUnsignedInt (), configReader.fromConfiguration ("logmaxlines").getNextUnsignedInt ()},
+    devices             {},
+    relayChannels       {0},
+    probeUsedOnly       {configReader.fromConfiguration ("probeusedonly").getNextBool ()},
+    relayProbed         {false},
+    relayDisconnections {0},
+    selectedDevice      {},
+    running             {false}
+{
+    checkSettings (configReader);
+    
+    loadDevices (configFileName, *relayDriver, logWriter, devices, simulation ? simulation->getDirectory () : "", readOnlyHistory);
+    
+    //all the devices share the relay, its channels are probed only once they are really driven, the command line requests may not need them at all
+    relayChannels = maxRelayChannel (devices);
+    relayDriver->setChannels (relayChannels);
+    relayDriver->setVerifyInterval (configReader.fromConfiguration ("relayverify").getNextUnsignedInt ());
+    
+    //the simulation begins from the configuration default state
+    if (not simulation) for (BatDevice& device : devices) device.restoreState ();
+    
+    if (serialPort and not serialPort->isOpen ()) logWriter.writeMessage (LogWriter::Level::ERROR, "The relay device " + serialPort->getPath () + " is not available, the relay is not driven until it shows up");
 }
 
-void BatGuard::readState ()
+void BatGuard::checkSettings (const ConfigReader& cr)
 {
-    if (keepState)
-    {
-        const StateFile::Error err = lastState.read ();
-        if (err == StateFile::Error::NO)
-        {
-            if (lastState.profileInit () != nullptr) currentProfile = lastState.profileInit (); 
-            if (lastState.chargerInit () != StateFile::State::LAST) chargerState = StateFile::stateToBool (lastState.chargerInit ());
-            if (lastState.schedulerInit () != StateFile::State::LAST) schedules.setEnable (StateFile::stateToBool (lastState.schedulerInit ()));        
-        }
-        else
-        {
-            logWriter.writeMessage (LogWriter::Level::ERROR, "It was not possible to read the state file due to the following error: " + StateFile::errorToString (err)); 
-        }
-    }        
+    //all the settings are parsed here to rise any exception before they are applied
+    cr.fromConfiguration ("serialbaud").getNextUnsignedInt ();
+    cr.fromConfiguration ("serialtrials").getNextUnsignedInt8 ();
+    cr.fromConfiguration ("probeusedonly").getNextBool ();
+    cr.fromConfiguration ("uevent").getNextBool ();
+    cr.fromConfiguration ("relayverify").getNextUnsignedInt ();
+    
+    const std::string protocol = cr.fromConfiguration ("relayprotocol").getNextString ();
+    if (protocol != "lcus" and protocol != "modbus" and protocol != "hidraw") throw std::invalid_argument ("The relay protocol is not known: " + protocol + ", it must be lcus, modbus or hidraw");
+    
+    const uint8_t address = cr.fromConfiguration ("modbusaddress").getNextUnsignedInt8 ();
+    if (address < 1 or address > 247) throw std::invalid_argument ("The modbus address must be from 1 to 247: " + std::to_string (address));
+}
+
+std::unique_ptr <RelayDriver> BatGuard::createRelayDriver (const std::string& protocol, const std::string& path, SerialPort* port, uint8_t address)
+{
+    //the channels are set once the devices are loaded
+    if (protocol == "lcus")     return std::make_unique <RelayBoard <LcusProtocol>> (LcusProtocol (*port), 0);
+    if (protocol == "modbus")   return std::make_unique <RelayBoard <ModbusProtocol>> (ModbusProtocol (*port, address), 0);
+    if (protocol == "hidraw")   return std::make_unique <RelayBoard <HidrawProtocol>> (HidrawProtocol (path), 0);
+    
+    throw std::invalid_argument ("The relay protocol is not known: " + protocol + ", it must be lcus, modbus or hidraw");
 }
 
-void BatGuard::writeState ()
+void BatGuard::probeRelay (const std::list <BatDevice>& devs)
 {
-    if  (keepState)
+    //without the device the channels are probed once it shows up
+    if (serialPort and not serialPort->isOpen ()) return;
+    
+    std::vector <uint8_t> channels;
+    
+    if (probeUsedOnly) channels = usedRelayChannels (devs);
+    else for (uint8_t c = 1; c <= relayChannels; ++ c) channels.push_back (c);
+    
+    const long long begin = Clock::monotonicMs ();
+    const unsigned int answers = relayDriver->probeChannels (channels);
+    
+    logWriter.writeMessage (LogWriter::Level::BASIC, "The relay channels were probed in " + std::to_string (Clock::monotonicMs () - begin) + " ms, " + std::to_string (answers) + " of " + std::to_string (channels.size ()) + " answered");
+    
+    relayProbed = true;
+}
+
+void BatGuard::loadDevices (const std::string& fileName, RelayDriver& relay, LogWriter& log, std::list <BatDevice>& devs, const std::string& filesDirectory, bool readOnlyHistory)
+{
+    const std::vector <std::string> sections = ConfigReader::readSectionNames (fileName);
+    
+    //the devices cannot be moved, therefore they are built in place
+    if (sections.empty ()) devs.emplace_back ("", readConfiguration (fileName), relay, log, filesDirectory, readOnlyHistory);
+    else for (const std::string& section : sections) devs.emplace_back (section, ConfigReader (BatDevice::configurationTemplate (), fileName, section), relay, log, filesDirectory, readOnlyHistory);
+    
+    for (auto d1 = devs.begin (); d1 != devs.end (); ++ d1)
     {
-        const StateFile::Error err = lastState.read ();        
-        
-        if (err != StateFile::Error::NO or lastState.isChangedRespectTo (currentProfile, StateFile::boolToState (chargerState), StateFile::boolToState (schedules.isEnabled ()))) 
+        for (auto d2 = devs.begin (); d2 != d1; ++ d2)
         {
-            const StateFile::Error erw = lastState.write (currentProfile, StateFile::boolToState (chargerState), StateFile::boolToState (schedules.isEnabled ()));
-            if (erw != StateFile::Error::NO) logWriter.writeMessage (LogWriter::Level::ERROR, "It was not possible to write the state file due to the following error: " + StateFile::errorToString (erw));
-        }        
+            if (d1->getRelayChannel () == d2->getRelayChannel ()) throw std::invalid_argument ("The devices " + d2->getName () + " and " + d1->getName () + " use the same relay channel: " + std::to_string (d1->getRelayChannel ()));
+            if (d1->getCommandFileName () == d2->getCommandFileName ()) throw std::invalid_argument ("The devices " + d2->getName () + " and " + d1->getName () + " use the same command file: " + d1->getCommandFileName ());
+            if (d1->getStateFileName () == d2->getStateFileName ()) throw std::invalid_argument ("The devices " + d2->getName () + " and " + d1->getName () + " use the same state file: " + d1->getStateFileName ());
+            if (d1->getStore () and d2->getStore () and d1->getStore ()->getPath () == d2->getStore ()->getPath ()) throw std::invalid_argument ("The devices " + d2->getName () + " and " + d1->getName () + " use the same history file: " + d1->getStore ()->getPath ());
+        }
     }
 }
 
-void BatGuard::loadProfiles ()
+uint8_t BatGuard::maxRelayChannel (const std::list <BatDevice>& devs)
 {
-    configReader.selectConfiguration ("profile"); 
-        
-    //profile is mandatory at least one must be present    
-    do
+    uint8_t channels = 0;
+    for (const BatDevice& device : devs) channels = std::max (channels, device.getRelayChannel ());
+    return channels;
+}
+
+std::vector <uint8_t> BatGuard::usedRelayChannels (const std::list <BatDevice>& devs)
+{
+    std::vector <uint8_t> channels;
+    for (const BatDevice& device : devs) channels.push_back (device.getRelayChannel ());
+    std::sort (channels.begin (), channels.end ());
+    return channels;
+}
+
+void BatGuard::reload ()
+{
+    logWriter.writeMessage (LogWriter::Level::BASIC, "Reloading the configuration file: " + configFileName);
+    
+    try
     {
-        const std::string   pnm = configReader.getNextString ();
-        const uint8_t       cmi = configReader.getNextUnsignedInt8 ();
-        const uint8_t       cma = configReader.getNextUnsignedInt8 ();
-        const bool          cin = configReader.getNextBool ();
+        //everything is parsed and built aside, the running configuration is replaced only if the new one is correct
+        ConfigReader            newConfig = readConfiguration (configFileName);
+        std::list <BatDevice>   newDevices;
+        
+        checkSettings (newConfig);
+        
+        loadDevices (configFileName, *relayDriver, logWriter, newDevices, "", false);
         
-        if (configReader.hasMoreValues ()) throw std::invalid_argument ("Profile definition requires 4 arguments instead were found " + std::to_string (configReader.numberOfValues ()) + " at " + configReader.currentConfigurationToString ());
+        //the serial port and the relay are touched only if their settings changed, if the new port cannot be opened the current one is kept
+        const std::string   serialPath = newConfig.fromConfiguration ("serialpath").getNextString ();
+        const unsigned int  serialBaud = newConfig.fromConfiguration ("serialbaud").getNextUnsignedInt ();
+        const uint8_t       newChannels = maxRelayChannel (newDevices);
+        const bool          newProbeUsed = newConfig.fromConfiguration ("probeusedonly").getNextBool ();
+        const bool          serialChanged = serialPort and (serialPath != serialPort->getPath () or serialBaud != serialPort->getBaudRate ());
+        
+        //the relay driver is shared by the devices, its protocol is fixed until batguard is restarted
+        if (newConfig.fromConfiguration ("relayprotocol").getNextString () != relayProtocol or newConfig.fromConfiguration ("modbusaddress").getNextUnsignedInt8 () != modbusAddress) throw std::invalid_argument ("the relay protocol and the modbus address cannot be changed without restarting batguard");
+        if (not serialPort and serialPath != relayPath) throw std::invalid_argument ("the hidraw device cannot be changed without restarting batguard");
+        
+        if (serialChanged) serialPort->reopen (serialPath, serialBaud, newConfig.fromConfiguration ("serialtrials").getNextUnsignedInt8 ());
+        
+        if (serialChanged or newChannels != relayChannels or newProbeUsed != probeUsedOnly or (newProbeUsed and usedRelayChannels (newDevices) != usedRelayChannels (devices)))
+        {
+            relayChannels = newChannels;
+            probeUsedOnly = newProbeUsed;
+            relayDriver->setChannels (relayChannels);
+            probeRelay (newDevices);
+        }
+        
+        relayDriver->setVerifyInterval (newConfig.fromConfiguration ("relayverify").getNextUnsignedInt ());
         
         try
         {
-            profiles.addProfile (ChargeProfile (pnm, cmi, cma, cin));
+            logWriter.reconfigure (newConfig.fromConfiguration ("logpath").getNextString (), newConfig.fromConfiguration ("loglevel").getNextUnsignedInt8 (), newConfig.fromConfiguration ("logflush").fromValue (0).getNextUnsignedInt8 (), newConfig.fromConfiguration ("logflush").fromValue (1).getNextUnsignedInt (), newConfig.fromConfiguration ("logmaxlines").getNextUnsignedInt ());
         }
         catch (const std::invalid_argument& exc)
         {
-            throw std::invalid_argument (exc.what () + std::string (" during the addition of the profile: ") + configReader.currentConfigurationToString ());                                    
-        }                        
+            logWriter.writeMessage (LogWriter::Level::ERROR, std::string ("The log settings were not reloaded because of the error: ") + exc.what ());
+        }
+        
+        //the devices still defined keep their state, the removed ones are left as required at exit, the new ones restore their saved state
+        for (BatDevice& device : devices)
+        {
+            if (std::none_of (newDevices.begin (), newDevices.end (), [&] (const BatDevice& nd) {return nd.getName () == device.getName ();})) 
+            {
+                logWriter.writeMessage (LogWriter::Level::BASIC, "The device " + device.getName () + " is not defined anymore");
+                device.applyExitState ();
+            }
+        }
+        
+        for (BatDevice& newDevice : newDevices)
+        {
+            auto old = std::find_if (devices.begin (), devices.end (), [&] (const BatDevice& od) {return od.getName () == newDevice.getName ();});
+            if (old != devices.end ()) newDevice.adoptStateOf (*old);
+            else newDevice.restoreState ();
+        }
+        
+        //the list nodes are moved without moving the devices
+        configReader    = std::move (newConfig);
+        devices         = std::move (newDevices);
+    }
+    catch (const std::invalid_argument& exc)
+    {
+        logWriter.writeMessage (LogWriter::Level::ERROR, std::string ("The configuration was not reloaded because of the error: ") + exc.what ());
+        return;
     }
-    while (configReader.gotoNextConfiguration ());   
     
-    currentProfile = profiles.getProfileWithIndex (0);         
+    if (selectedDevice.size () and std::none_of (devices.begin (), devices.end (), [&] (const BatDevice& d) {return d.getName () == selectedDevice;})) selectedDevice.clear ();
 }
 
-void BatGuard::loadSchedules ()
+bool BatGuard::updateRelayLink (EventLoop& eventLoop)
 {
-    //schedules are optional, they may miss at all
-    if (configReader.selectConfiguration ("schedule")) 
+    if (not serialPort) return false;
+    
+    //the relay device directory, for instance /dev, is watched only while the device is missing, otherwise any write there would wake up the loop
+    if (serialPort->checkLink ())
     {
-        do
-        {
-            const bool                ena = configReader.getNextBool ();
-            const std::vector <bool>  moy = configReader.getNextListOfBoolDescription (12);
-            const std::vector <bool>  dom = configReader.getNextListOfBoolDescription (31);
-            const std::vector <bool>  dow = configReader.getNextListOfBoolDescription (7);
-            const std::vector <int>   fhm = configReader.getNextListOfInt (2);
-            const std::vector <int>   thm = configReader.getNextListOfInt (2);
-            const std::string         pnm = configReader.getNextString ();
-            
-            if (configReader.hasMoreValues ()) throw std::invalid_argument ("Schedule definition requires 7 arguments instead were found " + std::to_string (configReader.numberOfValues ()) + " at " + configReader.currentConfigurationToString ());
-            
-            try
-            {
-                schedules.addSchedule (ProfileSchedule (ena, moy, dom, dow, HourMin (fhm), HourMin (thm), profiles.getProfileWithName (pnm)));
-            }
-            catch (const std::invalid_argument& exc)
-            {
-                throw std::invalid_argument (exc.what () + std::string (" during the addition of the schedule: ") + configReader.currentConfigurationToString ());
-            }        
-        }
-        while (configReader.gotoNextConfiguration ());
+        eventLoop.unwatchDevice ();
+        return false;
+    }
+    
+    if (serialPort->disconnections () != relayDisconnections)
+    {
+        relayDisconnections = serialPort->disconnections ();
+        logWriter.writeMessage (LogWriter::Level::ERROR, "The relay device " + serialPort->getPath () + " was disconnected, the relay is not driven until it comes back");
+    }
+    
+    //the watch is set before trying the device, therefore it cannot show up unnoticed meanwhile
+    if (not eventLoop.watchDevice (serialPort->getPath ())) logWriter.writeMessage (LogWriter::Level::FULL, "It was not possible to watch the relay device: " + serialPort->getPath () + ", it will be looked for only at every polling time");
+    
+    if (not serialPort->reconnect ()) return false;
+    
+    eventLoop.unwatchDevice ();
+    
+    const std::string recovery = serialPort->lastRecoveryMs () >= 0 ? " again after " + std::to_string (serialPort->lastRecoveryMs ()) + " ms, disconnections so far: " + std::to_string (serialPort->disconnections ()) : "";
+    
+    logWriter.writeMessage (LogWriter::Level::BASIC, "The relay device " + serialPort->getPath () + " is available" + recovery + ", its channels are probed again");
+    
+    //the relay state is unknown, it is read again before the devices apply theirs
+    relayDriver->setChannels (relayChannels);
+    probeRelay (devices);
+    return true;
+}
+
+void BatGuard::watchCommandFiles (EventLoop& eventLoop)
+{
+    eventLoop.clearWatches ();
+    
+    for (const BatDevice& device : devices)
+    {
+        if (not eventLoop.watchFile (device.getCommandFileName ())) logWriter.writeMessage (LogWriter::Level::ERROR, "It was not possible to watch the command file: " + device.getCommandFileName () + ", it will be read only at every polling time");
+    }
+}
+
+void BatGuard::watchSupplies (UeventListener& ueventListener)
+{
+    ueventListener.clearSupplies ();
+    
+    for (const BatDevice& device : devices)
+    {
+        for (const std::string& path : device.getBatteryPaths ()) ueventListener.watchSupply (UeventListener::supplyName (path));
+        ueventListener.watchSupply (device.getAcSupply ());
+    }
+}
+
+void BatGuard::requestSupplyCycles (const std::string& supply)
+{
+    for (BatDevice& device : devices)
+    {
+        const std::vector <std::string> paths = device.getBatteryPaths ();
         
-        schedules.setEnable (true);
-    }    
+        if (device.getAcSupply () == supply or std::any_of (paths.begin (), paths.end (), [&] (const std::string& path) {return UeventListener::supplyName (path) == supply;})) device.requestCycle ();
+    }
 }
 
 void BatGuard::stop ()
@@ -175,147 +326,139 @@ void BatGuard::stop ()
 
 void BatGuard::start ()
 {
+    if (readOnlyHistory) throw std::runtime_error ("batguard cannot run with a read only history");
+    
     running = true;
     
     logWriter.writeMessage (LogWriter::Level::BASIC, nameVersion + " is going to start");
     
-    while (running)
-    {        
-        selectCurrentProfile ();
-
-        computeChargerState ();
-        
-        sendRelayCommand ();
-        
-        if (userCommand.loggerInit ()) logWriter.flushMessages ();
-        
-        writeState ();
-        
-        sleep (sleepTime);
-    }
+    if (not relayProbed) probeRelay (devices);
     
-    if (not chargerExtLast)
-    {
-		chargerState = chargerExtState;
-		
-		sendRelayCommand ();
-	}
+    if (simulation) runSimulation ();
+    else runEventLoop ();
+    
+    for (BatDevice& device : devices) device.applyExitState ();
+    
+    if (simulation) simulation->writeActions ();
+    
+    if (serialPort and serialPort->disconnections ()) logWriter.writeMessage (LogWriter::Level::BASIC, "The relay device was disconnected " + std::to_string (serialPort->disconnections ()) + " times for " + std::to_string (serialPort->totalDownMs ()) + " ms overall");
+    
+    logWriter.writeMessage (LogWriter::Level::BASIC, std::to_string (relayDriver->sentFrames ()) + " frames were sent to the relay, " + std::to_string (relayDriver->suppressedFrames ()) + " were not because their channel was already in the required state");
     
     logWriter.writeMessage (LogWriter::Level::BASIC, nameVersion + " is going to stop");
 }
 
-void BatGuard::selectCurrentProfile ()
+unsigned long BatGuard::runDevices (bool all)
 {
-    const StateFile::Error usrCmdRd = userCommand.read ();
+    unsigned long timeout = ULONG_MAX;
     
-    if (usrCmdRd != StateFile::Error::NO) logWriter.writeMessage (LogWriter::Level::ERROR, "The command file was not correctly formed and will be ignored: " + StateFile::errorToString (usrCmdRd));
+    //the relay commands of all the devices due are sent at once, therefore the relay answer wait is paid only once
+    std::vector <BatDevice*> due;
+    std::vector <RelayDriver::Request> requests;
     
-    //Once the commands are read, the file is emptied
-    if (usrCmdRd != StateFile::Error::NO or userCommand.isChangedRespectTo ()) userCommand.write ();
-
-    //this must be done soon to allow the scheduler disable and profile change with a single command 
-    if (userCommand.schedulerInit () != StateFile::State::LAST) 
-    {                
-        schedules.setEnable (StateFile::stateToBool (userCommand.schedulerInit ()));
-        logWriter.writeMessage (LogWriter::Level::BASIC, std::string ("The command file required to change the scheduler state to: ") + (userCommand.schedulerInit () == StateFile::State::ON ? "enabled" : "disabled"));                
+    for (BatDevice& device : devices)
+    {
+        if (not all and device.msToNextCycle (Clock::monotonicMs ()) != 0) continue;
+        
+        due.push_back (& device);
+        requests.push_back (device.beginCycle ());
     }
     
-    profileChanged = false;
-    const ProfileSchedule* profileSchedTrig = schedules.getScheduleTriggered ();
-    const ChargeProfile* profileUserComnd = userCommand.profileInit ();
-    if (profileSchedTrig != nullptr)
+    const std::vector <RelayDriver::Result> results = relayDriver->sendCommands (requests);
+    
+    for (size_t d = 0; d < due.size (); ++ d) due [d]->endCycle (Clock::monotonicMs (), results [d]);
+    
+    for (const BatDevice& device : devices) timeout = std::min (timeout, device.msToNextCycle (Clock::monotonicMs ()));
+    
+    return timeout;
+}
+
+void BatGuard::runEventLoop ()
+{
+    EventLoop eventLoop;
+    
+    watchCommandFiles (eventLoop);
+    
+    //the power supply uevents wake up the loop at once, for instance when the charger is unplugged, otherwise batguard relies only on polling
+    std::unique_ptr <UeventListener> ueventListener;
+    if (configReader.fromConfiguration ("uevent").getNextBool ())
     {
-        if (profileSchedTrig->profile != currentProfile) 
+        try
         {
-            profileChanged = true;
-            currentProfile = profileSchedTrig->profile;
-            logWriter.writeMessage (LogWriter::Level::BASIC, "The following schedule triggered: " + profileSchedTrig->toString ());                            
+            ueventListener = std::make_unique <UeventListener> ();
+            if (not eventLoop.watchDescriptor (ueventListener->getDescriptor ())) throw std::invalid_argument ("It was not possible to wait for the uevents");
+            watchSupplies (*ueventListener);
         }
-        if (profileUserComnd != nullptr and profileUserComnd != currentProfile) logWriter.writeMessage (LogWriter::Level::ERROR, "Since a schedule is triggering, it was ignored the command file to switch to the profile: " + profileUserComnd->toString () + ", disable the scheduler to force a profile");
-    }
-    else 
-    {            
-        if (profileUserComnd != nullptr and profileUserComnd != currentProfile) 
+        catch (const std::invalid_argument& e)
         {
-            profileChanged = true;
-            currentProfile = profileUserComnd;
-            logWriter.writeMessage (LogWriter::Level::BASIC, "The command file required to change the current profile to: " + currentProfile->toString ());                    
+            ueventListener.reset ();
+            logWriter.writeMessage (LogWriter::Level::ERROR, std::string (e.what ()) + ", the battery will be read only at every polling time");
         }
-    }        
-}    
-
-void BatGuard::computeChargerState ()
-{        
-    const uint8_t charge = capacityReader.readCapacity ();
-    
-    if (chargerState)
-    {
-        if (capacityReader.deltaCapacity () < 0) logWriter.writeMessage (LogWriter::Level::ERROR, "The battery capacity is decreasing although the charger is turned on, last capacity variation measured is: " + std::to_string (capacityReader.deltaCapacity ()));
-    }
-    else
-    {
-        if (capacityReader.deltaCapacity () > 0) logWriter.writeMessage (LogWriter::Level::ERROR, "The battery capacity is increasing although the charger is turned off, last capacity variation measured is: " + std::to_string (capacityReader.deltaCapacity ()));
     }
+    
+    //at the start, after a reload or a command file change all the devices run their cycle, otherwise only those whose time elapsed
+    bool runAll = true;
+    
+    while (running)
+    {        
+        //the relay unplugged is noticed at every wake up even if nothing was sent to it, it is linked again as soon as it comes back
+        if (updateRelayLink (eventLoop)) runAll = true;
         
-    if      (charge < currentProfile->minCharge) 
-    {            
-        if (chargerState == false)  logWriter.writeMessage (LogWriter::Level::BASIC, "Capacity: " + std::to_string (charge) + " went below the min threshold, the charger is turned on");
-        else                        logWriter.writeMessage (LogWriter::Level::FULL, "Capacity: " + std::to_string (charge) + " is still below the min threshold, the charger stays on"); 
-
-        if (userCommand.chargerInit () == StateFile::State::OFF) logWriter.writeMessage (LogWriter::Level::ERROR, "Charger-off user-command was ignored because the battery charge is too low, change to a wider charge profile to force the charger state");                                
+        //the cycles read all the command files, the changes noticed before are already taken
+        eventLoop.discardFileChanges ();
         
-        chargerState = true;
-    }
-    else if (charge > currentProfile->maxCharge) 
-    {            
-        if (chargerState == true)   logWriter.writeMessage (LogWriter::Level::BASIC, "Capacity: " + std::to_string (charge) + " went above the max threshold, the charger is turned off");
-        else                        logWriter.writeMessage (LogWriter::Level::FULL, "Capacity: " + std::to_string (charge) + " is still above the max threshold, the charger stays off"); 
+        eventLoop.setTimeout (runDevices (runAll));
         
-        if (userCommand.chargerInit () == StateFile::State::ON) logWriter.writeMessage (LogWriter::Level::ERROR, "Charger-on user-command was ignored because the battery charge is too high, change to a wider charge profile profile to force the charger state");
+        runAll = false;
         
-        chargerState = false;
+        switch (eventLoop.wait ())
+        {
+            case EventLoop::Event::TERMINATE:
+                running = false;
+                break;
+            case EventLoop::Event::RELOAD:
+                reload ();
+                watchCommandFiles (eventLoop);
+                if (ueventListener) watchSupplies (*ueventListener);
+                runAll = true;
+                break;
+            case EventLoop::Event::FILECHANGE:
+                //the cycles cleaning the command files change them too, only a new command needs all the devices to run
+                if (std::any_of (devices.begin (), devices.end (), [] (const BatDevice& device) {return device.isCommandPending ();}))
+                {
+                    logWriter.writeMessage (LogWriter::Level::FULL, "A command file was changed");
+                    runAll = true;
+                }
+                break;
+            case EventLoop::Event::READABLE:
+                //only the devices fed by the power supplies changed run their cycle, the others keep their own time
+                if (ueventListener) for (const std::string& supply : ueventListener->readEvents ())
+                {
+                    logWriter.writeMessage (LogWriter::Level::FULL, "The power supply " + supply + " changed");
+                    requestSupplyCycles (supply);
+                }
+                break;
+            case EventLoop::Event::TIMEOUT:
+                break;
+        }
     }
-    //this order of else if is to allows to change profile and set the charger in a single editing of the command file
-    else if (userCommand.chargerInit () != StateFile::State::LAST) 
+}
+
+void BatGuard::runSimulation ()
+{
+    //the virtual clock jumps straight to the next wake up, the command files are never changed
+    bool runAll = true;
+    
+    while (running)
     {
-        chargerState = StateFile::stateToBool (userCommand.chargerInit ());
+        const unsigned long timeout = runDevices (runAll);
         
-        logWriter.writeMessage (LogWriter::Level::BASIC, std::string ("The command file forced the charger to: ") + (chargerState ? "enabled" : "disabled"));
-    }
-    else if (profileChanged)
-    {
-        chargerState = currentProfile->startState;
+        runAll = false;
         
-        logWriter.writeMessage (LogWriter::Level::BASIC, std::string ("A profile change forced the charger to its initial state: ") + (chargerState ? "enabled" : "disabled"));            
+        if (not simulation->advance (timeout)) running = false;
     }
-    else
-    {
-        logWriter.writeMessage (LogWriter::Level::FULL, std::string ("Capacity: " + std::to_string (charge) + " is still between min and max thresholds, the charger stays: " + (chargerState ? "enabled" : "disabled"))); 
-    }        
 }
 
-void BatGuard::sendRelayCommand ()
-{
-	const bool relayState = (chargerAtNO == chargerState);
-    
-	RelayDriver::Command feedback = relayDriver.sendCommand (relayChannel, RelayDriver::relayFeedbackToCommand (relayState, checkFeedback));
-
-	if (feedback == RelayDriver::Command::ERROR)
-	{
-		logWriter.writeMessage (LogWriter::Level::ERROR, std::string ("There was an error setting the charger to: ") + (chargerExtState ? "enabled" : "disabled") + ", the command sent to the relay returned the error: " + RelayDriver::errorToString (relayDriver.lastError ()));
-		
-        //retry to send the last command without feedback because it is ignored
-		relayDriver.sendCommand (relayChannel, RelayDriver::relayFeedbackToCommand (relayState, false));
-	}
-	else if (checkFeedback and RelayDriver::commandToBool (feedback) != relayState) 
-	{
-		logWriter.writeMessage (LogWriter::Level::ERROR, std::string ("There was an error setting the charger to: ") + (chargerExtState ? "enabled" : "disabled") + ", the relay feedback was: " + RelayDriver::commandToString (feedback) + " does not match its required state: " + (relayState ? "enabled" : "disabled"));
-		
-        //retry to send the last command without feedback because it is ignored
-		relayDriver.sendCommand (relayChannel, RelayDriver::relayFeedbackToCommand (relayState, false));
-	}
-}	
-
 bool BatGuard::isRunning () const
 {
     return running;
@@ -326,48 +469,69 @@ bool BatGuard::logMessage (const std::string& mes)
     return logWriter.writeMessage (LogWriter::Level::ERROR, mes);
 }
 
+void BatGuard::selectDevice (const std::string& deviceName)
+{
+    if (deviceName.size () and std::none_of (devices.begin (), devices.end (), [&] (const BatDevice& d) {return d.getName () == deviceName;})) throw std::invalid_argument ("The device " + deviceName + " is not defined in the configuration file");
+    
+    selectedDevice = deviceName;
+}
+
+std::string BatGuard::collectFromDevices (const std::function <std::string (BatDevice&)>& request)
+{
+    std::string output;
+    
+    for (BatDevice& device : devices)
+    {
+        if (selectedDevice.size () and device.getName () != selectedDevice) continue;
+        
+        //the unnamed device is alone, therefore its output is not tagged
+        if (device.getName ().empty ()) output += request (device);
+        else output += "\n[" + device.getName () + "]\n" + request (device);
+    }
+    
+    return output;
+}
+
 std::string BatGuard::sendCommandRelay (const std::string & cmd)
 {
-    RelayDriver::Command c = relayDriver.sendCommand (relayChannel, RelayDriver::stringToCommand (cmd));
+    if (serialPort and not serialPort->isOpen ()) throw std::invalid_argument ("The relay device is not available: " + serialPort->getPath ());
     
-    if (c != RelayDriver::Command::ERROR) return RelayDriver::commandToString (c);
+    if (not relayProbed) probeRelay (devices);
     
-    return RelayDriver::errorToString (relayDriver.lastError ());
+    return collectFromDevices ([&] (BatDevice& d) {return d.sendCommandRelay (cmd);});
 }
 
-std::string BatGuard::getBatteryCapacity () const
+std::string BatGuard::getBatteryCapacity ()
 {
-    return capacityReader.toString ();
+    return collectFromDevices ([] (BatDevice& d) {return d.getBatteryCapacity ();});
 }
 
-std::string BatGuard::getChargeProfiles () const
+std::string BatGuard::getChargeProfiles ()
 {
-    return profiles.toString ();
+    return collectFromDevices ([] (BatDevice& d) {return d.getChargeProfiles ();});
 }
 
 std::string BatGuard::getUserCommand ()
 {
-    StateFile::Error err = userCommand.read ();
-    if (err == StateFile::Error::NO) return userCommand.toString ();
-    return "Error reading the command file: " + StateFile::errorToString (err);
+    return collectFromDevices ([] (BatDevice& d) {return d.getUserCommand ();});
 }
 
 std::string BatGuard::getLastState ()
 {
-    StateFile::Error err = lastState.read ();
-    if (err == StateFile::Error::NO) return lastState.toString ();
-    return "Error reading the state file: " + StateFile::errorToString (err);
+    return collectFromDevices ([] (BatDevice& d) {return d.getLastState ();});
 }
 
-std::string BatGuard::getProfileSchedules () const
+std::string BatGuard::getProfileSchedules ()
 {
-    std::string output;
-    if (schedules.getNumOfSchedules ()) output += schedules.toString ();
-    else output += "No schedule is defined\n";
-    
-    const ProfileSchedule* st = schedules.getScheduleTriggered ();
-    if (st != nullptr) output += "There is a schedule triggering: " + st->toString ();
-    else output += "No schedule is triggering.";
-    return output;
+    return collectFromDevices ([] (BatDevice& d) {return d.getProfileSchedules ();});
 }
 
+std::string BatGuard::getHistorySummary (long long fromMs, long long toMs, long long stepMs)
+{
+    return collectFromDevices ([&] (BatDevice& d) {return d.getHistorySummary (fromMs, toMs, stepMs);});
+}
+
+std::string BatGuard::getSessions (long long fromMs, long long toMs)
+{
+    return collectFromDevices ([&] (BatDevice& d) {return d.getSessions (fromMs, toMs);});
+}
@@ -0,0 +1,288 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "BatteryReader.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+BatteryReader::BatteryReader (const std::string& capacityPath, const std::string& online) :
+    capacityReader  {capacityPath},
+    paths           {},
+    descs           {},
+    attributesOpen  {false},
+    sample          {},
+    prevCapacity    {0.0}
+{
+    const size_t sep = capacityPath.find_last_of ('/');
+    const std::string dir = (sep == std::string::npos ? "" : capacityPath.substr (0, sep + 1));
+    
+    paths [STATUS]      = dir + "status";
+    paths [ENERGYNOW]   = dir + "energy_now";
+    paths [ENERGYFULL]  = dir + "energy_full";
+    paths [CHARGENOW]   = dir + "charge_now";
+    paths [CHARGEFULL]  = dir + "charge_full";
+    paths [CURRENTNOW]  = dir + "current_now";
+    paths [POWERNOW]    = dir + "power_now";
+    paths [VOLTAGENOW]  = dir + "voltage_now";
+    paths [ONLINE]      = online;
+    
+    descs.fill (-1);
+    openAttributes ();
+    
+    //the capacity was already read by its reader
+    sample.capacity = capacityReader.readCapacity ();
+    computeSample ();
+    prevCapacity = sample.capacity;
+}
+
+BatteryReader::~BatteryReader ()
+{
+    closeAttributes ();
+}
+
+BatteryReader::BatteryReader (BatteryReader&& br) :
+    capacityReader  {std::move (br.capacityReader)},
+    paths           {std::move (br.paths)},
+    descs           {br.descs},
+    attributesOpen  {br.attributesOpen},
+    sample          {br.sample},
+    prevCapacity    {br.prevCapacity}
+{
+    br.descs.fill (-1);
+}
+
+BatteryReader& BatteryReader::operator = (BatteryReader&& br)
+{
+    //the descriptors are swapped, therefore the ones of this object are closed by the destruction of the other
+    capacityReader  = std::move (br.capacityReader);
+    std::swap (paths, br.paths);
+    std::swap (descs, br.descs);
+    std::swap (attributesOpen, br.attributesOpen);
+    sample          = br.sample;
+    prevCapacity    = br.prevCapacity;
+    return * this;
+}
+
+void BatteryReader::openAttributes ()
+{
+    for (size_t a = 0; a < ATTRIBUTES; ++ a) 
+    {
+        if (descs [a] < 0 and paths [a].size ()) descs [a] = open (paths [a].c_str (), O_RDONLY | O_CLOEXEC);
+    }
+    
+    attributesOpen = true;
+}
+
+void BatteryReader::closeAttributes ()
+{
+    for (int& desc : descs) 
+    {
+        if (desc >= 0) close (desc);
+        desc = -1;
+    }
+    
+    attributesOpen = false;
+}
+
+bool BatteryReader::parseNumber (const char* begin, const char* end, long long& value)
+{
+    while (begin < end and (* begin == ' ' or * begin == '\t')) ++ begin;
+    
+    const bool negative = begin < end and * begin == '-';
+    if (negative) ++ begin;
+    
+    const char* digits = begin;
+    long long result = 0;
+    while (begin < end and * begin >= '0' and * begin <= '9' and result < 100000000000000LL) result = result * 10 + (* begin ++ - '0');
+    
+    if (begin == digits) return false;
+    
+    //only the line end may follow the number
+    while (begin < end and (* begin == ' ' or * begin == '\t' or * begin == '\n' or * begin == '\r')) ++ begin;
+    if (begin != end) return false;
+    
+    value = negative ? - result : result;
+    return true;
+}
+
+bool BatteryReader::readNumber (Attribute attribute, long long& value) const
+{
+    if (descs [attribute] < 0) return false;
+    
+    char buffer [32];
+    const ssize_t len = pread (descs [attribute], buffer, sizeof (buffer), 0);
+    
+    return len > 0 and static_cast <size_t> (len) < sizeof (buffer) and parseNumber (buffer, buffer + len, value);
+}
+
+BatterySample::Status BatteryReader::readStatus () const
+{
+    if (descs [STATUS] < 0) return BatterySample::Status::UNKNOWN;
+    
+    char buffer [32];
+    const ssize_t len = pread (descs [STATUS], buffer, sizeof (buffer), 0);
+    if (len <= 0) return BatterySample::Status::UNKNOWN;
+    
+    const size_t size = static_cast <size_t> (len);
+    auto is = [&] (const char* word) {const size_t wl = strlen (word); return size >= wl and memcmp (buffer, word, wl) == 0 and (size == wl or buffer [wl] == '\n');};
+    
+    if (is ("Charging"))        return BatterySample::Status::CHARGING;
+    if (is ("Discharging"))     return BatterySample::Status::DISCHARGING;
+    if (is ("Not charging"))    return BatterySample::Status::NOTCHARGING;
+    if (is ("Full"))            return BatterySample::Status::FULL;
+    return BatterySample::Status::UNKNOWN;
+}
+
+const BatterySample& BatteryReader::readSample ()
+{
+    prevCapacity = sample.capacity;
+    
+    sample.capacity = capacityReader.readCapacity ();
+    
+    //the battery may have been removed and plugged again, therefore its files are opened again once it is read
+    //no battery provides all the attributes, the missing ones are not looked for at every sample
+    if (not capacityReader.isReadValid ()) closeAttributes ();
+    else if (not attributesOpen) openAttributes ();
+    
+    computeSample ();
+    
+    if (not sample.valid) sample.capacity = prevCapacity;
+    
+    return sample;
+}
+
+void BatteryReader::computeSample ()
+{
+    sample.valid     = capacityReader.isReadValid ();
+    sample.status    = readStatus ();
+    sample.rate      = 0.0;
+    sample.rateValid = false;
+    sample.energyNow = 0.0;
+    sample.energyFull = 0.0;
+    
+    long long online;
+    sample.acOnline = readNumber (ONLINE, online) ? (online != 0) : -1;
+    
+    if (not sample.valid) return;
+    
+    //the energy is in uWh and the power in uW, the charge is in uAh and the current in uA
+    long long now, full, flow, voltage;
+    const bool energy = readNumber (ENERGYNOW, now) and readNumber (ENERGYFULL, full) and full > 0;
+    const bool charge = not energy and readNumber (CHARGENOW, now) and readNumber (CHARGEFULL, full) and full > 0;
+    
+    if (not energy and not charge) return;
+    
+    //the integer capacity is used as it is if the fractional one does not agree, for instance some batteries compute it from the design capacity
+    const double fractional = std::min (100.0, std::max (0.0, 100.0 * static_cast <double> (now) / static_cast <double> (full)));
+    if (std::fabs (fractional - sample.capacity) < 1.0) sample.capacity = fractional;
+    
+    //the charge is converted to energy at the present voltage, it is enough to weight many batteries
+    if (energy)
+    {
+        sample.energyNow  = static_cast <double> (now);
+        sample.energyFull = static_cast <double> (full);
+    }
+    else if (readNumber (VOLTAGENOW, voltage) and voltage > 0)
+    {
+        sample.energyNow  = static_cast <double> (now) * static_cast <double> (voltage) / 1000000.0;
+        sample.energyFull = static_cast <double> (full) * static_cast <double> (voltage) / 1000000.0;
+    }
+    
+    if (energy)
+    {
+        if      (readNumber (POWERNOW, flow))                                       sample.rateValid = true;
+        else if (readNumber (CURRENTNOW, flow) and readNumber (VOLTAGENOW, voltage)) { flow = flow * voltage / 1000000LL; sample.rateValid = true; }
+    }
+    else
+    {
+        if      (readNumber (CURRENTNOW, flow))                                     sample.rateValid = true;
+        else if (readNumber (POWERNOW, flow) and readNumber (VOLTAGENOW, voltage) and voltage > 0) { flow = flow * 1000000LL / voltage; sample.rateValid = true; }
+    }
+    
+    if (not sample.rateValid) return;
+    
+    //many batteries report the flow without sign, therefore it is taken from the status
+    const double magnitude = std::fabs (100.0 * static_cast <double> (flow) / static_cast <double> (full) / 3600.0);
+    
+    switch (sample.status)
+    {
+        case BatterySample::Status::CHARGING:       sample.rate = magnitude;     break;
+        case BatterySample::Status::DISCHARGING:    sample.rate = - magnitude;   break;
+        case BatterySample::Status::NOTCHARGING:
+        case BatterySample::Status::FULL:           sample.rate = 0.0;           break;
+        case BatterySample::Status::UNKNOWN:        sample.rate = flow < 0 ? - magnitude : magnitude; break;
+    }
+}
+
+const BatterySample& BatteryReader::getSample () const
+{
+    return sample;
+}
+
+double BatteryReader::deltaCapacity () const
+{
+    return sample.capacity - prevCapacity;
+}
+
+const std::string& BatteryReader::getPath () const
+{
+    return capacityReader.getPath ();
+}
+
+std::string BatteryReader::capacityToString (double capacity)
+{
+    const double rounded = std::round (capacity * 10.0) / 10.0;
+    
+    if (rounded == std::floor (rounded)) return std::to_string (static_cast <int> (rounded));
+    
+    char buffer [16];
+    snprintf (buffer, sizeof (buffer), "%.1f", rounded);
+    return buffer;
+}
+
+std::string BatteryReader::onlinePath (const std::string& capacityPath, const std::string& supply)
+{
+    const size_t file = capacityPath.find_last_of ('/');
+    if (file == std::string::npos or file == 0) return supply + "/online";
+    
+    const size_t dir = capacityPath.find_last_of ('/', file - 1);
+    if (dir == std::string::npos) return supply + "/online";
+    
+    return capacityPath.substr (0, dir + 1) + supply + "/online";
+}
+
+std::string BatteryReader::toString () const
+{
+    static const char* statuses [] = {"unknown", "charging", "discharging", "not charging", "full"};
+    
+    std::string res {"The current battery capacity is: " + capacityToString (sample.capacity) + '%'};
+    
+    if (sample.status != BatterySample::Status::UNKNOWN) res += std::string (", status: ") + statuses [static_cast <int> (sample.status)];
+    if (sample.rateValid) res += ", rate: " + capacityToString (sample.rate * 3600.0) + "%/h";
+    if (sample.acOnline >= 0) res += std::string (", charger power supply: ") + (sample.acOnline ? "online" : "offline");
+    
+    return res;
+}
@@ -0,0 +1,155 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "BatterySource.hpp"
+#include <stdexcept>
+
+BatterySource::BatterySource (const std::vector <std::string>& capacityPaths, const std::string& onlinePath) :
+    packs           {},
+    sample          {},
+    prevCapacity    {0.0}
+{
+    if (capacityPaths.empty ()) throw std::invalid_argument ("At least a battery capacity file is required");
+    
+    packs.reserve (capacityPaths.size ());
+    
+    //all the batteries share the same charger, therefore its online flag is read only once
+    for (const std::string& path : capacityPaths) packs.emplace_back (path, packs.empty () ? onlinePath : "");
+    
+    combine ();
+    prevCapacity = sample.capacity;
+}
+
+const BatterySample& BatterySource::readSample ()
+{
+    prevCapacity = sample.capacity;
+    
+    for (BatteryReader& pack : packs) pack.readSample ();
+    
+    combine ();
+    
+    return sample;
+}
+
+void BatterySource::combine ()
+{
+    if (packs.size () == 1) 
+    {
+        sample = packs.front ().getSample ();
+        return;
+    }
+    
+    size_t valid = 0;
+    size_t weighted = 0;
+    double capacity = 0.0;
+    double energyNow = 0.0;
+    double energyFull = 0.0;
+    double flow = 0.0;
+    bool rateValid = true;
+    bool charging = false;
+    bool discharging = false;
+    bool full = true;
+    bool unknown = true;
+    
+    for (const BatteryReader& pack : packs)
+    {
+        const BatterySample& ps = pack.getSample ();
+        if (not ps.valid) continue;
+        
+        ++ valid;
+        capacity += ps.capacity;
+        
+        if (ps.energyFull > 0.0) 
+        {
+            ++ weighted;
+            energyNow  += ps.energyNow;
+            energyFull += ps.energyFull;
+            flow       += ps.rate * ps.energyFull;
+        }
+        
+        rateValid   = rateValid and ps.rateValid;
+        charging    = charging or ps.status == BatterySample::Status::CHARGING;
+        discharging = discharging or ps.status == BatterySample::Status::DISCHARGING;
+        full        = full and ps.status == BatterySample::Status::FULL;
+        unknown     = unknown and ps.status == BatterySample::Status::UNKNOWN;
+    }
+    
+    sample.acOnline = packs.front ().getSample ().acOnline;
+    sample.valid = valid > 0;
+    
+    //if no battery can be read the last capacity is kept
+    if (not sample.valid)
+    {
+        sample.rate = 0.0;
+        sample.rateValid = false;
+        sample.status = BatterySample::Status::UNKNOWN;
+        return;
+    }
+    
+    const bool energy = weighted == valid and energyFull > 0.0;
+    
+    sample.capacity   = energy ? 100.0 * energyNow / energyFull : capacity / static_cast <double> (valid);
+    sample.energyNow  = energy ? energyNow : 0.0;
+    sample.energyFull = energy ? energyFull : 0.0;
+    sample.rateValid  = energy and rateValid;
+    sample.rate       = sample.rateValid ? flow / energyFull : 0.0;
+    
+    if      (charging)      sample.status = BatterySample::Status::CHARGING;
+    else if (discharging)   sample.status = BatterySample::Status::DISCHARGING;
+    else if (full)          sample.status = BatterySample::Status::FULL;
+    else if (unknown)       sample.status = BatterySample::Status::UNKNOWN;
+    else                    sample.status = BatterySample::Status::NOTCHARGING;
+}
+
+const BatterySample& BatterySource::getSample () const
+{
+    return sample;
+}
+
+double BatterySource::deltaCapacity () const
+{
+    return sample.capacity - prevCapacity;
+}
+
+const std::vector <BatteryReader>& BatterySource::getPacks () const
+{
+    return packs;
+}
+
+std::vector <std::string> BatterySource::getPaths () const
+{
+    std::vector <std::string> paths;
+    for (const BatteryReader& pack : packs) paths.push_back (pack.getPath ());
+    return paths;
+}
+
+std::string BatterySource::toString () const
+{
+    if (packs.size () == 1) return packs.front ().toString ();
+    
+    std::string res {"The combined battery capacity is: " + BatteryReader::capacityToString (sample.capacity) + '%'};
+    if (sample.rateValid) res += ", rate: " + BatteryReader::capacityToString (sample.rate * 3600.0) + "%/h";
+    
+    for (const BatteryReader& pack : packs) res += "\n" + pack.getPath () + ": " + pack.toString ();
+    
+    return res;
+}
@@ -21,23 +21,73 @@
  */
  
 #include "CapacityReader.hpp"
-#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdexcept>
+#include <utility>
 
 CapacityReader::CapacityReader (const std::string& path) :
-    capacityPath {path}
+    capacityPath    {path},
+    capacityDesc    {open (capacityPath.c_str (), O_RDONLY | O_CLOEXEC)},
+    prevCapacity    {0},
+    currCapacity    {0},
+    readValid       {false}
 {
     //to rise an exception in case the file does not exists or is wrong and initialize current capacity  for the variation calculation
-    computeCapacity ();
-    if (currCapacity < 0 or currCapacity > 100) throw std::invalid_argument ("The given battery file capacity value is not between 0 and 100 at " + capacityPath);
+    if (capacityDesc < 0) throw std::invalid_argument ("It was not possible to open the battery capacity file " + capacityPath);
+    
+    if (not readValue (currCapacity)) 
+    {
+        close (capacityDesc);
+        throw std::invalid_argument ("Was expected a file containing the battery capacity at " + capacityPath);
+    }
+    
+    if (currCapacity < 0 or currCapacity > 100) 
+    {
+        close (capacityDesc);
+        throw std::invalid_argument ("The given battery file capacity value is not between 0 and 100 at " + capacityPath);
+    }
+    
+    readValid = true;
+}
+
+CapacityReader::~CapacityReader ()
+{
+    if (capacityDesc >= 0) close (capacityDesc);
+}
+
+CapacityReader::CapacityReader (CapacityReader&& cr) :
+    capacityPath    {std::move (cr.capacityPath)},
+    capacityDesc    {cr.capacityDesc},
+    prevCapacity    {cr.prevCapacity},
+    currCapacity    {cr.currCapacity},
+    readValid       {cr.readValid}
+{
+    cr.capacityDesc = -1;
+}
+
+CapacityReader& CapacityReader::operator = (CapacityReader&& cr)
+{
+    //the descriptors are swapped, therefore the one of this object is closed by the destruction of the other
+    std::swap (capacityPath, cr.capacityPath);
+    std::swap (capacityDesc, cr.capacityDesc);
+    prevCapacity    = cr.prevCapacity;
+    currCapacity    = cr.currCapacity;
+    readValid       = cr.readValid;
+    return * this;
 }
 
 uint8_t CapacityReader::readCapacity ()
 {
-    computeCapacity ();
+    readValid = computeCapacity ();
     return static_cast<uint8_t> (currCapacity);
 }
 
+bool CapacityReader::isReadValid () const
+{
+    return readValid;
+}
+
 int CapacityReader::deltaCapacity () const
 {
     return currCapacity - prevCapacity;
@@ -49,21 +99,61 @@ std::string CapacityReader::toString () const
     return "The current battery capacity is: " + std::to_string (currCapacity) + '%';
 }
 
-void CapacityReader::computeCapacity ()
+const std::string& CapacityReader::getPath () const
 {
-    std::ifstream capacityfstream (capacityPath);
+    return capacityPath;
+}
+
+bool CapacityReader::parseInteger (const char* begin, const char* end, int& value)
+{
+    while (begin < end and (* begin == ' ' or * begin == '\t')) ++ begin;
+    
+    const bool negative = begin < end and * begin == '-';
+    if (negative) ++ begin;
+    
+    const char* digits = begin;
+    int result = 0;
+    while (begin < end and * begin >= '0' and * begin <= '9' and result < 100000) result = result * 10 + (* begin ++ - '0');
+    
+    if (begin == digits) return false;
+    
+    //only the line end may follow the number
+    while (begin < end and (* begin == ' ' or * begin == '\t' or * begin == '\n' or * begin == '\r')) ++ begin;
+    if (begin != end) return false;
+    
+    value = negative ? - result : result;
+    return true;
+}
+
+bool CapacityReader::readValue (int& value)
+{
+    char buffer [32];
     
-    if (not capacityfstream.good ()) throw std::invalid_argument ("It was not possible to open the battery capacity file " + capacityPath);
+    const ssize_t len = pread (capacityDesc, buffer, sizeof (buffer), 0);
     
-    std::string capacitystring;
-    std::getline (capacityfstream, capacitystring);
+    return len > 0 and static_cast <size_t> (len) < sizeof (buffer) and parseInteger (buffer, buffer + len, value);
+}
+
+bool CapacityReader::computeCapacity ()
+{
     prevCapacity = currCapacity;
-    try
+    
+    int value;
+    if (capacityDesc >= 0 and readValue (value) and value >= 0 and value <= 100) 
     {
-        currCapacity = std::stoi (capacitystring);
+        currCapacity = value;
+        return true;
     }
-    catch (...)
+    
+    //the battery may have been removed and plugged again, therefore the file is opened again 
+    if (capacityDesc >= 0) close (capacityDesc);
+    capacityDesc = open (capacityPath.c_str (), O_RDONLY | O_CLOEXEC);
+    
+    if (capacityDesc >= 0 and readValue (value) and value >= 0 and value <= 100) 
     {
-        throw std::invalid_argument ("Was expected a file containing the battery capacity, instead the content is " + capacitystring);
+        currCapacity = value;
+        return true;
     }
+    
+    return false;
 }
@@ -0,0 +1,95 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "ChargeRateEstimator.hpp"
+#include "Clock.hpp"
+#include <stdexcept>
+
+ChargeRateEstimator::ChargeRateEstimator (double w) :
+    weight          {w},
+    rates           {0.0, 0.0},
+    measured        {false, false},
+    lastCapacity    {0.0},
+    anchorCapacity  {0.0},
+    anchorSeconds   {0.0},
+    anchorCharging  {false},
+    anchored        {false}
+{
+    if (weight <= 0.0 or weight > 1.0) throw std::invalid_argument ("The rate estimator weight shall be in the interval (0, 1] instead it was found: " + std::to_string (weight));
+}
+
+void ChargeRateEstimator::addSample (double capacity, double seconds, bool charging)
+{
+    lastCapacity = capacity;
+    
+    //after a charger change the slope would mix the two states, the measure begins again from this sample 
+    if (not anchored or anchorCharging != charging or seconds <= anchorSeconds)
+    {
+        anchorCapacity = capacity;
+        anchorSeconds = seconds;
+        anchorCharging = charging;
+        anchored = true;
+        return;
+    }
+    
+    if (capacity == anchorCapacity) return;
+    
+    const double slope = (capacity - anchorCapacity) / (seconds - anchorSeconds);
+    
+    if (measured [charging]) rates [charging] += weight * (slope - rates [charging]);
+    else rates [charging] = slope;
+    measured [charging] = true;
+    
+    anchorCapacity = capacity;
+    anchorSeconds = seconds;
+}
+
+bool ChargeRateEstimator::hasRate (bool charging) const
+{
+    return measured [charging];
+}
+
+double ChargeRateEstimator::rate (bool charging) const
+{
+    return rates [charging];
+}
+
+double ChargeRateEstimator::secondsToReach (double target, bool charging) const
+{
+    if (not measured [charging] or rates [charging] == 0.0) return -1.0;
+    
+    return (target - lastCapacity) / rates [charging];
+}
+
+std::string ChargeRateEstimator::toString () const
+{
+    std::string res {"charging rate: "};
+    res += measured [true] ? std::to_string (rates [true] * 3600.0) + "%/h" : "unknown";
+    res += ", discharging rate: ";
+    res += measured [false] ? std::to_string (rates [false] * 3600.0) + "%/h" : "unknown";
+    return res;
+}
+
+double ChargeRateEstimator::monotonicSeconds ()
+{
+    return static_cast <double> (Clock::monotonicMs ()) / 1000.0;
+}
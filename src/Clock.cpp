@@ -0,0 +1,112 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "Clock.hpp"
+#include <time.h>
+#include <stdexcept>
+
+std::atomic <bool>      Clock::virtualClock     {false};
+std::atomic <long long> Clock::virtualStartMs   {0};
+std::atomic <long long> Clock::virtualElapsedMs {0};
+
+static long long readClockMs (clockid_t id)
+{
+    struct timespec now;
+    clock_gettime (id, & now);
+    return static_cast <long long> (now.tv_sec) * 1000LL + now.tv_nsec / 1000000LL;
+}
+
+time_t Clock::wallTime ()
+{
+    return static_cast <time_t> (wallMs () / 1000LL);
+}
+
+long long Clock::wallMs ()
+{
+    if (virtualClock) return virtualStartMs + virtualElapsedMs;
+    return readClockMs (CLOCK_REALTIME);
+}
+
+long long Clock::monotonicMs ()
+{
+    if (virtualClock) return virtualElapsedMs;
+    return readClockMs (CLOCK_MONOTONIC);
+}
+
+void Clock::startVirtual (time_t start)
+{
+    virtualStartMs      = static_cast <long long> (start) * 1000LL;
+    virtualElapsedMs    = 0;
+    virtualClock        = true;
+}
+
+void Clock::stopVirtual ()
+{
+    virtualClock = false;
+}
+
+void Clock::advance (unsigned long ms)
+{
+    if (virtualClock) virtualElapsedMs += static_cast <long long> (ms);
+}
+
+bool Clock::isVirtual ()
+{
+    return virtualClock;
+}
+
+time_t Clock::parseTime (const std::string& text)
+{
+    if (text.find ('-') == std::string::npos) 
+    {
+        size_t end;
+        const long long seconds = std::stoll (text, & end);
+        if (end != text.size () or seconds < 0) throw std::invalid_argument ("Wrong time: " + text);
+        return static_cast <time_t> (seconds);
+    }
+    
+    struct tm date {};
+    const char* end = strptime (text.c_str (), "%Y-%m-%d %H:%M:%S", & date);
+    if (end == nullptr) 
+    {
+        date = {};
+        end = strptime (text.c_str (), "%Y-%m-%d %H:%M", & date);
+    }
+    if (end == nullptr) 
+    {
+        date = {};
+        end = strptime (text.c_str (), "%Y-%m-%d", & date);
+    }
+    if (end == nullptr or * end != '\0') throw std::invalid_argument ("Wrong time: " + text);
+    
+    //the daylight saving time is decided by mktime
+    date.tm_isdst = -1;
+    return mktime (& date);
+}
+
+std::string Clock::formatTime (time_t seconds)
+{
+    struct tm date;
+    char text [32];
+    strftime (text, sizeof (text), "%Y-%m-%d %H:%M:%S", localtime_r (& seconds, & date));
+    return text;
+}
@@ -65,13 +65,48 @@ std::string Configuration::toString () const
     return res;
 }
 
-std::vector <Configuration> ConfigReader::readConfigFile (const std::vector <Configuration> & defconfs, const std::string & configfilename)
+bool ConfigReader::isSectionHeader (const std::string & line)
+{
+    return line.size () >= 2 and line.front () == '[' and line.back () == ']';
+}
+
+std::vector <std::string> ConfigReader::readSectionNames (const std::string & configfilename)
+{
+    std::ifstream configfile (configfilename);        
+    if (not configfile.good ()) throw std::invalid_argument ("The configuration file '" + configfilename + "' was not found or is not readable");
+    
+    std::vector <std::string> sections;
+    
+    unsigned int lineNumber = 0;
+    for (std::string& line : split (configfile, '\n')) 
+    {
+        ++ lineNumber;
+        
+        if (isSkippable (line)) continue;        
+        trim (line);
+        
+        if (not isSectionHeader (line)) continue;
+        
+        std::string name = line.substr (1, line.size () - 2);
+        trim (name);
+        if (name.empty () or not isValidName (name)) throw std::invalid_argument ("The section name shall contain only alphanumeric characters and underscore instead found: '" + name + "', at the line number: " + std::to_string (lineNumber) + ", with text :" + line);
+        if (std::find (sections.begin (), sections.end (), name) != sections.end ()) throw std::invalid_argument ("The section '" + name + "' is defined twice, last at the line number: " + std::to_string (lineNumber) + ", with text :" + line);
+        
+        sections.push_back (name);
+    }
+    
+    return sections;
+}
+
+std::vector <Configuration> ConfigReader::readConfigFile (const std::vector <Configuration> & defconfs, const std::string & configfilename, const std::string & section)
 {
     std::ifstream configfile (configfilename);        
     if (not configfile.good ()) throw std::invalid_argument ("The configuration file '" + configfilename + "' was not found or is not readable");
     
     std::vector<Configuration> cfgs;
     
+    std::string currentSection;
+    
     unsigned int lineNumber = 0;
     for (std::string& line : split (configfile, '\n')) 
     {
@@ -80,6 +115,15 @@ std::vector <Configuration> ConfigReader::readConfigFile (const std::vector <Con
         if (isSkippable (line)) continue;        
         trim (line);
         
+        if (isSectionHeader (line))
+        {
+            currentSection = line.substr (1, line.size () - 2);
+            trim (currentSection);
+            continue;
+        }
+        
+        if (currentSection != section) continue;
+        
         std::vector <std::string> propertyvalues;
         split (line, propertyvalues, '=');
         
@@ -120,8 +164,8 @@ std::vector <Configuration> ConfigReader::readConfigFile (const std::vector <Con
     return cfgs;
 }
 
-ConfigReader::ConfigReader (const std::vector <Configuration> & props, const std::string & fname) :
-    configurations    {readConfigFile (props, fname)} 
+ConfigReader::ConfigReader (const std::vector <Configuration> & props, const std::string & fname, const std::string & section) :
+    configurations    {readConfigFile (props, fname, section)} 
 {
     resetConfiguration ();
 }
@@ -0,0 +1,239 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "EventLoop.hpp"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+
+//the files are noticed when written, the device when created or made accessible
+static const uint32_t fileMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+static const uint32_t deviceMask = IN_CREATE | IN_ATTRIB | IN_MOVED_TO;
+
+EventLoop::EventLoop () :
+    previousMask    {},
+    epollDesc       {epoll_create1 (EPOLL_CLOEXEC)},
+    timerDesc       {timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)},
+    signalDesc      {openSignalDescriptor ()},
+    inotifyDesc     {inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)},
+    watchedFiles    {},
+    deviceWatch     {-1},
+    deviceDirectory {},
+    deviceEntry     {}
+{
+    if (epollDesc < 0 or timerDesc < 0 or signalDesc < 0 or inotifyDesc < 0 or not addDescriptor (timerDesc) or not addDescriptor (signalDesc) or not addDescriptor (inotifyDesc)) 
+    {
+        const std::string err {strerror (errno)};
+        closeDescriptors ();
+        throw std::invalid_argument ("It was not possible to create the event loop, error: " + err);
+    }
+}
+
+EventLoop::~EventLoop ()
+{
+    closeDescriptors ();
+}
+
+void EventLoop::closeDescriptors ()
+{
+    if (inotifyDesc >= 0)   close (inotifyDesc);
+    if (signalDesc >= 0)    close (signalDesc);
+    if (timerDesc >= 0)     close (timerDesc);
+    if (epollDesc >= 0)     close (epollDesc);
+    
+    sigprocmask (SIG_SETMASK, & previousMask, nullptr);
+}
+
+int EventLoop::openSignalDescriptor ()
+{
+    sigset_t signals;
+    sigemptyset (& signals);
+    sigaddset (& signals, SIGINT);
+    sigaddset (& signals, SIGTERM);
+    sigaddset (& signals, SIGHUP);
+    
+    //the signals must be blocked otherwise their default handlers would run instead of being queued on the descriptor
+    if (sigprocmask (SIG_BLOCK, & signals, & previousMask) != 0) return -1;
+    
+    return signalfd (-1, & signals, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+bool EventLoop::addDescriptor (int fd)
+{
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl (epollDesc, EPOLL_CTL_ADD, fd, & ev) == 0;
+}
+
+bool EventLoop::watchFile (const std::string& path)
+{
+    const size_t sep = path.find_last_of ('/');
+    const std::string dir  = (sep == std::string::npos ? "." : (sep == 0 ? "/" : path.substr (0, sep)));
+    const std::string name = (sep == std::string::npos ? path : path.substr (sep + 1));
+    
+    const int wd = inotify_add_watch (inotifyDesc, dir.c_str (), fileMask | (dir == deviceDirectory ? IN_MASK_ADD : 0));
+    if (wd < 0) return false;
+    
+    watchedFiles.push_back ({wd, name});
+    return true;
+}
+
+bool EventLoop::watchDevice (const std::string& path)
+{
+    std::string dir = path;
+    std::string entry;
+    
+    while (true)
+    {
+        const size_t sep = dir.find_last_of ('/');
+        entry = (sep == std::string::npos ? dir : dir.substr (sep + 1));
+        dir = (sep == std::string::npos ? "." : (sep == 0 ? "/" : dir.substr (0, sep)));
+        
+        struct stat st;
+        if (stat (dir.c_str (), & st) == 0 or dir == "/" or dir == ".") break;
+    }
+    
+    if (deviceWatch >= 0 and dir == deviceDirectory and entry == deviceEntry) return true;
+    
+    unwatchDevice ();
+    
+    //the directory may be shared with the watched files, their events are kept
+    const int wd = inotify_add_watch (inotifyDesc, dir.c_str (), deviceMask | IN_MASK_ADD);
+    if (wd < 0) return false;
+    
+    deviceWatch     = wd;
+    deviceDirectory = dir;
+    deviceEntry     = entry;
+    return true;
+}
+
+void EventLoop::unwatchDevice ()
+{
+    if (deviceWatch < 0) return;
+    
+    //a directory shared with the watched files gets back only their events
+    if (std::any_of (watchedFiles.begin (), watchedFiles.end (), [&] (const std::pair <int, std::string>& wf) {return wf.first == deviceWatch;})) inotify_add_watch (inotifyDesc, deviceDirectory.c_str (), fileMask);
+    else inotify_rm_watch (inotifyDesc, deviceWatch);
+    
+    deviceWatch = -1;
+    deviceDirectory.clear ();
+    deviceEntry.clear ();
+}
+
+bool EventLoop::watchDescriptor (int fd)
+{
+    return addDescriptor (fd);
+}
+
+void EventLoop::clearWatches ()
+{
+    unwatchDevice ();
+    
+    //many files may share the same directory watch, removing it twice just fails
+    for (const std::pair <int, std::string>& wf : watchedFiles) inotify_rm_watch (inotifyDesc, wf.first);
+    
+    watchedFiles.clear ();
+}
+
+void EventLoop::setTimeout (unsigned long ms)
+{
+    struct itimerspec its {};
+    its.it_value.tv_sec  = static_cast <time_t> (ms / 1000);
+    its.it_value.tv_nsec = static_cast <long> ((ms % 1000) * 1000000);
+    
+    //a zero value would disarm the timer, therefore the shortest timeout is used instead
+    if (ms == 0) its.it_value.tv_nsec = 1;
+    
+    timerfd_settime (timerDesc, 0, & its, nullptr);
+}
+
+bool EventLoop::readFileChanges ()
+{
+    alignas (struct inotify_event) char buffer [4096];
+    bool changed = false;
+    
+    ssize_t len;
+    while ((len = read (inotifyDesc, buffer, sizeof (buffer))) > 0)
+    {
+        for (char* p = buffer; p < buffer + len; )
+        {
+            const struct inotify_event* ev = reinterpret_cast <const struct inotify_event*> (p);
+            if (ev->len and std::any_of (watchedFiles.begin (), watchedFiles.end (), [&] (const std::pair <int, std::string>& wf) {return wf.first == ev->wd and wf.second == ev->name;})) changed = true;
+            if (ev->len and ev->wd == deviceWatch and deviceEntry == ev->name) changed = true;
+            p += sizeof (struct inotify_event) + ev->len;
+        }
+    }
+    
+    return changed;
+}
+
+void EventLoop::discardFileChanges ()
+{
+    readFileChanges ();
+}
+
+EventLoop::Event EventLoop::wait ()
+{
+    while (true)
+    {
+        struct epoll_event ev;
+        const int n = epoll_wait (epollDesc, & ev, 1, -1);
+        
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            throw std::runtime_error ("The event loop wait failed with error: " + std::string (strerror (errno)));
+        }
+        
+        if (ev.data.fd == signalDesc)
+        {
+            struct signalfd_siginfo si;
+            if (read (signalDesc, & si, sizeof (si)) != sizeof (si)) continue;
+            if (si.ssi_signo == SIGHUP) return RELOAD;
+            return TERMINATE;
+        }
+        
+        if (ev.data.fd == timerDesc)
+        {
+            uint64_t expirations;
+            if (read (timerDesc, & expirations, sizeof (expirations)) != sizeof (expirations)) continue;
+            return TIMEOUT;
+        }
+        
+        if (ev.data.fd == inotifyDesc)
+        {
+            if (readFileChanges ()) return FILECHANGE;
+            continue;
+        }
+        
+        return READABLE;
+    }
+}
@@ -0,0 +1,118 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "HidrawProtocol.hpp"
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include <array>
+#include <stdexcept>
+
+HidrawProtocol::HidrawProtocol (const std::string& path) :
+    fd              {open (path.c_str (), O_RDWR | O_CLOEXEC)},
+    writes          {},
+    readRequired    {false},
+    feedbacks       {},
+    nextState       {0},
+    errors          {0}
+{
+    if (fd < 0) throw std::invalid_argument ("It was not possible to open for read and write the hidraw device: " + path + ", lastError: " + std::string (strerror (errno)));
+}
+
+HidrawProtocol::HidrawProtocol (HidrawProtocol&& other) noexcept :
+    fd              {other.fd},
+    writes          {std::move (other.writes)},
+    readRequired    {other.readRequired},
+    feedbacks       {std::move (other.feedbacks)},
+    nextState       {other.nextState},
+    errors          {other.errors}
+{
+    other.fd = -1;
+}
+
+HidrawProtocol::~HidrawProtocol ()
+{
+    if (fd >= 0) close (fd);
+}
+
+bool HidrawProtocol::queueFrame (uint8_t channel, RelayDriver::Command command, bool state)
+{
+    if (command != RelayDriver::CHECK) writes.push_back ({channel, state});
+    if (command != RelayDriver::ON and command != RelayDriver::OFF) readRequired = true;
+    
+    return true;
+}
+
+bool HidrawProtocol::sendFrames (unsigned int)
+{
+    std::vector <Feedback> toWrite;
+    toWrite.swap (writes);
+    
+    const bool read = readRequired;
+    readRequired = false;
+    
+    feedbacks.clear ();
+    nextState = 0;
+    
+    //the report number is 0 because the boards do not number their reports, 0xFF turns a channel on and 0xFD off
+    for (const Feedback& write : toWrite)
+    {
+        std::array <uint8_t, reportLength> report {0, static_cast <uint8_t> (write.state ? 0xFF : 0xFD), write.channel};
+        if (ioctl (fd, HIDIOCSFEATURE (reportLength), report.data ()) < 0) return false;
+    }
+    
+    if (not read) return true;
+    
+    //the byte 7 of the report holds a bit for every channel, it follows the report number
+    std::array <uint8_t, reportLength> report {};
+    if (ioctl (fd, HIDIOCGFEATURE (reportLength), report.data ()) < 0) 
+    {
+        ++ errors;
+        return true;
+    }
+    
+    for (uint8_t c = 1; c <= maxChannels; ++ c) feedbacks.push_back ({c, ((report [8] >> (c - 1)) & 1) != 0});
+    
+    return true;
+}
+
+bool HidrawProtocol::nextFeedback (uint8_t& channel, bool& state)
+{
+    if (nextState == feedbacks.size ()) return false;
+    
+    channel = feedbacks [nextState].channel;
+    state = feedbacks [nextState].state;
+    ++ nextState;
+    return true;
+}
+
+bool HidrawProtocol::waitFeedback (std::chrono::steady_clock::time_point)
+{
+    return false;
+}
+
+unsigned long HidrawProtocol::frameErrors () const
+{
+    return errors;
+}
@@ -0,0 +1,251 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "HistoryStore.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <stdexcept>
+
+static const char storeMagic [8] = {'B', 'A', 'T', 'G', 'H', 'I', 'S', 'T'};
+static const uint32_t storeVersion = 1;
+
+//the header is shared with other processes through the mapping, the fields telling which records are complete are accessed atomically
+template <class T> static T loadShared (const T& field)
+{
+    return __atomic_load_n (& field, __ATOMIC_ACQUIRE);
+}
+
+template <class T> static void storeShared (T& field, T value)
+{
+    __atomic_store_n (& field, value, __ATOMIC_RELEASE);
+}
+
+HistoryStore::HistoryStore (const std::string& p, bool ro) :
+    path        {p},
+    readOnly    {ro},
+    fileDesc    {open (path.c_str (), (readOnly ? O_RDONLY : O_RDWR | O_CREAT) | O_CLOEXEC, 0644)},
+    header      {nullptr},
+    segmentMaps (maxSegments, nullptr)
+{
+    if (fileDesc < 0) throw std::invalid_argument ("It was not possible to open the history file " + path + ", error: " + std::string (strerror (errno)));
+    
+    struct stat st;
+    const bool empty = fstat (fileDesc, & st) == 0 and st.st_size == 0;
+    
+    if (empty and readOnly)
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("The file " + path + " is not a batguard history");
+    }
+    
+    if (empty and not readOnly and ftruncate (fileDesc, headerBytes) != 0)
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("It was not possible to create the history file " + path);
+    }
+    
+    void* map = mmap (nullptr, headerBytes, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fileDesc, 0);
+    if (map == MAP_FAILED)
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("It was not possible to map the history file " + path + ", error: " + std::string (strerror (errno)));
+    }
+    
+    header = static_cast <Header*> (map);
+    
+    if (empty and not readOnly) initHeader ();
+    
+    try
+    {
+        checkHeader ();
+    }
+    catch (const std::invalid_argument&)
+    {
+        unmapAll ();
+        close (fileDesc);
+        throw;
+    }
+}
+
+HistoryStore::~HistoryStore ()
+{
+    unmapAll ();
+    close (fileDesc);
+}
+
+void HistoryStore::initHeader ()
+{
+    memset (header, 0, sizeof (Header));
+    header->version         = storeVersion;
+    header->recordSize      = sizeof (Record);
+    header->segmentRecords  = recordsPerSegment;
+    header->segmentSlots    = maxSegments;
+    
+    //the magic is written at last, a file with the magic has a complete header
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    memcpy (header->magic, storeMagic, sizeof (storeMagic));
+}
+
+void HistoryStore::checkHeader () const
+{
+    if (memcmp (header->magic, storeMagic, sizeof (storeMagic)) != 0) throw std::invalid_argument ("The file " + path + " is not a batguard history");
+    
+    if (header->version != storeVersion or header->recordSize != sizeof (Record) or header->segmentRecords != recordsPerSegment or header->segmentSlots != maxSegments) throw std::invalid_argument ("The history file " + path + " has a different format version");
+    
+    if (loadShared (header->segments) > maxSegments or loadShared (header->firstSegment) >= maxSegments) throw std::invalid_argument ("The history file " + path + " is corrupted");
+}
+
+void HistoryStore::unmapAll ()
+{
+    for (Record*& map : segmentMaps)
+    {
+        if (map != nullptr) munmap (map, segmentBytes);
+        map = nullptr;
+    }
+    
+    if (header != nullptr) munmap (header, headerBytes);
+    header = nullptr;
+}
+
+HistoryStore::Record* HistoryStore::mapSegment (uint32_t slot) const
+{
+    if (segmentMaps [slot] != nullptr) return segmentMaps [slot];
+    
+    const off_t offset = static_cast <off_t> (headerBytes + slot * segmentBytes);
+    void* map = mmap (nullptr, segmentBytes, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fileDesc, offset);
+    if (map == MAP_FAILED) throw std::runtime_error ("It was not possible to map the history file " + path + ", error: " + std::string (strerror (errno)));
+    
+    segmentMaps [slot] = static_cast <Record*> (map);
+    return segmentMaps [slot];
+}
+
+const HistoryStore::Segment& HistoryStore::segmentAt (uint32_t order) const
+{
+    return header->index [(loadShared (header->firstSegment) + order) % maxSegments];
+}
+
+void HistoryStore::append (const Record& rec)
+{
+    if (readOnly) throw std::runtime_error ("The history file " + path + " is open read only");
+    
+    Record record = rec;
+    
+    //only this process writes the header, therefore it reads its own fields without synchronization
+    const uint32_t segments = header->segments;
+    
+    //the time must not decrease to allow the binary search, the wall clock may be set backward
+    if (segments and record.wallMs < segmentAt (segments - 1).lastMs) record.wallMs = segmentAt (segments - 1).lastMs;
+    
+    if (segments == 0 or segmentAt (segments - 1).count == recordsPerSegment)
+    {
+        if (segments < maxSegments) 
+        {
+            const uint32_t slot = (header->firstSegment + segments) % maxSegments;
+            
+            //the file grows by a segment at a time
+            struct stat st;
+            const off_t required = static_cast <off_t> (headerBytes + (slot + 1) * segmentBytes);
+            if (fstat (fileDesc, & st) != 0 or (st.st_size < required and ftruncate (fileDesc, required) != 0)) throw std::runtime_error ("It was not possible to grow the history file " + path + ", error: " + std::string (strerror (errno)));
+            
+            Segment& segment = header->index [slot];
+            storeShared (segment.count, uint32_t {0});
+            storeShared (segment.firstMs, record.wallMs);
+            storeShared (segment.lastMs, record.wallMs);
+            storeShared (header->segments, segments + 1);
+        }
+        else
+        {
+            //the oldest segment is dropped to store the new records
+            const uint32_t slot = header->firstSegment;
+            Segment& segment = header->index [slot];
+            storeShared (segment.count, uint32_t {0});
+            storeShared (header->firstSegment, (slot + 1) % maxSegments);
+            storeShared (segment.firstMs, record.wallMs);
+            storeShared (segment.lastMs, record.wallMs);
+        }
+    }
+    
+    const uint32_t slot = (header->firstSegment + header->segments - 1) % maxSegments;
+    Segment& segment = header->index [slot];
+    
+    mapSegment (slot) [segment.count] = record;
+    
+    //the record is visible to the readers only after it is complete
+    storeShared (segment.lastMs, record.wallMs);
+    storeShared (segment.count, segment.count + 1);
+}
+
+size_t HistoryStore::size () const
+{
+    size_t n = 0;
+    const uint32_t segments = loadShared (header->segments);
+    for (uint32_t s = 0; s < segments; ++ s) n += loadShared (segmentAt (s).count);
+    return n;
+}
+
+size_t HistoryStore::query (long long fromMs, long long toMs, std::vector <Record>& out) const
+{
+    const size_t initial = out.size ();
+    const uint32_t segments = loadShared (header->segments);
+    
+    for (uint32_t s = 0; s < segments; ++ s)
+    {
+        const Segment& segment = segmentAt (s);
+        const uint32_t count = loadShared (segment.count);
+        
+        if (count == 0 or loadShared (segment.lastMs) < fromMs) continue;
+        if (loadShared (segment.firstMs) >= toMs) break;
+        
+        const Record* records = mapSegment (static_cast <uint32_t> (& segment - header->index));
+        
+        const Record* begin = std::lower_bound (records, records + count, fromMs, [] (const Record& r, long long ms) {return r.wallMs < ms;});
+        const Record* end   = std::lower_bound (begin, records + count, toMs, [] (const Record& r, long long ms) {return r.wallMs < ms;});
+        
+        out.insert (out.end (), begin, end);
+    }
+    
+    return out.size () - initial;
+}
+
+bool HistoryStore::last (Record& record) const
+{
+    const uint32_t segments = loadShared (header->segments);
+    if (segments == 0) return false;
+    
+    const Segment& segment = segmentAt (segments - 1);
+    const uint32_t count = loadShared (segment.count);
+    
+    if (count == 0) return false;
+    
+    record = mapSegment (static_cast <uint32_t> (& segment - header->index)) [count - 1];
+    return true;
+}
+
+const std::string& HistoryStore::getPath () const
+{
+    return path;
+}
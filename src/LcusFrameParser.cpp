@@ -0,0 +1,78 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "LcusFrameParser.hpp"
+
+LcusFrameParser::LcusFrameParser () :
+    wrongChecksums  {0},
+    skipped         {0}
+{
+}
+
+bool LcusFrameParser::nextFrame (SerialPort& port, Frame& frame)
+{
+    while (port.bytesToRead ())
+    {
+        if (port.peekByte (0) != header)
+        {
+            ++ skipped;
+            port.consume (1);
+            continue;
+        }
+        
+        if (port.bytesToRead () < frameLength) return false;
+        
+        //the frame is copied only to check it, it may wrap around the end of the ring buffer
+        uint8_t data [frameLength];
+        for (unsigned int i = 0; i < frameLength; ++ i) data [i] = port.peekByte (i);
+        
+        //the header may be noise or the frame may be corrupted, the search restarts from the next byte
+        if (data [frameLength - 1] != checksum (data))
+        {
+            ++ wrongChecksums;
+            port.consume (1);
+            continue;
+        }
+        
+        frame = Frame {data [1], data [2]};
+        port.consume (frameLength);
+        return true;
+    }
+    
+    return false;
+}
+
+unsigned long LcusFrameParser::checksumErrors () const
+{
+    return wrongChecksums;
+}
+
+unsigned long LcusFrameParser::skippedBytes () const
+{
+    return skipped;
+}
+
+uint8_t LcusFrameParser::checksum (const uint8_t* data)
+{
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < frameLength - 1; ++ i) sum += data [i];
+    return static_cast <uint8_t> (sum % 0x100);
+}
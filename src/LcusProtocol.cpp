@@ -0,0 +1,82 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "LcusProtocol.hpp"
+
+LcusProtocol::LcusProtocol (SerialPort& s) :
+    serialPort  {s},
+    parser      {}
+{
+}
+
+bool LcusProtocol::queueFrame (uint8_t channel, RelayDriver::Command command, bool)
+{
+    uint8_t frame [LcusFrameParser::frameLength] = {LcusFrameParser::header, channel, static_cast <uint8_t> (command), 0};
+    frame [LcusFrameParser::frameLength - 1] = LcusFrameParser::checksum (frame);
+    
+    //when the write buffer is full it is sent to make room for the remaining bytes
+    for (uint8_t c : frame) 
+    {
+        if (serialPort.writeByte (c)) continue;
+        if (serialPort.writeFlush () == 0 or not serialPort.writeByte (c)) return false;
+    }
+    
+    return true;
+}
+
+bool LcusProtocol::sendFrames (unsigned int)
+{
+    //all the frames are written by a single call as far as they fit the write buffer
+    while (serialPort.bytesToWrite ()) 
+    {
+        if (serialPort.writeFlush () == 0) return false;
+    }
+    
+    return true;
+}
+
+bool LcusProtocol::nextFeedback (uint8_t& channel, bool& state)
+{
+    LcusFrameParser::Frame frame;
+    if (not parser.nextFrame (serialPort, frame)) return false;
+    
+    channel = frame.channel;
+    state = frame.state;
+    return true;
+}
+
+bool LcusProtocol::waitFeedback (std::chrono::steady_clock::time_point deadline)
+{
+    return waitBytes (serialPort, deadline);
+}
+
+unsigned long LcusProtocol::frameErrors () const
+{
+    return parser.checksumErrors ();
+}
+
+bool LcusProtocol::waitBytes (SerialPort& port, std::chrono::steady_clock::time_point deadline)
+{
+    const long long left = std::chrono::duration_cast <std::chrono::milliseconds> (deadline - std::chrono::steady_clock::now ()).count ();
+    const unsigned int available = port.bytesToRead ();
+    
+    return port.readFlushUntil (available + 1, left > 0 ? static_cast <unsigned int> (left) : 0) > available;
+}
@@ -21,6 +21,7 @@
  */
  
 #include "LogWriter.hpp"
+#include "Clock.hpp"
 #include <ctime>
 #include <cstdio> 
 
@@ -36,15 +37,47 @@ LogWriter::LogWriter (const std::string& path, uint8_t mel, uint8_t fl, unsigned
 {
     if (maxErrLvl == 0) return;
     
-    if (maxErrLvl > FULL + 1) throw std::invalid_argument ("The log level required: " + std::to_string (maxErrLvl) + " exceeds the maximum: " + std::to_string (FULL + 1));
-    
-    if (maxFlushLvl > FULL + 1) throw std::invalid_argument ("The flush level required: " + std::to_string (maxFlushLvl) + " exceeds the maximum: " + std::to_string (FULL + 1));
+    checkLevels (maxErrLvl, maxFlushLvl);
             
     open ();
     
     if (not logFile.good ()) throw std::invalid_argument ("It is not possible to create the log file " + path);
 }
 
+void LogWriter::checkLevels (uint8_t mel, uint8_t fl)
+{
+    if (mel > FULL + 1) throw std::invalid_argument ("The log level required: " + std::to_string (mel) + " exceeds the maximum: " + std::to_string (FULL + 1));
+    
+    if (fl > FULL + 1) throw std::invalid_argument ("The flush level required: " + std::to_string (fl) + " exceeds the maximum: " + std::to_string (FULL + 1));
+}
+
+void LogWriter::reconfigure (const std::string& path, uint8_t mel, uint8_t fl, unsigned int mtfln, unsigned int mln)
+{
+    checkLevels (mel, fl);
+    
+    if (mel and (path != logFileName or not logFile.is_open ()))
+    {
+        std::ofstream nlf (path, std::ios::app);
+        if (not nlf.is_open ()) nlf.open (path);
+        if (not nlf.good ()) throw std::invalid_argument ("It is not possible to create the log file " + path);
+        
+        if (logFile.is_open ()) logFile.close ();
+        logFile = std::move (nlf);
+        logFileName = path;
+        logLns = countLogLines ();
+        toFlsLns = 0;
+    }
+    else if (mel == 0 and logFile.is_open ())
+    {
+        logFile.close ();
+    }
+    
+    maxErrLvl = mel;
+    maxFlushLvl = fl;
+    maxToFlsLns = mtfln;
+    maxLogLns = mln;
+}
+
 LogWriter::~LogWriter ()
 {
     if (logFile.is_open ()) logFile.close ();
@@ -52,7 +85,7 @@ LogWriter::~LogWriter ()
 
 void LogWriter::computeDate ()
 {
-    time_t now = time (nullptr);
+    time_t now = Clock::wallTime ();
     const tm* localTime = localtime (& now);
     strftime (dateCharArray, sizeof (dateCharArray), "%Y-%m-%d %H:%M:%S", localTime);
 }
@@ -0,0 +1,215 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "ModbusProtocol.hpp"
+#include "LcusProtocol.hpp"
+#include <unistd.h>
+#include <algorithm>
+
+ModbusProtocol::ModbusProtocol (SerialPort& s, uint8_t addr) :
+    serialPort      {s},
+    address         {addr},
+    writes          {},
+    firstRead       {0},
+    lastRead        {0},
+    pendingFirst    {0},
+    pendingCount    {0},
+    echoed          {0},
+    feedbacks       {},
+    nextState       {0},
+    errors          {0}
+{
+}
+
+bool ModbusProtocol::queueFrame (uint8_t channel, RelayDriver::Command command, bool state)
+{
+    if (command != RelayDriver::CHECK) writes.push_back ({channel, state});
+    
+    if (command != RelayDriver::ON and command != RelayDriver::OFF)
+    {
+        firstRead = firstRead ? std::min (firstRead, channel) : channel;
+        lastRead = std::max (lastRead, channel);
+    }
+    
+    return true;
+}
+
+bool ModbusProtocol::sendFrames (unsigned int answerWaitMs)
+{
+    std::vector <Feedback> toWrite;
+    toWrite.swap (writes);
+    
+    const uint8_t first = firstRead;
+    const uint8_t count = static_cast <uint8_t> (lastRead - first + 1);
+    firstRead = lastRead = 0;
+    
+    //a reply arriving after the previous transaction is not matched anymore
+    feedbacks.clear ();
+    nextState = 0;
+    pendingFirst = pendingCount = 0;
+    
+    for (const Feedback& write : toWrite)
+    {
+        if (not sendFrame (writeCoil, write.channel, write.state ? 0xFF00 : 0x0000)) return false;
+        
+        //without the echo the next frame waits for this one to be transmitted
+        if (answerWaitMs == 0) 
+        {
+            waitSilence (12);
+            continue;
+        }
+        
+        //the echo only paces the writes, the state is verified by the read
+        const auto deadline = std::chrono::steady_clock::now () + std::chrono::milliseconds (answerWaitMs);
+        echoed = 0;
+        do
+        {
+            while (echoed != write.channel and nextReply ()) {}
+        }
+        while (echoed != write.channel and LcusProtocol::waitBytes (serialPort, deadline));
+        
+        waitSilence (4);
+    }
+    
+    if (first == 0) return true;
+    
+    if (not sendFrame (readCoils, first, count)) return false;
+    
+    pendingFirst = first;
+    pendingCount = count;
+    return true;
+}
+
+bool ModbusProtocol::nextFeedback (uint8_t& channel, bool& state)
+{
+    while (nextState == feedbacks.size () and nextReply ()) {}
+    
+    if (nextState == feedbacks.size ()) return false;
+    
+    channel = feedbacks [nextState].channel;
+    state = feedbacks [nextState].state;
+    ++ nextState;
+    return true;
+}
+
+bool ModbusProtocol::waitFeedback (std::chrono::steady_clock::time_point deadline)
+{
+    return LcusProtocol::waitBytes (serialPort, deadline);
+}
+
+unsigned long ModbusProtocol::frameErrors () const
+{
+    return errors;
+}
+
+uint16_t ModbusProtocol::crc16 (const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    
+    for (size_t i = 0; i < length; ++ i)
+    {
+        crc ^= data [i];
+        for (int bit = 0; bit < 8; ++ bit) crc = (crc & 1) ? static_cast <uint16_t> ((crc >> 1) ^ 0xA001) : static_cast <uint16_t> (crc >> 1);
+    }
+    
+    return crc;
+}
+
+bool ModbusProtocol::sendFrame (uint8_t function, uint8_t channel, uint16_t value)
+{
+    const uint16_t coil = static_cast <uint16_t> (channel - 1);
+    uint8_t frame [8] = {address, function, static_cast <uint8_t> (coil >> 8), static_cast <uint8_t> (coil & 0xFF), static_cast <uint8_t> (value >> 8), static_cast <uint8_t> (value & 0xFF), 0, 0};
+    
+    const uint16_t crc = crc16 (frame, 6);
+    frame [6] = static_cast <uint8_t> (crc & 0xFF);
+    frame [7] = static_cast <uint8_t> (crc >> 8);
+    
+    for (uint8_t c : frame) if (not serialPort.writeByte (c)) return false;
+    
+    while (serialPort.bytesToWrite ()) 
+    {
+        if (serialPort.writeFlush () == 0) return false;
+    }
+    
+    return true;
+}
+
+bool ModbusProtocol::nextReply ()
+{
+    while (serialPort.bytesToRead ())
+    {
+        if (serialPort.peekByte (0) != address)
+        {
+            serialPort.consume (1);
+            continue;
+        }
+        
+        if (serialPort.bytesToRead () < 3) return false;
+        
+        const uint8_t function = serialPort.peekByte (1);
+        unsigned int length = maxReplyLength + 1;
+        
+        if      (function == writeCoil)     length = 8;
+        else if (function == readCoils)     length = 5u + serialPort.peekByte (2);
+        else if (function & 0x80)           length = 5;
+        
+        //the address may be noise, the search restarts from the next byte
+        if (length > maxReplyLength)
+        {
+            serialPort.consume (1);
+            continue;
+        }
+        
+        if (serialPort.bytesToRead () < length) return false;
+        
+        //the reply is copied only to check it, it may wrap around the end of the ring buffer
+        uint8_t data [maxReplyLength];
+        for (unsigned int i = 0; i < length; ++ i) data [i] = serialPort.peekByte (i);
+        
+        const uint16_t crc = crc16 (data, length - 2);
+        if (data [length - 2] != (crc & 0xFF) or data [length - 1] != (crc >> 8))
+        {
+            ++ errors;
+            serialPort.consume (1);
+            continue;
+        }
+        
+        serialPort.consume (length);
+        
+        if (function == writeCoil) echoed = static_cast <uint8_t> (((data [2] << 8) | data [3]) + 1);
+        else if (function == readCoils and pendingCount and data [2] == (pendingCount + 7) / 8)
+        {
+            for (unsigned int i = 0; i < pendingCount; ++ i) feedbacks.push_back ({static_cast <uint8_t> (pendingFirst + i), ((data [3 + i / 8] >> (i % 8)) & 1) != 0});
+            pendingFirst = pendingCount = 0;
+        }
+        else ++ errors; //an exception or a read not requested
+        
+        return true;
+    }
+    
+    return false;
+}
+
+void ModbusProtocol::waitSilence (unsigned int characters) const
+{
+    //every character takes 11 bits: start, 8 data, parity or stop and stop
+    usleep (static_cast <useconds_t> (characters * 11ULL * 1000000ULL / std::max (serialPort.getBaudRate (), 1u)));
+}
@@ -21,6 +21,7 @@
  */
  
 #include "ProfileSchedules.hpp"
+#include "Clock.hpp"
 #include <stdexcept>
 #include <algorithm>
 #include <cstdint>
@@ -83,13 +84,18 @@ ProfileSchedule::ProfileSchedule (const bool e, const std::vector<bool>& moy, co
 }
 
 bool ProfileSchedule::doesInclude (const struct tm* t) const
+{  
+    return  doesIncludeDay (t)          and
+            from <= t                   and
+            to >= t;
+}
+
+bool ProfileSchedule::doesIncludeDay (const struct tm* t) const
 {  
     return  enabled                     and
             monthOfYear [t->tm_mon]     and //0 - 11
             dayOfMonth [t->tm_mday-1]   and //1 - 31
-            dayOfWeek [t->tm_wday]      and //0 - 6 since Sunday
-            from <= t                   and
-            to >= t;
+            dayOfWeek [t->tm_wday];         //0 - 6 since Sunday
 }
 
 bool ProfileSchedule::doesOverlap (const ProfileSchedule& s) const
@@ -180,7 +186,7 @@ const ProfileSchedule* ProfileSchedules::getScheduleTriggered (time_t nowraw) co
 {
     if (not enabled or enabledSchedules.size () == 0) return nullptr;
     
-    if (not nowraw) nowraw = time (nullptr);
+    if (not nowraw) nowraw = Clock::wallTime ();
     
     const struct tm* now = localtime (& nowraw);
 
@@ -191,6 +197,59 @@ const ProfileSchedule* ProfileSchedules::getScheduleTriggered (time_t nowraw) co
     return nullptr;
 }
 
+time_t ProfileSchedules::getNextTransition (time_t nowraw, unsigned int maxDays) const
+{
+    if (not enabled or enabledSchedules.size () == 0) return 0;
+    
+    if (not nowraw) nowraw = Clock::wallTime ();
+    
+    const ProfileSchedule* current = getScheduleTriggered (nowraw);
+    
+    //localtime returns a pointer to a static object which is overwritten by getScheduleTriggered
+    const struct tm today = * localtime (& nowraw);
+    
+    //the triggered schedule can only change at midnight or at the from/to boundaries of the schedules active in that day 
+    std::vector <time_t> boundaries;
+    boundaries.reserve (1 + 2 * enabledSchedules.size ());
+    
+    for (unsigned int d = 0; d <= maxDays; ++ d)
+    {
+        struct tm day = today;
+        day.tm_mday += static_cast <int> (d);
+        day.tm_hour = 0;
+        day.tm_min = 0;
+        day.tm_sec = 0;
+        day.tm_isdst = -1;
+        
+        boundaries.clear ();
+        boundaries.push_back (mktime (& day)); //mktime normalizes day, month and computes the day of week
+        
+        for (const ProfileSchedule& ps : enabledSchedules)
+        {
+            if (not ps.doesIncludeDay (& day)) continue;
+            
+            struct tm bound = day;
+            bound.tm_hour = ps.from.hour;
+            bound.tm_min = ps.from.min;
+            bound.tm_isdst = -1;
+            boundaries.push_back (mktime (& bound));
+            
+            //the to time is inclusive therefore the schedule ends at the following minute
+            bound = day;
+            bound.tm_hour = ps.to.hour;
+            bound.tm_min = ps.to.min + 1;
+            bound.tm_isdst = -1;
+            boundaries.push_back (mktime (& bound));
+        }
+        
+        std::sort (boundaries.begin (), boundaries.end ());
+        
+        for (time_t b : boundaries) if (b > nowraw and getScheduleTriggered (b) != current) return b;
+    }
+    
+    return 0;
+}
+
 std::string  ProfileSchedules::toString () const
 {
     std::string schels;
@@ -21,94 +21,178 @@
  */
  
 #include "RelayDriver.hpp"
-#include <unistd.h>
+#include "Clock.hpp"
 #include <stdexcept>
 #include <algorithm>
 
-bool RelayDriver::sendMessage ()
+bool RelayDriver::queueCommand (uint8_t channel, Command command)
 {
-    if (not std::all_of (message.begin (), message.end (), [this](uint8_t c) {return serialPort.writeByte (c);})) return false ;
-    return serialPort.writeFlush () >= messageLength;
+    if (not queueFrame (channel, command, relayStates [channel])) return false;
+    
+    ++ sent;
+    return true;
 }
 
-bool RelayDriver::recvMessage ()
+bool RelayDriver::recvFeedback (uint8_t& channel, bool& state)
 {
-    if (serialPort.readFlush () < messageLength) return false;
+    const auto deadline = std::chrono::steady_clock::now () + std::chrono::milliseconds (answerWaitMs);
+    bool found = false;
     
-    //if there are extra inputs, may be previous ones were missed, it realign to the last 4 bytes received
-    while (serialPort.bytesToRead () > messageLength) serialPort.readByte (); 
+    //the feedbacks may be split among many reads, the one of the relay channel commanded is preferred to any other
+    do
+    {
+        uint8_t nextChannel;
+        bool    nextState;
+        while (nextFeedback (nextChannel, nextState))
+        {
+            channel = nextChannel;
+            state = nextState;
+            found = true;
+            if (channel == relayChannel) return true;
+        }
+    }
+    while (waitFeedback (deadline));
     
-    for (unsigned int i = 0; i < messageLength; ++ i) message [i] = serialPort.readByte ();
-    return true;
+    return found;
 }
 
-uint8_t RelayDriver::computeCRC ()
+RelayDriver::RelayDriver (unsigned int awms) :
+    maxRelayChannels    {0},
+    relayStates         {},
+    answerWaitMs        {awms},
+    error               {NO},
+    relayChannel        {0},
+    confirmedMs         {},
+    verifyIntervalMs    {0},
+    sent                {0},
+    suppressed          {0}
 {
-    unsigned int crc = 0;
-    for (unsigned int i = 0; i < messageLength - 1; ++ i) crc += message [i];
-    return static_cast<uint8_t> (crc % 0x100);
 }
 
-void RelayDriver::addCRC ()
+RelayDriver::~RelayDriver () = default;
+
+void RelayDriver::probeChannels (uint8_t channels)
 {
-    message [messageLength - 1] = computeCRC ();
+    setChannels (channels);
+    
+    std::vector <uint8_t> all;
+    for (uint8_t c = 1; c < maxRelayChannels; ++ c) all.push_back (c);
+    
+    probeChannels (all);
 }
 
-bool RelayDriver::checkCRC ()
+void RelayDriver::setChannels (uint8_t channels)
 {
-    return message [0] == 0xA0 and message [messageLength - 1] == computeCRC ();
+    maxRelayChannels = ++ channels; //one more because [0] is not used!!!!
+    relayStates.assign (maxRelayChannels, false);
+    confirmedMs.assign (maxRelayChannels, -1);
 }
 
-RelayDriver::RelayDriver (SerialPort& s, uint8_t channels, unsigned int awms) :
-    maxRelayChannels    {++ channels}, //one more because [0] is not used!!!!
-    relayStates         (maxRelayChannels, false),
-    serialPort          {s},    
-    answerWaitMs        {awms * 1000},
-    error               {NO}
+void RelayDriver::setVerifyInterval (unsigned int seconds)
 {
-    //called sendCommand to initialize relayState variable properly
-    for (uint8_t c = 1; c < maxRelayChannels; ++ c) sendCommand (c, CHECK);
+    verifyIntervalMs = seconds * 1000LL;
 }
 
-RelayDriver::Error RelayDriver::lastError () const
+unsigned long RelayDriver::sentFrames () const
 {
-    return error;
+    return sent;
 }
 
-RelayDriver::Command RelayDriver::recvCommand ()
+unsigned long RelayDriver::suppressedFrames () const
 {
-    if (not recvMessage ()) 
+    return suppressed;
+}
+
+unsigned int RelayDriver::probeChannels (const std::vector <uint8_t>& channels)
+{
+    std::vector <bool> answered (maxRelayChannels, false);
+    unsigned int answers = 0;
+    
+    for (uint8_t c : channels)
     {
-        error = NORECV;
-        return ERROR;
+        if (c < 1 or c >= maxRelayChannels) throw std::invalid_argument ("Relay driver called with a relay channel out of range");
+        
+        confirmedMs [c] = -1;
+        
+        if (not queueCommand (c, CHECK)) 
+        {
+            error = NOSEND;
+            return answers;
+        }
+    }
+    
+    if (not sendFrames (answerWaitMs)) 
+    {
+        error = NOSEND;
+        return answers;
+    }
+    
+    if (answerWaitMs == 0 or channels.empty ()) 
+    {
+        error = NO;
+        return answers;
     }
+    
+    //the answers are collected as they arrive until all of them are received or the deadline expires
+    const auto deadline = std::chrono::steady_clock::now () + std::chrono::milliseconds (answerWaitMs);
+    do
+    {
+        uint8_t c;
+        bool    state;
+        while (answers < channels.size () and nextFeedback (c, state))
+        {
+            if (c < 1 or c >= maxRelayChannels or answered [c]) continue;
+            
+            relayStates [c] = state;
+            confirmedMs [c] = Clock::monotonicMs ();
+            answered [c] = true;
+            ++ answers;
+        }
+    }
+    while (answers < channels.size () and waitFeedback (deadline));
+    
+    error = answers == channels.size () ? NO : NORECV;
+    return answers;
+}
 
-    if (not checkCRC ()) 
+RelayDriver::Error RelayDriver::lastError () const
+{
+    return error;
+}
+
+RelayDriver::Command RelayDriver::recvCommand ()
+{
+    const unsigned long errors = frameErrors ();
+    uint8_t channel;
+    bool    state;
+    
+    //a wrong checksum is reported only if no valid frame arrived, otherwise it was noise
+    if (not recvFeedback (channel, state)) 
     {
-        error = WRNGCRC;
+        error = frameErrors () != errors ? WRNGCRC : NORECV;
         return ERROR;
     }
    
-    if (message [1] != relayChannel)
+    if (channel != relayChannel)
     {
         error = WRNGREL;
         return ERROR;
     }    
  
-    if ((bool) message [2] != relayStates [relayChannel])
+    if (state != relayStates [relayChannel])
     {
-        relayStates [relayChannel] = (bool) message [2]; //align internal relay state with real status
+        relayStates [relayChannel] = state; //align internal relay state with real status
         error = WRNGSTA;
         return ERROR;
     }
 
     error = NO;
-    return (Command) message [2];    
+    return state ? ON : OFF;    
 }
 
 RelayDriver::Command RelayDriver::sendCommand (uint8_t channel, Command c)
 {
-    if (channel < 1 or channel > maxRelayChannels) throw std::invalid_argument ("Relay driver called with a relay channel out of range");
+    if (channel < 1 or channel >= maxRelayChannels) throw std::invalid_argument ("Relay driver called with a relay channel out of range");
     
     if (c == NONE or c == ERROR) 
     {
@@ -118,18 +202,43 @@ RelayDriver::Command RelayDriver::sendCommand (uint8_t channel, Command c)
     
     relayChannel = channel;
     
+    expectState (relayChannel, c);
+    
+    //the commands sent alone, like the retries, are verified again by the next sendCommands
+    confirmedMs [relayChannel] = -1;
+    
+    if (not queueCommand (relayChannel, c) or not sendFrames (answerWaitMs)) 
+    {
+        error = NOSEND;
+        return ERROR;
+    }
+    
+    if (c == OFF or c == ON) 
+    {
+        error = NO;
+        return NONE;
+    }
+    
+    if (answerWaitMs) return recvCommand ();
+
+    error = NORECV;
+    return ERROR;
+}
+
+void RelayDriver::expectState (uint8_t channel, Command c)
+{
     switch (c) 
     {
         case ON:
         case ON_CHECK:
-            relayStates [relayChannel] = true;
+            relayStates [channel] = true;
             break;
         case OFF:
         case OFF_CHECK:
-            relayStates [relayChannel] = false;
+            relayStates [channel] = false;
             break;
         case NEGATE_CHECK:
-            relayStates [relayChannel] = not relayStates [relayChannel]; 
+            relayStates [channel] = not relayStates [channel]; 
             break;
         case CHECK:
             //keep previous value
@@ -139,32 +248,126 @@ RelayDriver::Command RelayDriver::sendCommand (uint8_t channel, Command c)
             throw std::runtime_error ("The send command reached a wrong state");
             break;
     }
+}
+
+std::vector <RelayDriver::Result> RelayDriver::sendCommands (const std::vector <Request>& requests)
+{
+    std::vector <Result> results;
+    results.reserve (requests.size ());
+    
+    //the index of the result waiting for the feedback of every channel
+    std::vector <int> waiting (maxRelayChannels, -1);
+    std::vector <bool> used (maxRelayChannels, false);
+    std::vector <size_t> queued;
+    unsigned int feedbacks = 0;
     
-    message [0] = 0xA0;
-    message [1] = relayChannel;
-    message [2] = c;
-    addCRC ();
+    const long long now = Clock::monotonicMs ();
     
-    if (not sendMessage ()) 
+    //the requests are checked before anything is queued
+    for (const Request& request : requests)
     {
-        error = NOSEND;
-        return ERROR;
+        if (request.channel < 1 or request.channel >= maxRelayChannels) throw std::invalid_argument ("Relay driver called with a relay channel out of range");
+        if (used [request.channel]) throw std::invalid_argument ("Relay driver called twice with the same relay channel: " + std::to_string (request.channel));
+        used [request.channel] = true;
     }
     
-    if (c == OFF or c == ON) 
+    for (const Request& request : requests)
     {
-        error = NO;
-        return NONE;
+        if (request.command == NONE or request.command == ERROR)
+        {
+            results.push_back ({request.channel, ERROR, WRNGCOM});
+            continue;
+        }
+        
+        results.push_back ({request.channel, NONE, NO});
+        
+        Command command = request.command;
+        const bool feedback = command != ON and command != OFF;
+        const bool state = command == ON or command == ON_CHECK;
+        
+        //the channel already confirmed in the required state is left alone until the verify interval elapses, then it is only checked
+        if (verifyIntervalMs and confirmedMs [request.channel] >= 0 and command != CHECK and command != NEGATE_CHECK and relayStates [request.channel] == state)
+        {
+            if (now - confirmedMs [request.channel] < verifyIntervalMs)
+            {
+                if (feedback) results.back ().feedback = state ? ON : OFF;
+                ++ suppressed;
+                continue;
+            }
+            
+            if (feedback) command = CHECK;
+        }
+        
+        expectState (request.channel, command);
+        confirmedMs [request.channel] = -1;
+        
+        if (not queueCommand (request.channel, command)) 
+        {
+            results.back () = {request.channel, ERROR, NOSEND};
+            continue;
+        }
+        
+        queued.push_back (results.size () - 1);
+        
+        if (feedback) 
+        {
+            waiting [request.channel] = static_cast <int> (results.size () - 1);
+            ++ feedbacks;
+        }
+        //without feedback the state sent is taken as confirmed, it is sent again at the verify interval
+        else confirmedMs [request.channel] = now;
     }
     
-    if (answerWaitMs)
+    //all the frames are sent together, the protocol decides how many writes they need
+    if (not sendFrames (answerWaitMs)) 
     {
-        usleep (answerWaitMs); 
-        return recvCommand ();
+        for (size_t index : queued) 
+        {
+            results [index] = {results [index].channel, ERROR, NOSEND};
+            confirmedMs [results [index].channel] = -1;
+            waiting [results [index].channel] = -1;
+        }
+        feedbacks = 0;
     }
-
-    error = NORECV;
-    return ERROR;
+    
+    const unsigned long errors = frameErrors ();
+    
+    //the feedbacks are matched to the commands as they arrive until all of them are received or the deadline expires
+    const auto deadline = std::chrono::steady_clock::now () + std::chrono::milliseconds (answerWaitMs);
+    while (answerWaitMs and feedbacks)
+    {
+        uint8_t c;
+        bool    state;
+        while (feedbacks and nextFeedback (c, state))
+        {
+            if (c < 1 or c >= maxRelayChannels or waiting [c] < 0) continue;
+            
+            Result& result = results [static_cast <size_t> (waiting [c])];
+            waiting [c] = -1;
+            -- feedbacks;
+            
+            if (state != relayStates [c])
+            {
+                relayStates [c] = state; //align internal relay state with real status
+                result = {c, ERROR, WRNGSTA};
+            }
+            else 
+            {
+                result.feedback = state ? ON : OFF;
+                confirmedMs [c] = now;
+            }
+        }
+        
+        if (feedbacks == 0 or not waitFeedback (deadline)) break;
+    }
+    
+    //a wrong checksum is reported only if the feedback did not arrive
+    for (int index : waiting) if (index >= 0 and results [static_cast <size_t> (index)].error == NO) results [static_cast <size_t> (index)] = {results [static_cast <size_t> (index)].channel, ERROR, frameErrors () != errors ? WRNGCRC : NORECV};
+    
+    error = NO;
+    for (const Result& result : results) if (result.error != NO) error = result.error;
+    
+    return results;
 }
 
 std::string RelayDriver::errorToString (RelayDriver::Error e)
@@ -0,0 +1,274 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "RelayEmulator.hpp"
+#include "Clock.hpp"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <stdexcept>
+
+RelayEmulator::RelayEmulator (uint8_t chs) :
+    channels        {chs},
+    masterDesc      {posix_openpt (O_RDWR | O_NOCTTY | O_CLOEXEC)},
+    slaveDesc       {-1},
+    stopPipe        {-1, -1},
+    path            {},
+    states          {},
+    stuck           {},
+    latencyMs       {0},
+    dropEvery       {0},
+    corruptEvery    {0},
+    splitReplies    {false},
+    replies         {0},
+    received        {0},
+    actions         {},
+    mutex           {},
+    busy            {false},
+    worker          {}
+{
+    if (masterDesc < 0 or grantpt (masterDesc) != 0 or unlockpt (masterDesc) != 0 or ptsname (masterDesc) == nullptr or pipe2 (stopPipe, O_CLOEXEC) != 0)
+    {
+        const std::string err {strerror (errno)};
+        closeDescriptors ();
+        throw std::invalid_argument ("It was not possible to create the relay emulator, error: " + err);
+    }
+    
+    path = ptsname (masterDesc);
+    
+    //the slave side is kept open otherwise the master would read an error every time the serial port is closed
+    slaveDesc = open (path.c_str (), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    
+    struct termios tty;
+    if (slaveDesc < 0 or tcgetattr (masterDesc, & tty) != 0) 
+    {
+        const std::string err {strerror (errno)};
+        closeDescriptors ();
+        throw std::invalid_argument ("It was not possible to open the relay emulator terminal, error: " + err);
+    }
+    cfmakeraw (& tty);
+    tcsetattr (masterDesc, TCSANOW, & tty);
+    
+    states.fill (false);
+    stuck.fill (false);
+    
+    worker = std::thread (& RelayEmulator::serve, this);
+}
+
+RelayEmulator::~RelayEmulator ()
+{
+    const char stop = 0;
+    if (write (stopPipe [1], & stop, 1) == 1) worker.join ();
+    else worker.detach ();
+    
+    closeDescriptors ();
+}
+
+void RelayEmulator::closeDescriptors ()
+{
+    for (int fd : {masterDesc, slaveDesc, stopPipe [0], stopPipe [1]}) if (fd >= 0) close (fd);
+}
+
+const std::string& RelayEmulator::getPath () const
+{
+    return path;
+}
+
+bool RelayEmulator::getState (uint8_t channel) const
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    return states [channel];
+}
+
+void RelayEmulator::waitIdle () const
+{
+    //the bytes written on the terminal may need a while to reach the master side, therefore idle must be seen twice
+    unsigned int idleChecks = 0;
+    while (idleChecks < 2)
+    {
+        usleep (100);
+        
+        int pending = 0;
+        if (ioctl (masterDesc, FIONREAD, & pending) != 0) return;
+        
+        if (pending == 0 and not busy) ++ idleChecks;
+        else idleChecks = 0;
+    }
+}
+
+std::vector <RelayEmulator::Action> RelayEmulator::takeActions ()
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    std::vector <Action> taken;
+    taken.swap (actions);
+    return taken;
+}
+
+void RelayEmulator::setLatency (unsigned int ms)
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    latencyMs = ms;
+}
+
+void RelayEmulator::setDropEvery (unsigned int r)
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    dropEvery = r;
+}
+
+void RelayEmulator::setCorruptEvery (unsigned int r)
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    corruptEvery = r;
+}
+
+void RelayEmulator::setSplitReplies (bool split)
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    splitReplies = split;
+}
+
+void RelayEmulator::setStuck (uint8_t channel, bool s)
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    stuck [channel] = s;
+}
+
+unsigned long RelayEmulator::receivedFrames () const
+{
+    std::lock_guard <std::mutex> lock (mutex);
+    return received;
+}
+
+void RelayEmulator::processFrame (const std::array <uint8_t, messageLength>& frame)
+{
+    const uint8_t channel = frame [1];
+    const uint8_t command = frame [2];
+    
+    if (static_cast <uint8_t> (frame [0] + frame [1] + frame [2]) != frame [3] or command > 0x05) return;
+    
+    uint8_t         answer [messageLength];
+    unsigned int    latency;
+    bool            split;
+    
+    {
+        std::lock_guard <std::mutex> lock (mutex);
+        
+        ++ received;
+        
+        //a real board ignores the channels it does not have
+        if (channel < 1 or channel > channels) return;
+        
+        const bool previous = states [channel];
+        
+        if (not stuck [channel])
+        {
+            switch (command)
+            {
+                case 0x00:
+                case 0x02:
+                    states [channel] = false;
+                    break;
+                case 0x01:
+                case 0x03:
+                    states [channel] = true;
+                    break;
+                case 0x04:
+                    states [channel] = not states [channel];
+                    break;
+            }
+        }
+        
+        if (states [channel] != previous) actions.push_back ({Clock::wallMs (), channel, states [channel]});
+        
+        //the commands with check return the relay state after their execution
+        if (command < 0x02) return;
+        
+        ++ replies;
+        if (dropEvery and replies % dropEvery == 0) return;
+        
+        const uint8_t state = states [channel];
+        answer [0] = 0xA0;
+        answer [1] = channel;
+        answer [2] = state;
+        answer [3] = static_cast <uint8_t> (0xA0 + channel + state);
+        if (corruptEvery and replies % corruptEvery == 0) answer [3] = static_cast <uint8_t> (~ answer [3]);
+        
+        latency = latencyMs;
+        split = splitReplies;
+    }
+    
+    //the reply is written without the lock, the settings may be changed meanwhile
+    if (latency) usleep (static_cast <useconds_t> (latency) * 1000);
+    
+    if (split)
+    {
+        if (write (masterDesc, answer, messageLength / 2) != messageLength / 2) return;
+        usleep (splitPauseUs);
+        if (write (masterDesc, answer + messageLength / 2, messageLength / 2) != messageLength / 2) return;
+    }
+    else if (write (masterDesc, answer, messageLength) != messageLength) return;
+}
+
+void RelayEmulator::serve ()
+{
+    std::array <uint8_t, messageLength> frame;
+    unsigned int received = 0;
+    
+    struct pollfd fds [2] = {{masterDesc, POLLIN, 0}, {stopPipe [0], POLLIN, 0}};
+    
+    while (true)
+    {
+        if (poll (fds, 2, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+        
+        if (fds [1].revents) return;
+        if (not (fds [0].revents & POLLIN)) continue;
+        
+        busy = true;
+        
+        uint8_t buffer [256];
+        const ssize_t len = read (masterDesc, buffer, sizeof (buffer));
+        
+        for (ssize_t i = 0; i < len; ++ i)
+        {
+            //the frames are realigned on their header in case any byte was lost
+            if (received == 0 and buffer [i] != 0xA0) continue;
+            
+            frame [received ++] = buffer [i];
+            if (received < messageLength) continue;
+            received = 0;
+            
+            processFrame (frame);
+        }
+        
+        busy = false;
+    }
+}
@@ -0,0 +1,304 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "RollupStore.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <stdexcept>
+
+static const char rollupMagic [8] = {'B', 'A', 'T', 'G', 'R', 'O', 'L', 'L'};
+static const uint32_t rollupVersion = 1;
+static const long long levelMs [RollupStore::LEVELS] = {60000LL, 3600000LL, 86400000LL};
+static const long long maxGapMs = 3600000LL;
+
+constexpr uint32_t RollupStore::levelSlots [];
+
+RollupStore::RollupStore (const std::string& p, bool ro) :
+    path        {p},
+    readOnly    {ro},
+    fileDesc    {open (path.c_str (), (readOnly ? O_RDONLY : O_RDWR | O_CREAT) | O_CLOEXEC, 0644)},
+    fileBytes   {headerBytes},
+    header      {nullptr},
+    levels      {}
+{
+    if (fileDesc < 0) throw std::invalid_argument ("It was not possible to open the rollup file " + path + ", error: " + std::string (strerror (errno)));
+    
+    for (size_t l = 0; l < LEVELS; ++ l) fileBytes += levelSlots [l] * sizeof (Bucket);
+    
+    struct stat st;
+    const bool empty = fstat (fileDesc, & st) == 0 and st.st_size == 0;
+    
+    //the whole file is allocated at once since its size is bounded
+    if ((empty and readOnly) or (empty and ftruncate (fileDesc, static_cast <off_t> (fileBytes)) != 0) or (not empty and static_cast <size_t> (st.st_size) != fileBytes))
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("The file " + path + " is not a batguard rollup file");
+    }
+    
+    void* map = mmap (nullptr, fileBytes, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fileDesc, 0);
+    if (map == MAP_FAILED)
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("It was not possible to map the rollup file " + path + ", error: " + std::string (strerror (errno)));
+    }
+    
+    header = static_cast <Header*> (map);
+    
+    if (empty)
+    {
+        header->version     = rollupVersion;
+        header->bucketSize  = sizeof (Bucket);
+        for (size_t l = 0; l < LEVELS; ++ l) header->slots [l] = levelSlots [l];
+        memcpy (header->magic, rollupMagic, sizeof (rollupMagic));
+    }
+    
+    if (memcmp (header->magic, rollupMagic, sizeof (rollupMagic)) != 0 or header->version != rollupVersion or header->bucketSize != sizeof (Bucket) or not std::equal (header->slots, header->slots + LEVELS, levelSlots))
+    {
+        munmap (header, fileBytes);
+        close (fileDesc);
+        throw std::invalid_argument ("The file " + path + " is not a batguard rollup file or it has a different format version");
+    }
+    
+    char* next = static_cast <char*> (map) + headerBytes;
+    for (size_t l = 0; l < LEVELS; ++ l) 
+    {
+        levels [l] = reinterpret_cast <Bucket*> (next);
+        next += levelSlots [l] * sizeof (Bucket);
+    }
+}
+
+RollupStore::~RollupStore ()
+{
+    munmap (header, fileBytes);
+    close (fileDesc);
+}
+
+long long RollupStore::bucketStart (Level level, long long ms)
+{
+    if (level == MINUTE) return ms - (ms % levelMs [MINUTE] + levelMs [MINUTE]) % levelMs [MINUTE];
+    
+    const time_t seconds = static_cast <time_t> (ms / 1000);
+    struct tm date;
+    localtime_r (& seconds, & date);
+    
+    //the local hours, some time zones are not a whole number of hours from UTC
+    if (level == HOUR)
+    {
+        const long long local = ms + date.tm_gmtoff * 1000LL;
+        return ms - (local % levelMs [HOUR] + levelMs [HOUR]) % levelMs [HOUR];
+    }
+    
+    //the local midnight, the daylight saving time is decided by mktime
+    date.tm_hour = 0;
+    date.tm_min = 0;
+    date.tm_sec = 0;
+    date.tm_isdst = -1;
+    return static_cast <long long> (mktime (& date)) * 1000LL;
+}
+
+long long RollupStore::nextBucket (Level level, long long startMs)
+{
+    if (level != DAY) return startMs + levelMs [level];
+    
+    //the days may last 23 or 25 hours when the daylight saving time changes
+    return bucketStart (DAY, startMs + levelMs [DAY] + 3 * levelMs [HOUR]);
+}
+
+uint64_t RollupStore::bucketNumber (Level level, long long startMs)
+{
+    //the buckets shorter than a day are consecutive by their duration
+    if (level != DAY) return static_cast <uint64_t> (startMs / levelMs [level]);
+    
+    //the local date read as UTC gives a number increasing by one every day
+    const time_t seconds = static_cast <time_t> (startMs / 1000);
+    struct tm date;
+    localtime_r (& seconds, & date);
+    date.tm_hour = 12;
+    return static_cast <uint64_t> (timegm (& date) / 86400);
+}
+
+RollupStore::Bucket& RollupStore::bucketFor (Level level, long long ms)
+{
+    const long long start = bucketStart (level, ms);
+    Bucket& bucket = levels [level] [bucketNumber (level, start) % levelSlots [level]];
+    
+    //the slot keeps an old bucket which is overwritten
+    if (bucket.startMs != start)
+    {
+        memset (& bucket, 0, sizeof (Bucket));
+        bucket.startMs = start;
+    }
+    
+    return bucket;
+}
+
+const RollupStore::Bucket* RollupStore::findBucket (Level level, long long startMs) const
+{
+    const Bucket& bucket = levels [level] [bucketNumber (level, startMs) % levelSlots [level]];
+    return bucket.startMs == startMs ? & bucket : nullptr;
+}
+
+void RollupStore::add (long long wallMs, double capacity, double energyWh, bool charger, size_t profile, bool valid)
+{
+    if (readOnly) throw std::runtime_error ("The rollup file " + path + " is open read only");
+    
+    const bool  follows = header->lastMs > 0 and wallMs > header->lastMs;
+    const float seconds = follows ? static_cast <float> (std::min (wallMs - header->lastMs, maxGapMs)) / 1000.0f : 0.0f;
+    const float delta   = (follows and valid and header->lastValid) ? static_cast <float> (capacity) - header->lastCapacity : 0.0f;
+    const float energy  = (follows and valid and header->lastValid and energyWh >= 0.0 and header->lastEnergyWh >= 0.0f) ? static_cast <float> (energyWh) - header->lastEnergyWh : 0.0f;
+    
+    for (size_t l = 0; l < LEVELS; ++ l)
+    {
+        Bucket& bucket = bucketFor (static_cast <Level> (l), wallMs);
+        
+        //the interval since the previous sample had its charger state and profile
+        bucket.coveredSeconds += seconds;
+        if (header->lastCharger) bucket.chargingSeconds += seconds;
+        if (header->lastProfile < maxProfiles) bucket.profileSeconds [header->lastProfile] += seconds;
+        
+        if (delta > 0.0f)   bucket.chargedPercent += delta;
+        else                bucket.dischargedPercent -= delta;
+        
+        if (energy > 0.0f)  bucket.energyInWh += energy;
+        else                bucket.energyOutWh -= energy;
+        
+        if (not valid) continue;
+        
+        const float cap = static_cast <float> (capacity);
+        bucket.minCapacity = bucket.samples ? std::min (bucket.minCapacity, cap) : cap;
+        bucket.maxCapacity = bucket.samples ? std::max (bucket.maxCapacity, cap) : cap;
+        bucket.sumCapacity += capacity;
+        ++ bucket.samples;
+    }
+    
+    header->lastMs          = wallMs;
+    header->lastCharger     = charger;
+    header->lastProfile     = static_cast <uint8_t> (std::min (profile, static_cast <size_t> (UINT8_MAX)));
+    header->lastValid       = valid;
+    
+    if (valid)
+    {
+        header->lastCapacity = static_cast <float> (capacity);
+        header->lastEnergyWh = static_cast <float> (energyWh);
+    }
+}
+
+void RollupStore::merge (Bucket& into, const Bucket& from)
+{
+    into.minCapacity = into.samples ? (from.samples ? std::min (into.minCapacity, from.minCapacity) : into.minCapacity) : from.minCapacity;
+    into.maxCapacity = into.samples ? (from.samples ? std::max (into.maxCapacity, from.maxCapacity) : into.maxCapacity) : from.maxCapacity;
+    into.sumCapacity        += from.sumCapacity;
+    into.samples            += from.samples;
+    into.coveredSeconds     += from.coveredSeconds;
+    into.chargingSeconds    += from.chargingSeconds;
+    for (size_t p = 0; p < maxProfiles; ++ p) into.profileSeconds [p] += from.profileSeconds [p];
+    into.chargedPercent     += from.chargedPercent;
+    into.dischargedPercent  += from.dischargedPercent;
+    into.energyInWh         += from.energyInWh;
+    into.energyOutWh        += from.energyOutWh;
+}
+
+RollupStore::Level RollupStore::selectLevel (long long fromMs, long long toMs, long long stepMs)
+{
+    if (stepMs <= 0 or stepMs % levelMs [MINUTE] != 0) throw std::invalid_argument ("The history step shall be a multiple of a minute");
+    if (fromMs >= toMs) throw std::invalid_argument ("The history interval is empty");
+    
+    //the intervals of whole days follow the calendar, therefore they fit the days also when the daylight saving time changes
+    if (stepMs % levelMs [DAY] == 0 and bucketStart (DAY, fromMs) == fromMs) return DAY;
+    if (stepMs % levelMs [HOUR] == 0 and bucketStart (HOUR, fromMs) == fromMs) return HOUR;
+    return MINUTE;
+}
+
+std::vector <RollupStore::Bucket> RollupStore::query (long long from, long long toMs, long long stepMs) const
+{
+    //the intervals begin at a minute at least
+    const long long fromMs = bucketStart (MINUTE, from);
+    const Level level = selectLevel (fromMs, toMs, stepMs);
+    
+    //the buckets older than the level keeps are not looked for
+    const long long oldest = bucketStart (level, header->lastMs - static_cast <long long> (levelSlots [level] - 1) * levelMs [level]);
+    
+    std::vector <Bucket> result;
+    
+    for (long long intervalStart = fromMs, intervalEnd; intervalStart < toMs; intervalStart = intervalEnd)
+    {
+        Bucket interval {};
+        interval.startMs = intervalStart;
+        
+        //the intervals of days are counted in calendar days
+        if (level == DAY)
+        {
+            intervalEnd = intervalStart;
+            for (long long d = 0; d < stepMs / levelMs [DAY]; ++ d) intervalEnd = nextBucket (DAY, intervalEnd);
+        }
+        else intervalEnd = intervalStart + stepMs;
+        
+        for (long long start = std::max (intervalStart, oldest); start < intervalEnd and start < toMs; start = nextBucket (level, start))
+        {
+            const Bucket* bucket = findBucket (level, start);
+            if (bucket != nullptr) merge (interval, * bucket);
+        }
+        
+        if (interval.samples or interval.coveredSeconds > 0.0f) result.push_back (interval);
+    }
+    
+    return result;
+}
+
+long long RollupStore::parseStep (const std::string& text)
+{
+    size_t end = 0;
+    long long value = 0;
+    
+    try
+    {
+        value = std::stoll (text, & end);
+    }
+    catch (const std::exception&)
+    {
+        throw std::invalid_argument ("Wrong history step: " + text);
+    }
+    
+    const std::string unit = text.substr (end);
+    
+    long long unitMs;
+    if      (unit.empty ())     unitMs = 1000LL;
+    else if (unit == "m")       unitMs = levelMs [MINUTE];
+    else if (unit == "h")       unitMs = levelMs [HOUR];
+    else if (unit == "d")       unitMs = levelMs [DAY];
+    else throw std::invalid_argument ("Wrong history step: " + text);
+    
+    if (value <= 0) throw std::invalid_argument ("Wrong history step: " + text);
+    
+    return value * unitMs;
+}
+
+const std::string& RollupStore::getPath () const
+{
+    return path;
+}
@@ -0,0 +1,124 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+ 
+#include "SampleHistory.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+SampleHistory::SampleHistory (size_t size) :
+    length      {size},
+    words       {},
+    sequence    {0},
+    head        {0},
+    count       {0}
+{
+    if (length == 0) throw std::invalid_argument ("The sample history requires at least one record");
+    
+    words.reset (new std::atomic <uint64_t> [length * wordsPerRecord]);
+    for (size_t w = 0; w < length * wordsPerRecord; ++ w) words [w].store (0, std::memory_order_relaxed);
+}
+
+void SampleHistory::storeRecord (size_t index, const Record& record)
+{
+    uint64_t raw [wordsPerRecord];
+    memcpy (raw, & record, sizeof (Record));
+    
+    for (size_t w = 0; w < wordsPerRecord; ++ w) words [index * wordsPerRecord + w].store (raw [w], std::memory_order_relaxed);
+}
+
+void SampleHistory::loadRecord (size_t index, Record& record) const
+{
+    uint64_t raw [wordsPerRecord];
+    
+    for (size_t w = 0; w < wordsPerRecord; ++ w) raw [w] = words [index * wordsPerRecord + w].load (std::memory_order_relaxed);
+    
+    memcpy (& record, raw, sizeof (Record));
+}
+
+void SampleHistory::push (const Record& record)
+{
+    //an odd sequence tells the readers a write is in progress
+    const uint64_t seq = sequence.load (std::memory_order_relaxed);
+    sequence.store (seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+    
+    const size_t h = head.load (std::memory_order_relaxed);
+    storeRecord (h, record);
+    head.store ((h + 1) % length, std::memory_order_relaxed);
+    if (count.load (std::memory_order_relaxed) < length) count.store (count.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    
+    sequence.store (seq + 2, std::memory_order_release);
+}
+
+size_t SampleHistory::capacity () const
+{
+    return length;
+}
+
+size_t SampleHistory::size () const
+{
+    return count.load (std::memory_order_acquire);
+}
+
+size_t SampleHistory::snapshot (Record* out, size_t max) const
+{
+    while (true)
+    {
+        const uint64_t before = sequence.load (std::memory_order_acquire);
+        if (before & 1) continue;
+        
+        const size_t h = head.load (std::memory_order_relaxed);
+        const size_t n = std::min (count.load (std::memory_order_relaxed), max);
+        
+        for (size_t i = 0; i < n; ++ i) loadRecord ((h + length - n + i) % length, out [i]);
+        
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (sequence.load (std::memory_order_relaxed) == before) return n;
+    }
+}
+
+std::vector <SampleHistory::Record> SampleHistory::snapshot () const
+{
+    //the records are copied in a buffer as large as the ring, therefore they all fit also if the writer adds more meanwhile
+    std::vector <Record> records (length);
+    records.resize (snapshot (records.data (), length));
+    return records;
+}
+
+bool SampleHistory::last (Record& record) const
+{
+    return snapshot (& record, 1) == 1;
+}
+
+SampleHistory::Record SampleHistory::toRecord (long long wallMs, const BatterySample& sample)
+{
+    Record record {};
+    record.wallMs    = wallMs;
+    record.capacity  = sample.capacity;
+    record.rate      = sample.rate;
+    record.status    = static_cast <int8_t> (sample.status);
+    record.acOnline  = static_cast <int8_t> (sample.acOnline);
+    record.valid     = sample.valid;
+    record.rateValid = sample.rateValid;
+    return record;
+}
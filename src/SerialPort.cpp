@@ -27,103 +27,386 @@
 #include <errno.h>  
 #include <termios.h>   
 #include <unistd.h> 
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <time.h>
 #include <stdexcept>
-#include <iostream>
+#include <algorithm>
+
+//Fill the given vector with the one or two segments of the ring from the given position for the given length, returns their number
+static int ringSegments (uint8_t* data, unsigned int size, unsigned int position, unsigned int length, struct iovec* segments)
+{
+    const unsigned int begin = position & (size - 1);
+    const unsigned int first = std::min (length, size - begin);
+    
+    segments [0] = {data + begin, first};
+    segments [1] = {data, length - first};
+    
+    return length > first ? 2 : 1;
+}
 
 bool SerialPort::writeByte (uint8_t c)
 {
-    if (writeEnd >= bufferSize) return false;
-    writeBuffer [writeEnd] = c;
-    ++ writeEnd;
+    if (writeBuffer.room () == 0)
+    {
+        ++ writeOverflowCount;
+        return false;
+    }
+    
+    writeBuffer.at (writeBuffer.tail ++) = c;
     return true;
 }
     
+//The errors of a device hung up or removed, the other ones may be transient
+static bool isLinkLost (int err)
+{
+    return err == EIO or err == ENODEV or err == ENXIO or err == EPIPE;
+}
+
+//the deadlines are on the real monotonic clock, they must not follow the virtual clock of the simulation
+static long long monotonicMs ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return static_cast <long long> (ts.tv_sec) * 1000LL + ts.tv_nsec / 1000000L;
+}
+
+bool SerialPort::waitReady (short events, long long deadlineMs) const
+{
+    struct pollfd pfd {serialDesc, events, 0};
+    
+    while (true)
+    {
+        const long long left = deadlineMs - monotonicMs ();
+        const int ready = poll (& pfd, 1, left > 0 ? static_cast <int> (left) : 0);
+        
+        if (ready > 0) return true;
+        if (ready == 0 or errno != EINTR) return false;
+    }
+}
+
 unsigned int SerialPort::writeFlush ()
 {
-    unsigned int writtenbytes = (unsigned int) write (serialDesc, writeBuffer.data () + writeBeg, writeEnd - writeBeg);
-    writeBeg += writtenbytes;
-    if (writeBeg == writeEnd) writeBeg = writeEnd = 0;
+    if (writeBuffer.size () == 0) return 0;
+    
+    //the bytes for a missing device are dropped, they must not reach it once it comes back
+    if (serialDesc < 0)
+    {
+        writeBuffer.head = writeBuffer.tail;
+        return 0;
+    }
+    
+    //the bytes wrapped around the end of the buffer are sent by the same call
+    struct iovec segments [2];
+    const int count = ringSegments (writeBuffer.data.data (), bufferSize, writeBuffer.head, writeBuffer.size (), segments);
+    
+    ssize_t written = writev (serialDesc, segments, count);
+    
+    if (written < 0 and errno == EAGAIN and waitReady (POLLOUT, monotonicMs () + flushTimeoutMs)) written = writev (serialDesc, segments, count);
+    
+    if (written < 0 and isLinkLost (errno))
+    {
+        markDown ();
+        return 0;
+    }
+    
+    const unsigned int writtenbytes = written > 0 ? static_cast <unsigned int> (written) : 0;
+    writeBuffer.head += writtenbytes;
     return writtenbytes;
 }
 
 unsigned int SerialPort::bytesToWrite () const
 {
-    return writeEnd - writeBeg;
+    return writeBuffer.size ();
 }
                 
 unsigned int SerialPort::bytesToRead () const
 {
-    return readEnd - readBeg;
+    return readBuffer.size ();
 } 
 
 uint8_t SerialPort::readByte ()
 {
-    if (readBeg == readEnd) throw std::runtime_error ("Internal lastError in SerialPort::readByte called with empty buffer");
-    unsigned int bytetoread = readBeg;
-    ++ readBeg ;
-    if (readBeg == readEnd) readBeg = readEnd = 0;
-    return readBuffer [bytetoread];
+    if (readBuffer.size () == 0) throw std::runtime_error ("Internal lastError in SerialPort::readByte called with empty buffer");
+    return readBuffer.at (readBuffer.head ++);
+}
+
+uint8_t SerialPort::peekByte (unsigned int offset) const
+{
+    if (offset >= readBuffer.size ()) throw std::runtime_error ("Internal lastError in SerialPort::peekByte called beyond the bytes to read");
+    return readBuffer.data [(readBuffer.head + offset) & (bufferSize - 1)];
+}
+
+void SerialPort::consume (unsigned int bytes)
+{
+    if (bytes > readBuffer.size ()) throw std::runtime_error ("Internal lastError in SerialPort::consume called with more bytes than available");
+    readBuffer.head += bytes;
+}
+
+unsigned long SerialPort::writeOverflows () const
+{
+    return writeOverflowCount;
+}
+
+unsigned long SerialPort::readOverflows () const
+{
+    return readOverflowCount;
 }
 
 unsigned int SerialPort::readFlush ()
 {
-    readEnd += (unsigned int) read (serialDesc, readBuffer.data () + readEnd, bufferSize - readEnd);
-    return readEnd - readBeg;
+    return readFlushUntil (bytesToRead () + 1, flushTimeoutMs);
+}
+
+unsigned int SerialPort::readFlushUntil (unsigned int minBytes, unsigned int timeoutMs)
+{
+    if (serialDesc < 0) return readBuffer.size ();
+    
+    const long long deadline = monotonicMs () + timeoutMs;
+    
+    //the bytes already arrived are always read, then it waits only if they are not enough
+    bool waited = false;
+    while (true)
+    {
+        //the bytes not read yet are kept, the new ones are left to the serial driver until some room is made
+        if (readBuffer.room () == 0)
+        {
+            ++ readOverflowCount;
+            break;
+        }
+        
+        struct iovec segments [2];
+        const int count = ringSegments (readBuffer.data.data (), bufferSize, readBuffer.tail, readBuffer.room (), segments);
+        
+        const ssize_t got = readv (serialDesc, segments, count);
+        if (got > 0) readBuffer.tail += static_cast <unsigned int> (got);
+        
+        //a port ready without data is hung up
+        if ((got < 0 and isLinkLost (errno)) or (got == 0 and waited))
+        {
+            markDown ();
+            break;
+        }
+        
+        if (bytesToRead () >= minBytes or (got < 0 and errno != EAGAIN and errno != EINTR)) break;
+        
+        waited = waitReady (POLLIN, deadline);
+        if (not waited) break;
+    }
+    
+    return readBuffer.size ();
 }
         
 SerialPort::~SerialPort ()
 {
-    close (serialDesc);
+    if (serialDesc >= 0) close (serialDesc);
+}
+
+//Watch the directory of the given path, or its nearest existing ancestor if it is missing too
+static void watchNearestDirectory (int inotifyDesc, const std::string& path)
+{
+    std::string dir = path;
+    
+    while (true)
+    {
+        const size_t sep = dir.find_last_of ('/');
+        dir = (sep == std::string::npos ? "." : (sep == 0 ? "/" : dir.substr (0, sep)));
+        
+        if (inotify_add_watch (inotifyDesc, dir.c_str (), IN_CREATE | IN_ATTRIB | IN_MOVED_TO) >= 0 or dir == "/" or dir == ".") return;
+    }
+}
+
+static bool isMissingDevice (int err)
+{
+    return err == ENOENT or err == ENODEV or err == ENXIO;
 }
 
 int SerialPort::tryToOpen (const std::string& path, const uint8_t maxConnAttemp)
 {    
-    int sd = open (path.c_str (), O_RDWR);
+    int sd = open (path.c_str (), O_RDWR | O_NONBLOCK | O_NOCTTY);
+    if (sd >= 0) return sd;
     
-    uint8_t conTrial = 1;
-    while (sd < 0 and conTrial < maxConnAttemp)
+    //the device may show up later, for instance when the USB relay is enumerated after batguard started
+    //its directory is watched up to the deadline, the new entries and the permission changes are tried at once
+    const long long deadline = monotonicMs () + (maxConnAttemp > 1 ? maxConnAttemp - 1 : 0) * trialWaitMs;
+    const int inotifyDesc = deadline > monotonicMs () ? inotify_init1 (IN_NONBLOCK | IN_CLOEXEC) : -1;
+    int err = errno;
+    
+    while (sd < 0 and inotifyDesc >= 0)
     {
-        std::cout << "Unable to link to " << path << '\n';
-        std::cout << "Connection trial " << static_cast<int> (conTrial) << " of " << static_cast<int> (maxConnAttemp) << '\n'; 
-        sleep (2);
+        watchNearestDirectory (inotifyDesc, path);
+        
+        //the device may have appeared before the watch was set
+        sd = open (path.c_str (), O_RDWR | O_NONBLOCK | O_NOCTTY);
+        err = errno;
+        if (sd >= 0) break;
         
-        sd = open (path.c_str (), O_RDWR);
+        const long long left = deadline - monotonicMs ();
+        if (left <= 0) break;
         
-        ++ conTrial;
+        struct pollfd pfd {inotifyDesc, POLLIN, 0};
+        const int ready = poll (& pfd, 1, static_cast <int> (left));
+        if (ready < 0 and errno == EINTR) continue;
+        if (ready <= 0) break;
+        
+        alignas (struct inotify_event) char events [4096];
+        while (read (inotifyDesc, events, sizeof (events)) > 0) {}
     }
     
-    if (sd < 0) throw std::invalid_argument ("It was not possible to open for read and write the device: " + path + ", lastError: " + std::string (strerror (errno)));
+    if (inotifyDesc >= 0) close (inotifyDesc);
+    
+    if (sd >= 0 or isMissingDevice (err)) return sd;
     
-    return sd;    
+    throw std::invalid_argument ("It was not possible to open for read and write the device: " + path + ", lastError: " + std::string (strerror (err)));
 }
 
 SerialPort::SerialPort (const std::string& path, const unsigned int baudrate, const uint8_t maxConnAttemp, const uint8_t bits, const bool parity, const bool singlestop, const bool flowctl) :
+    serialPath  {path},
+    baudRate    {baudrate},
+    dataBits    {bits},
+    parityBit   {parity},
+    singleStop  {singlestop},
+    flowControl {flowctl},
     serialDesc  {tryToOpen (path.c_str (), maxConnAttemp)},
     readBuffer  {},
     writeBuffer {},
-    readBeg     {0},
-    readEnd     {0},
-    writeBeg    {0},
-    writeEnd    {0}
+    writeOverflowCount  {0},
+    readOverflowCount   {0},
+    disconnectCount     {0},
+    downSinceMs         {-1},
+    lastRecovery        {-1},
+    totalDown           {0}
+{
+    if (serialDesc < 0) return;
+    
+    try
+    {
+        configure (serialDesc, path, baudrate);
+    }
+    catch (...)
+    {
+        close (serialDesc);
+        throw;
+    }
+}
+
+void SerialPort::reopen (const std::string& path, const unsigned int baudrate, const uint8_t maxConnAttemp)
+{
+    const int sd = tryToOpen (path, maxConnAttemp);
+    if (sd < 0) throw std::invalid_argument ("The device did not show up: " + path);
+    
+    try
+    {
+        configure (sd, path, baudrate);
+    }
+    catch (...)
+    {
+        close (sd);
+        throw;
+    }
+    
+    if (serialDesc >= 0) close (serialDesc);
+    
+    serialDesc = sd;
+    serialPath = path;
+    baudRate = baudrate;
+    readBuffer.head = readBuffer.tail = writeBuffer.head = writeBuffer.tail = 0;
+    
+    //the device lost is back
+    if (downSinceMs >= 0)
+    {
+        lastRecovery = monotonicMs () - downSinceMs;
+        totalDown += lastRecovery;
+        downSinceMs = -1;
+    }
+}
+
+const std::string& SerialPort::getPath () const
+{
+    return serialPath;
+}
+
+bool SerialPort::isOpen () const
+{
+    return serialDesc >= 0;
+}
+
+bool SerialPort::reconnect ()
+{
+    try
+    {
+        reopen (serialPath, baudRate, 1);
+    }
+    catch (const std::invalid_argument&)
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+bool SerialPort::checkLink ()
+{
+    if (serialDesc < 0) return false;
+    
+    struct pollfd pfd {serialDesc, 0, 0};
+    if (poll (& pfd, 1, 0) > 0 and (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))) markDown ();
+    
+    return isOpen ();
+}
+
+void SerialPort::markDown ()
+{
+    //the bytes already received are still valid, the ones to send are not sent to the device coming back
+    close (serialDesc);
+    serialDesc = -1;
+    writeBuffer.head = writeBuffer.tail;
+    
+    ++ disconnectCount;
+    downSinceMs = monotonicMs ();
+}
+
+unsigned long SerialPort::disconnections () const
+{
+    return disconnectCount;
+}
+
+long long SerialPort::lastRecoveryMs () const
+{
+    return lastRecovery;
+}
+
+long long SerialPort::totalDownMs () const
+{
+    return totalDown + (downSinceMs >= 0 ? monotonicMs () - downSinceMs : 0);
+}
+
+unsigned int SerialPort::getBaudRate () const
+{
+    return baudRate;
+}
+
+void SerialPort::configure (int sd, const std::string& path, const unsigned int baudrate)
 {
     struct termios serialconfig;
-    if(tcgetattr (serialDesc, &serialconfig)) throw std::invalid_argument ("It was not possible to retrieve the configuration of: " + path + " lastError: " + std::string (strerror (errno)));
+    if(tcgetattr (sd, &serialconfig)) throw std::invalid_argument ("It was not possible to retrieve the configuration of: " + path + " lastError: " + std::string (strerror (errno)));
     
-    if (parity) serialconfig.c_cflag |=  PARENB;
-    else        serialconfig.c_cflag &= ~PARENB;
+    if (parityBit)  serialconfig.c_cflag |=  PARENB;
+    else            serialconfig.c_cflag &= ~PARENB;
     
-    if (singlestop) serialconfig.c_cflag &= ~CSTOPB;
+    if (singleStop) serialconfig.c_cflag &= ~CSTOPB;
     else            serialconfig.c_cflag |=  CSTOPB;
     
     serialconfig.c_cflag &= ~CSIZE;
-    if      (bits == 5) serialconfig.c_cflag |= CS5;
-    else if (bits == 6) serialconfig.c_cflag |= CS6;
-    else if (bits == 7) serialconfig.c_cflag |= CS7;
-    else if (bits == 8) serialconfig.c_cflag |= CS8;
-    else throw std::invalid_argument ("The given number of bits is not supported: " + std::to_string (bits));
+    if      (dataBits == 5) serialconfig.c_cflag |= CS5;
+    else if (dataBits == 6) serialconfig.c_cflag |= CS6;
+    else if (dataBits == 7) serialconfig.c_cflag |= CS7;
+    else if (dataBits == 8) serialconfig.c_cflag |= CS8;
+    else throw std::invalid_argument ("The given number of bits is not supported: " + std::to_string (dataBits));
     
-    if (flowctl) serialconfig.c_cflag |=  CRTSCTS;
-    else         serialconfig.c_cflag &= ~CRTSCTS;
+    if (flowControl) serialconfig.c_cflag |=  CRTSCTS;
+    else             serialconfig.c_cflag &= ~CRTSCTS;
     
     //Disables modem signal like carrier detect
     serialconfig.c_cflag |= CLOCAL;
@@ -158,8 +441,8 @@ SerialPort::SerialPort (const std::string& path, const unsigned int baudrate, co
     //Disable conversion of newline to carriage return/line feed
     serialconfig.c_oflag &= ~ONLCR; 
 
-    //read call waits up to 1s 
-    serialconfig.c_cc[VTIME] = 10;  
+    //read call never waits, the port is non-blocking and the waits are done by poll with a deadline
+    serialconfig.c_cc[VTIME] = 0;  
     
     //read call does not wait for any number of chars received
     serialconfig.c_cc[VMIN] = 0;
@@ -187,5 +470,5 @@ SerialPort::SerialPort (const std::string& path, const unsigned int baudrate, co
     else throw std::invalid_argument ("The given baud rate is not supported: " + baudrate);
     cfsetspeed(&serialconfig, spd);
     
-    if (tcsetattr (serialDesc, TCSANOW, &serialconfig) != 0) throw std::invalid_argument ("Error configuring the serial port parameters: " + std::string (strerror (errno)));
+    if (tcsetattr (sd, TCSANOW, &serialconfig) != 0) throw std::invalid_argument ("Error configuring the serial port parameters: " + std::string (strerror (errno)));
 }
@@ -0,0 +1,196 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+#include "SessionJournal.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <stdexcept>
+
+static const char journalMagic [8] = {'B', 'A', 'T', 'G', 'S', 'E', 'S', 'S'};
+static const uint32_t journalVersion = 1;
+
+SessionJournal::SessionJournal (const std::string& p, bool ro) :
+    path        {p},
+    readOnly    {ro},
+    fileDesc    {open (path.c_str (), (readOnly ? O_RDONLY : O_RDWR | O_CREAT) | O_CLOEXEC, 0644)},
+    records     {0},
+    current     {}
+{
+    if (fileDesc < 0) throw std::invalid_argument ("It was not possible to open the session journal " + path + ", error: " + std::string (strerror (errno)));
+    
+    Header header {};
+    const ssize_t got = pread (fileDesc, & header, sizeof (header), 0);
+    
+    if (got == 0 and not readOnly)
+    {
+        memcpy (header.magic, journalMagic, sizeof (journalMagic));
+        header.version = journalVersion;
+        header.recordSize = sizeof (Record);
+        
+        if (pwrite (fileDesc, & header, sizeof (header), 0) != static_cast <ssize_t> (sizeof (header)))
+        {
+            close (fileDesc);
+            throw std::invalid_argument ("It was not possible to create the session journal " + path);
+        }
+    }
+    else if (got != static_cast <ssize_t> (sizeof (header)) or memcmp (header.magic, journalMagic, sizeof (journalMagic)) != 0)
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("The file " + path + " is not a batguard session journal");
+    }
+    else if (header.version != journalVersion or header.recordSize != sizeof (Record))
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("The session journal " + path + " has a different format version");
+    }
+    
+    records = countRecords ();
+    
+    //a record partially written at a power loss is dropped
+    if (not readOnly and ftruncate (fileDesc, static_cast <off_t> (sizeof (Header) + records * sizeof (Record))) != 0)
+    {
+        close (fileDesc);
+        throw std::invalid_argument ("It was not possible to write the session journal " + path + ", error: " + std::string (strerror (errno)));
+    }
+    
+    if (records and pread (fileDesc, & current, sizeof (Record), static_cast <off_t> (sizeof (Header) + (records - 1) * sizeof (Record))) != static_cast <ssize_t> (sizeof (Record))) current = Record {};
+}
+
+SessionJournal::~SessionJournal ()
+{
+    close (fileDesc);
+}
+
+size_t SessionJournal::countRecords () const
+{
+    struct stat st;
+    if (fstat (fileDesc, & st) != 0 or static_cast <size_t> (st.st_size) < sizeof (Header)) return 0;
+    
+    return (static_cast <size_t> (st.st_size) - sizeof (Header)) / sizeof (Record);
+}
+
+void SessionJournal::writeRecord (size_t index, const Record& record)
+{
+    if (readOnly) throw std::runtime_error ("The session journal " + path + " is open read only");
+    
+    if (pwrite (fileDesc, & record, sizeof (Record), static_cast <off_t> (sizeof (Header) + index * sizeof (Record))) != static_cast <ssize_t> (sizeof (Record))) throw std::runtime_error ("It was not possible to write the session journal " + path + ", error: " + std::string (strerror (errno)));
+}
+
+bool SessionJournal::isOpen () const
+{
+    return records and current.endMs == 0;
+}
+
+void SessionJournal::openSession (long long wallMs, double capacity, double energyWh, const std::string& profile, Cause cause)
+{
+    if (isOpen ()) throw std::runtime_error ("A charging session is already open in the session journal " + path);
+    
+    Record record {};
+    record.startMs          = wallMs;
+    record.startCapacity    = static_cast <float> (capacity);
+    record.startEnergyWh    = static_cast <float> (energyWh);
+    record.endEnergyWh      = -1.0f;
+    record.startCause       = cause;
+    record.endCause         = Cause::NONE;
+    strncpy (record.profile, profile.c_str (), profileNameSize - 1);
+    
+    writeRecord (records, record);
+    
+    ++ records;
+    current = record;
+}
+
+void SessionJournal::closeSession (long long wallMs, double capacity, double energyWh, Cause cause)
+{
+    if (not isOpen ()) throw std::runtime_error ("No charging session is open in the session journal " + path);
+    
+    Record record = current;
+    //the wall clock may be set backward, a session never ends before its start
+    record.endMs            = wallMs > record.startMs ? wallMs : record.startMs + 1;
+    record.endCapacity      = static_cast <float> (capacity);
+    record.endEnergyWh      = static_cast <float> (energyWh);
+    record.endCause         = cause;
+    
+    writeRecord (records - 1, record);
+    
+    current = record;
+}
+
+size_t SessionJournal::size () const
+{
+    return readOnly ? countRecords () : records;
+}
+
+size_t SessionJournal::query (long long fromMs, long long toMs, std::vector <Record>& out) const
+{
+    const size_t initial = out.size ();
+    const size_t total = size ();
+    
+    //the records are read sequentially by blocks
+    Record block [readBlock];
+    for (size_t first = 0; first < total; first += readBlock)
+    {
+        const size_t wanted = std::min (readBlock, total - first);
+        const ssize_t got = pread (fileDesc, block, wanted * sizeof (Record), static_cast <off_t> (sizeof (Header) + first * sizeof (Record)));
+        if (got < 0) throw std::runtime_error ("It was not possible to read the session journal " + path + ", error: " + std::string (strerror (errno)));
+        
+        for (size_t i = 0; i < static_cast <size_t> (got) / sizeof (Record); ++ i)
+        {
+            const Record& record = block [i];
+            //the open session is still going on
+            if (record.startMs < toMs and (record.endMs == 0 or record.endMs >= fromMs)) out.push_back (record);
+        }
+    }
+    
+    return out.size () - initial;
+}
+
+double SessionJournal::energyDelivered (const Record& record)
+{
+    if (record.endMs == 0 or record.startEnergyWh < 0.0f or record.endEnergyWh < 0.0f) return -1.0;
+    
+    return static_cast <double> (record.endEnergyWh) - static_cast <double> (record.startEnergyWh);
+}
+
+std::string SessionJournal::causeToString (Cause cause)
+{
+    switch (cause)
+    {
+        case Cause::NONE:           return "none";
+        case Cause::START:          return "start";
+        case Cause::MIN_THRESHOLD:  return "min_threshold";
+        case Cause::MAX_THRESHOLD:  return "max_threshold";
+        case Cause::USER_COMMAND:   return "user_command";
+        case Cause::PROFILE_CHANGE: return "profile_change";
+        case Cause::EXIT:           return "exit";
+    }
+    
+    return "unknown";
+}
+
+const std::string& SessionJournal::getPath () const
+{
+    return path;
+}
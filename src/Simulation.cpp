@@ -0,0 +1,169 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "Simulation.hpp"
+#include "Clock.hpp"
+#include "stringtools.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <errno.h>
+
+std::vector <Simulation::Sample> Simulation::readTrace (const std::string& fileName)
+{
+    std::ifstream traceFile (fileName);        
+    if (not traceFile.good ()) throw std::invalid_argument ("The trace file '" + fileName + "' was not found or is not readable");
+    
+    std::vector <Sample> samples;
+    
+    unsigned int lineNumber = 0;
+    for (std::string& line : split (traceFile, '\n')) 
+    {
+        ++ lineNumber;
+        
+        if (isSkippable (line)) continue;
+        
+        std::vector <std::string> values = split (line, ',');
+        trim (values);
+        
+        if (values.size () < 2 or values.size () > 3) throw std::invalid_argument ("The trace requires time, capacity and optionally ac instead it was found: " + line + ", at the line number: " + std::to_string (lineNumber));
+        
+        Sample sample {0, 0, -1};
+        try
+        {
+            sample.time     = Clock::parseTime (values [0]);
+            sample.capacity = std::stoi (values [1]);
+            if (values.size () == 3) sample.ac = std::stoi (values [2]);
+        }
+        catch (const std::logic_error&)
+        {
+            throw std::invalid_argument ("The trace sample is not correct: " + line + ", at the line number: " + std::to_string (lineNumber));
+        }
+        
+        if (sample.capacity < 0 or sample.capacity > 100) throw std::invalid_argument ("The trace capacity shall be between 0 and 100 instead it was found: " + line + ", at the line number: " + std::to_string (lineNumber));
+        if (values.size () == 3 and sample.ac != 0 and sample.ac != 1) throw std::invalid_argument ("The trace ac shall be 0 or 1 instead it was found: " + line + ", at the line number: " + std::to_string (lineNumber));
+        if (samples.size () and sample.time <= samples.back ().time) throw std::invalid_argument ("The trace time shall increase line by line instead it was found: " + line + ", at the line number: " + std::to_string (lineNumber));
+        
+        samples.push_back (sample);
+    }
+    
+    if (samples.empty ()) throw std::invalid_argument ("The trace file '" + fileName + "' does not contain any sample");
+    
+    return samples;
+}
+
+Simulation::Simulation (const std::string& traceFile, std::ostream& out) :
+    trace       {readTrace (traceFile)},
+    output      {out},
+    logPath     {traceFile + ".log"},
+    directory   {},
+    batteryPath {},
+    emulator    {},
+    current     {0}
+{
+    char dirTemplate [] = "/tmp/batguardXXXXXX";
+    if (mkdtemp (dirTemplate) == nullptr) throw std::invalid_argument ("It was not possible to create the simulation directory, error: " + std::string (strerror (errno)));
+    
+    directory   = dirTemplate;
+    batteryPath = directory + "/capacity";
+    
+    Clock::startVirtual (trace.front ().time);
+    
+    writeBattery ();
+    
+    output << "time,channel,relay,capacity,ac\n";
+}
+
+Simulation::~Simulation ()
+{
+    DIR* dir = opendir (directory.c_str ());
+    if (dir == nullptr) return;
+    
+    while (const struct dirent* entry = readdir (dir))
+    {
+        if (strcmp (entry->d_name, ".") and strcmp (entry->d_name, "..")) unlink ((directory + "/" + entry->d_name).c_str ());
+    }
+    closedir (dir);
+    
+    rmdir (directory.c_str ());
+}
+
+const std::string& Simulation::getRelayPath () const
+{
+    return emulator.getPath ();
+}
+
+const std::string& Simulation::getDirectory () const
+{
+    return directory;
+}
+
+const std::string& Simulation::getLogPath () const
+{
+    return logPath;
+}
+
+void Simulation::writeBattery ()
+{
+    std::ofstream battery (batteryPath, std::ios::trunc);
+    battery << trace [current].capacity << '\n';
+    if (not battery.good ()) throw std::runtime_error ("It was not possible to write the simulated battery file: " + batteryPath);
+    
+    //the charger power supply is simulated only if the trace reports it
+    if (trace [current].ac < 0) return;
+    
+    std::ofstream online (directory + "/online", std::ios::trunc);
+    online << trace [current].ac << '\n';
+    if (not online.good ()) throw std::runtime_error ("It was not possible to write the simulated charger file: " + directory + "/online");
+}
+
+void Simulation::writeActions ()
+{
+    emulator.waitIdle ();
+    
+    for (const RelayEmulator::Action& action : emulator.takeActions ())
+    {
+        output << Clock::formatTime (static_cast <time_t> (action.wallMs / 1000LL)) << ',' << static_cast <int> (action.channel) << ',' << (action.state ? "on" : "off") << ',' << trace [current].capacity << ',';
+        if (trace [current].ac >= 0) output << trace [current].ac;
+        output << '\n';
+    }
+}
+
+bool Simulation::advance (unsigned long ms)
+{
+    writeActions ();
+    
+    Clock::advance (ms);
+    
+    const time_t now = Clock::wallTime ();
+    if (now > trace.back ().time) return false;
+    
+    const size_t previous = current;
+    while (current + 1 < trace.size () and trace [current + 1].time <= now) ++ current;
+    
+    if (current != previous) writeBattery ();
+    
+    return true;
+}
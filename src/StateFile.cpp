@@ -23,6 +23,7 @@
 #include "StateFile.hpp"
 #include "stringtools.hpp"
 #include <fstream>
+#include <iterator>
 #include <stdexcept>
 
 void StateFile::resetState ()
@@ -40,6 +41,16 @@ StateFile::StateFile (const std::string& fn, const ChargeProfiles& cp) :
     resetState ();
 }   
 
+void StateFile::setFileName (const std::string& fn)
+{
+    fileName = fn;
+}
+
+const std::string& StateFile::getFileName () const
+{
+    return fileName;
+}
+
 std::string StateFile::toString () const
 {
     return "Profile: " + (profile ? profile->toString () : std::string ("not defined")) + "; charger: " + stateToString (charger) + "; scheduler: " + stateToString (scheduler) + (logger ? ", logger to flush" : "");
@@ -56,7 +67,9 @@ StateFile::Error StateFile::read ()
     
     if (not runfile.good ()) return NOTFUND;
     
-    std::vector <std::string> values = splitMulti (runfile, ' ');  
+    content.assign (std::istreambuf_iterator <char> (runfile), std::istreambuf_iterator <char> ());
+    
+    std::vector <std::string> values = splitMulti (content, ' ');  
     trim (values); //to remove new lines
     if (values.size () == 0) return RFEMPTY;
             
@@ -113,23 +126,37 @@ StateFile::Error StateFile::read ()
     return NO;
 }
 
-StateFile::Error StateFile::write (const ChargeProfile* profile, State cha, State sch) const
+StateFile::Error StateFile::write (const ChargeProfile* profile, State cha, State sch)
 {
-    std::ofstream runfile (fileName);
+    std::string text;
     
-    if (not runfile.good ()) return NOTWRIT;
+    if (profile != nullptr) text += profile->name + ' ';
     
-    if (profile != nullptr) runfile << profile->name << ' ';
+    if (cha != LAST) text += std::string (cha == ON ? "#chargeron" : "#chargeroff") + ' ';
     
-    if (cha != LAST) runfile << (cha == ON ? "#chargeron" : "#chargeroff") << ' ';
+    if (sch != LAST) text += std::string (sch == ON ? "#scheduleron" : "#scheduleroff") + ' ';
     
-    if (sch != LAST) runfile << (sch == ON ? "#scheduleron" : "#scheduleroff") << ' ';
+    text += '\n';
     
-    runfile << '\n';
+    std::ofstream runfile (fileName);
+    
+    if (not runfile.good ()) return NOTWRIT;
+    
+    runfile << text;
+    content = text;
     
     return NO;
 }
 
+bool StateFile::isChangedOnFile () const
+{
+    std::ifstream runfile (fileName);
+    
+    if (not runfile.good ()) return true;
+    
+    return std::string (std::istreambuf_iterator <char> (runfile), std::istreambuf_iterator <char> ()) != content;
+}
+
 StateFile::State StateFile::chargerInit () const
 {
     return charger;
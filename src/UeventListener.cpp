@@ -0,0 +1,171 @@
+/*
+ * batguard a laptop battery charge manager
+ * 
+ * Copyright (C) 2025 Simone Pernice pernice@libero.it 
+ * 
+ * This file is part of batguard.
+ *
+ * batguard is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * batguard is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include "UeventListener.hpp"
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <charconv>
+#include <algorithm>
+#include <stdexcept>
+
+int UeventListener::openKernelSocket ()
+{
+    const int sd = socket (AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (sd < 0) throw std::invalid_argument ("It was not possible to open the uevent socket, error: " + std::string (strerror (errno)));
+    
+    //the group 1 receives the uevents sent by the kernel
+    struct sockaddr_nl address {};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1;
+    
+    if (bind (sd, reinterpret_cast <struct sockaddr*> (& address), sizeof (address)) != 0)
+    {
+        const std::string err {strerror (errno)};
+        close (sd);
+        throw std::invalid_argument ("It was not possible to subscribe to the kernel uevents, error: " + err);
+    }
+    
+    return sd;
+}
+
+UeventListener::UeventListener () :
+    socketDesc  {openKernelSocket ()},
+    supplies    {}
+{
+}
+
+UeventListener::UeventListener (int sd) :
+    socketDesc  {sd},
+    supplies    {}
+{
+}
+
+UeventListener::~UeventListener ()
+{
+    close (socketDesc);
+}
+
+void UeventListener::watchSupply (const std::string& name)
+{
+    if (std::none_of (supplies.begin (), supplies.end (), [&] (const Supply& s) {return s.name == name;})) supplies.push_back ({name, -1, "", -1});
+}
+
+void UeventListener::clearSupplies ()
+{
+    supplies.clear ();
+}
+
+int UeventListener::getDescriptor () const
+{
+    return socketDesc;
+}
+
+std::string UeventListener::supplyName (const std::string& path)
+{
+    const size_t end = path.find_last_of ('/');
+    if (end == std::string::npos or end == 0) return "";
+    
+    const size_t begin = path.find_last_of ('/', end - 1);
+    return path.substr (begin == std::string::npos ? 0 : begin + 1, end - (begin == std::string::npos ? 0 : begin + 1));
+}
+
+std::vector <std::string> UeventListener::readEvents ()
+{
+    char buffer [8192];
+    std::vector <std::string> changed;
+    
+    while (true)
+    {
+        struct sockaddr_storage sender {};
+        socklen_t senderLength = sizeof (sender);
+        
+        const ssize_t len = recvfrom (socketDesc, buffer, sizeof (buffer), MSG_DONTWAIT, reinterpret_cast <struct sockaddr*> (& sender), & senderLength);
+        if (len <= 0) break;
+        
+        //on netlink only the messages sent by the kernel are trusted
+        if (sender.ss_family == AF_NETLINK and reinterpret_cast <const struct sockaddr_nl*> (& sender)->nl_pid != 0) continue;
+        
+        const std::string name = parseEvent (std::string_view (buffer, static_cast <size_t> (len)));
+        if (name.size () and std::find (changed.begin (), changed.end (), name) == changed.end ()) changed.push_back (name);
+    }
+    
+    return changed;
+}
+
+std::string UeventListener::parseEvent (std::string_view payload)
+{
+    std::string_view subsystem, name, status, capacity, online;
+    
+    //the payload is a header followed by KEY=value fields, all terminated by a null character
+    size_t begin = 0;
+    while (begin < payload.size ())
+    {
+        size_t end = payload.find ('\0', begin);
+        if (end == std::string_view::npos) end = payload.size ();
+        
+        const std::string_view field = payload.substr (begin, end - begin);
+        begin = end + 1;
+        
+        const size_t equal = field.find ('=');
+        if (equal == std::string_view::npos) continue;
+        
+        const std::string_view key = field.substr (0, equal);
+        const std::string_view value = field.substr (equal + 1);
+        
+        if      (key == "SUBSYSTEM")                subsystem = value;
+        else if (key == "POWER_SUPPLY_NAME")        name = value;
+        else if (key == "POWER_SUPPLY_STATUS")      status = value;
+        else if (key == "POWER_SUPPLY_CAPACITY")    capacity = value;
+        else if (key == "POWER_SUPPLY_ONLINE")      online = value;
+    }
+    
+    if (subsystem != "power_supply") return "";
+    
+    const auto supply = std::find_if (supplies.begin (), supplies.end (), [&] (const Supply& s) {return s.name == name;});
+    if (supply == supplies.end ()) return "";
+    
+    bool changed = false;
+    
+    int number;
+    if (capacity.size () and std::from_chars (capacity.data (), capacity.data () + capacity.size (), number).ec == std::errc () and number != supply->capacity)
+    {
+        supply->capacity = number;
+        changed = true;
+    }
+    
+    if (online.size () and std::from_chars (online.data (), online.data () + online.size (), number).ec == std::errc () and number != supply->online)
+    {
+        supply->online = number;
+        changed = true;
+    }
+    
+    if (status.size () and status != supply->status)
+    {
+        supply->status = status;
+        changed = true;
+    }
+    
+    return changed ? supply->name : "";
+}
@@ -21,7 +21,10 @@
  */
  
 #include "BatGuard.hpp"
+#include "Clock.hpp"
+#include "RollupStore.hpp"
 #include <unistd.h>
+#include <getopt.h>
 #include <iostream>
 #include <stdexcept>
 #include <signal.h>
@@ -39,7 +42,8 @@ void signalHandler (int signal)
             else exit (0);
             break;
         case SIGHUP:
-            std::cout << "SIGHUP signal is not supported by batguard, please restart batguard to reload the configuration: sudo systemctl restart batguard";
+            //while the main loop runs SIGHUP is received by its event loop to reload the configuration
+            std::cout << "SIGHUP signal reloads the configuration only while batguard is running as a service: sudo systemctl reload batguard\n";
             break;
     }
 }
@@ -53,18 +57,53 @@ int main (int argc, char** argv)
     std::string configFile {""};
     std::string relayCommand;
     std::string logMessage;
+    std::string deviceName;
+    std::string simulationTrace;
+    std::string historyFrom;
+    std::string historyTo;
+    std::string historyStep {"1h"};
     bool        printBattery = false;
     bool        printProfiles = false;
     bool        printSchedules = false;
     bool        printUserCommand = false;
     bool        printLastState = false;
+    bool        printHistory = false;
+    bool        printSessions = false;
     bool        quit = false;
     
+    const struct option longOptions [] = {
+                                            {"simulate", required_argument, nullptr, 'S'},
+                                            {"history",  no_argument,       nullptr, 'H'},
+                                            {"from",     required_argument, nullptr, 'F'},
+                                            {"to",       required_argument, nullptr, 'T'},
+                                            {"step",     required_argument, nullptr, 'P'},
+                                            {"sessions", no_argument,       nullptr, 'J'},
+                                            {nullptr, 0, nullptr, 0}
+                                         };
+    
     int opt;
-    while ((opt = getopt (argc, argv, "c:r:l:bpqusvht")) != -1)
+    while ((opt = getopt_long (argc, argv, "c:r:l:d:bpqusvht", longOptions, nullptr)) != -1)
     {
         switch (opt)
         {
+            case 'S':
+                simulationTrace = std::string (optarg);
+                break;
+            case 'H':
+                printHistory = true;
+                break;
+            case 'J':
+                printSessions = true;
+                break;
+            case 'F':
+                historyFrom = std::string (optarg);
+                break;
+            case 'T':
+                historyTo = std::string (optarg);
+                break;
+            case 'P':
+                historyStep = std::string (optarg);
+                break;
             case 'c':
                 configFile = std::string (optarg);
                 break;
@@ -74,6 +113,9 @@ int main (int argc, char** argv)
             case 'l':
                 logMessage = std::string (optarg);
                 break;
+            case 'd':
+                deviceName = std::string (optarg);
+                break;
             case 'b':
                 printBattery = true;
                 break;
@@ -103,6 +145,7 @@ int main (int argc, char** argv)
                 std::cout << "-c config_file_path   (read the configuration file from the given path instead of the default /etc/batguard/config)\n";
                 std::cout << "-r relay_command      (send one of the following commands to the relay: off, on, offc, onc, notc, check where the ending 'c' stands for check feedback)\n";
                 std::cout << "-l log_message        (write an ERROR-level message into the log file as far as the log is enabled)\n";
+                std::cout << "-d device_name        (apply the options -r, -b, -p, -s, -u, -t, --history, --sessions only to the given device instead of all the devices)\n";
                 std::cout << "-b                    (print the battery capacity)\n";
                 std::cout << "-p                    (print the list of capacity profiles loaded from the configuration file)\n";
                 std::cout << "-s                    (print the list of profile schedules loaded from the configuration file)\n";
@@ -110,6 +153,12 @@ int main (int argc, char** argv)
                 std::cout << "-u                    (print the command file content)\n";
                 std::cout << "-t                    (print the state file content)\n";
                 std::cout << "-q                    (read the configuration file then quit without entering the main loop)\n";
+                std::cout << "--simulate trace_file (run the main loop on a virtual clock replaying the battery trace against an emulated relay, print the relay changes and write the log in trace_file.log)\n";
+                std::cout << "--history             (print the battery history summaries, it requires historypath in the configuration file)\n";
+                std::cout << "--sessions            (print the charging sessions, it requires historypath in the configuration file)\n";
+                std::cout << "--from time           (begin of the history or sessions, as YYYY-MM-DD [HH:MM[:SS]] or seconds since the epoch, default one day before the end for the history, the first session for the sessions)\n";
+                std::cout << "--to time             (end of the history or sessions, default now)\n";
+                std::cout << "--step step           (history interval as 15m, 2h, 1d or seconds, default 1h)\n";
                 std::cout << "-h                    (print this help)\n";                
                 std::cout << '\n';
                 return 0;
@@ -123,9 +172,14 @@ int main (int argc, char** argv)
     
     try 
     {
-        BatGuard batGuard (configFile);
+        const bool query = relayCommand.size () or logMessage.size () or printBattery or printProfiles or printSchedules or printUserCommand or printLastState or printHistory or printSessions or quit;
+        
+        //the queries only read the history files, the running batguard may be writing them
+        BatGuard batGuard (configFile, simulationTrace, query);
         batGuardPtr = & batGuard;
         
+        batGuard.selectDevice (deviceName);
+        
         if (relayCommand.size ())   std::cout << "Relay feedback: "         << batGuard.sendCommandRelay (relayCommand) << '\n';
         
         if (logMessage.size ())     std::cout << "Log message result: "     << batGuard.logMessage (logMessage) << '\n';
@@ -140,8 +194,27 @@ int main (int argc, char** argv)
         
         if (printLastState)         std::cout << "State file content: "     << batGuard.getLastState () << '\n';   
         
+        if (printHistory)
+        {
+            const time_t to   = historyTo.size () ? Clock::parseTime (historyTo) : Clock::wallTime ();
+            const time_t from = historyFrom.size () ? Clock::parseTime (historyFrom) : to - 86400;
+            
+            const std::string summary = batGuard.getHistorySummary (from * 1000LL, to * 1000LL, RollupStore::parseStep (historyStep));
+            
+            std::cout << "Battery history:\n" << summary << '\n';
+        }
+        
+        if (printSessions)
+        {
+            const time_t to   = historyTo.size () ? Clock::parseTime (historyTo) : Clock::wallTime ();
+            const time_t from = historyFrom.size () ? Clock::parseTime (historyFrom) : 0;
+            
+            const std::string list = batGuard.getSessions (from * 1000LL, to * 1000LL);
+            
+            std::cout << "Charging sessions:\n" << list << '\n';
+        }
         
-        if (relayCommand.size () or logMessage.size () or printBattery or printProfiles or printSchedules or printUserCommand or printLastState or quit) return 0;
+        if (query) return 0;
         
         batGuard.start ();        
     }
@@ -21,19 +21,143 @@
  */
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <signal.h>
 #include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <climits>
+#include <atomic>
 
 #include "ConfigReader.hpp"
 #include "SerialPort.hpp"
 #include "RelayDriver.hpp"
+#include "RelayBoard.hpp"
+#include "LcusProtocol.hpp"
+#include "ModbusProtocol.hpp"
+#include "RelayEmulator.hpp"
 #include "CapacityReader.hpp"
+#include "BatteryReader.hpp"
+#include "BatterySource.hpp"
+#include "SampleHistory.hpp"
+#include "HistoryStore.hpp"
+#include "RollupStore.hpp"
+#include "SessionJournal.hpp"
 #include "LogWriter.hpp"
 #include "ChargeProfiles.hpp"
 #include "StateFile.hpp"
 #include "ProfileSchedules.hpp"
 #include "stringtools.hpp"
+#include "ChargeRateEstimator.hpp"
+#include "Clock.hpp"
+#include "UeventListener.hpp"
+#include "EventLoop.hpp"
+#include "BatGuard.hpp"
+
+//The far end of a pseudo terminal, it reads and writes raw bytes to the SerialPort opened on its path
+class PtyPeer
+{
+    public:
+        PtyPeer () :
+            master  {posix_openpt (O_RDWR | O_NOCTTY | O_CLOEXEC)},
+            slave   {-1},
+            path    {},
+            out     {},
+            in      {}
+        {
+            REQUIRE (master >= 0);
+            REQUIRE (grantpt (master) == 0);
+            REQUIRE (unlockpt (master) == 0);
+            path = ptsname (master);
+            
+            //the slave side is kept open otherwise the master would read an error every time the serial port is closed
+            slave = open (path.c_str (), O_RDWR | O_NOCTTY | O_CLOEXEC);
+            REQUIRE (slave >= 0);
+            
+            struct termios tty;
+            REQUIRE (tcgetattr (master, & tty) == 0);
+            cfmakeraw (& tty);
+            REQUIRE (tcsetattr (master, TCSANOW, & tty) == 0);
+        }
+        
+        ~PtyPeer ()
+        {
+            close (slave);
+            close (master);
+        }
+        
+        const std::string& getPath () const
+        {
+            return path;
+        }
+        
+        bool writeByte (uint8_t b)
+        {
+            out.push_back (b);
+            return true;
+        }
+        
+        unsigned int writeFlush ()
+        {
+            const ssize_t written = write (master, out.data (), out.size ());
+            out.clear ();
+            return written > 0 ? static_cast <unsigned int> (written) : 0;
+        }
+        
+        unsigned int readFlushUntil (unsigned int minBytes, unsigned int timeoutMs)
+        {
+            const auto deadline = std::chrono::steady_clock::now () + std::chrono::milliseconds (timeoutMs);
+            
+            while (in.size () < minBytes)
+            {
+                const long long left = std::chrono::duration_cast <std::chrono::milliseconds> (deadline - std::chrono::steady_clock::now ()).count ();
+                struct pollfd fd {master, POLLIN, 0};
+                if (poll (& fd, 1, left > 0 ? static_cast <int> (left) : 0) <= 0) break;
+                
+                uint8_t buffer [256];
+                const ssize_t len = read (master, buffer, sizeof (buffer));
+                if (len <= 0) break;
+                in.insert (in.end (), buffer, buffer + len);
+            }
+            
+            return bytesToRead ();
+        }
+        
+        unsigned int readFlush ()
+        {
+            return readFlushUntil (bytesToRead () + 1, 100);
+        }
+        
+        unsigned int bytesToRead () const
+        {
+            return static_cast <unsigned int> (in.size ());
+        }
+        
+        uint8_t readByte ()
+        {
+            REQUIRE (not in.empty ());
+            const uint8_t b = in.front ();
+            in.erase (in.begin ());
+            return b;
+        }
+        
+    private:
+        int                     master;
+        int                     slave;
+        std::string             path;
+        std::vector <uint8_t>   out;
+        std::vector <uint8_t>   in;
+};
+
+using Catch::Approx;
 
 TEST_CASE( "ConfigReader", "[configuration]" ) 
 {
@@ -161,16 +285,35 @@ TEST_CASE( "ConfigReader", "[configuration]" )
     REQUIRE (cr.getNextListOfBoolDescription (5,1) == std::vector <bool> {true,  false, true,  true,  true});        
 }
 
-TEST_CASE("SerialPort", "[serial]") 
+TEST_CASE( "ConfigReader sections", "[configuration]" ) 
 {
-    // Start socat in the background
-    REQUIRE (system("socat -d2 PTY,link=/tmp/ttyS10,raw,echo=0 PTY,link=/tmp/ttyS11,raw,echo=0 &") == 0);
-    sleep (1); // Give socat time to start
+    REQUIRE (ConfigReader::readSectionNames ("../tests/sectiontest.conf") == std::vector <std::string> {"first", "second"});
+    REQUIRE (ConfigReader::readSectionNames ("../tests/configtest.conf").empty ());
+    
+    ConfigReader common ({Configuration ({"!UNIQUE!", "common"})}, "../tests/sectiontest.conf");
+    REQUIRE (common.fromConfiguration ("common").getNextString () == "shared");
     
-    SerialPort wr ("/tmp/ttyS10", 9600);
-    SerialPort rd ("/tmp/ttyS11", 9600);
+    ConfigReader first ({Configuration ({"!UNIQUE!", "channel"}), Configuration ({"!UNIQUE!", "name", "none"})}, "../tests/sectiontest.conf", "first");
+    REQUIRE (first.fromConfiguration ("channel").getNextUnsignedInt () == 1);
+    REQUIRE (first.fromConfiguration ("name").getNextString () == "one");
+    
+    ConfigReader second ({Configuration ({"!UNIQUE!", "channel"}), Configuration ({"!UNIQUE!", "name", "none"})}, "../tests/sectiontest.conf", "second");
+    REQUIRE (second.fromConfiguration ("channel").getNextUnsignedInt () == 2);
+    REQUIRE (second.fromConfiguration ("name").getNextString () == "none");
+    
+    //a missing section has not any property
+    REQUIRE_THROWS (ConfigReader ({Configuration ({"!UNIQUE!", "channel"})}, "../tests/sectiontest.conf", "third"));
+    
+    //the common properties are not allowed by the template of the sections
+    REQUIRE_THROWS (ConfigReader ({Configuration ({"!UNIQUE!", "channel"})}, "../tests/sectiontest.conf"));
+}
 
-    REQUIRE (rd.readFlush () == 0);
+TEST_CASE("SerialPort", "[serial]") 
+{
+    PtyPeer wr;
+    SerialPort rd (wr.getPath (), 9600);
+
+    REQUIRE (rd.readFlushUntil (1, 0) == 0);
     
     REQUIRE (wr.writeByte (71) == true);
     REQUIRE (wr.writeByte (17) == true);
@@ -193,7 +336,7 @@ TEST_CASE("SerialPort", "[serial]")
     REQUIRE (rd.bytesToRead () == 3);
     REQUIRE (rd.readByte () == 12);
     REQUIRE (rd.bytesToRead () == 2);
-    REQUIRE (rd.readFlush () == 2);
+    REQUIRE (rd.readFlushUntil (2, 0) == 2);
     REQUIRE (rd.readByte () == 34);
     REQUIRE (rd.readByte () == 99);
 
@@ -207,24 +350,120 @@ TEST_CASE("SerialPort", "[serial]")
     REQUIRE (rd.bytesToRead () == 1);    
     REQUIRE (rd.readByte () == 39);
     REQUIRE (rd.bytesToRead () == 0);    
-    REQUIRE (rd.readFlush () == 0);
+    REQUIRE (rd.readFlushUntil (1, 0) == 0);
     REQUIRE (rd.bytesToRead () == 0);
     
-    //Kill the socat process
-    REQUIRE(system("pkill socat") == 0);
+    //the buffers wrap around their end keeping the bytes not read yet
+    for (unsigned int i = 0; i < 100; ++ i) REQUIRE (wr.writeByte (static_cast <uint8_t> (i)) == true);
+    REQUIRE (wr.writeFlush () == 100);
+    REQUIRE (rd.readFlushUntil (100, 1000) == 100);
+    for (unsigned int i = 0; i < 90; ++ i) REQUIRE (rd.readByte () == i);
+    
+    for (unsigned int i = 100; i < 200; ++ i) REQUIRE (wr.writeByte (static_cast <uint8_t> (i)) == true);
+    REQUIRE (wr.writeFlush () == 100);
+    REQUIRE (rd.readFlushUntil (110, 1000) == 110);
+    REQUIRE (rd.peekByte (0) == 90);
+    REQUIRE (rd.peekByte (109) == 199);
+    REQUIRE_THROWS (rd.peekByte (110));
+    for (unsigned int i = 90; i < 200; ++ i) REQUIRE (rd.readByte () == i);
+    
+    //a full write buffer refuses the bytes and counts them
+    for (unsigned int i = 0; i < 128; ++ i) REQUIRE (rd.writeByte (static_cast <uint8_t> (i)) == true);
+    REQUIRE (rd.writeByte (0) == false);
+    REQUIRE (rd.writeOverflows () == 1);
+    REQUIRE (rd.writeFlush () == 128);
+    REQUIRE (rd.writeByte (128) == true);
+    REQUIRE (rd.writeFlush () == 1);
+    
+    REQUIRE (wr.readFlushUntil (129, 1000) == 129);
+    for (unsigned int i = 0; i < 129; ++ i) REQUIRE (wr.readByte () == i);
+    
+    //a full read buffer leaves the bytes to the driver
+    for (unsigned int i = 0; i < 129; ++ i) REQUIRE (wr.writeByte (static_cast <uint8_t> (i)) == true);
+    REQUIRE (wr.writeFlush () == 129);
+    
+    REQUIRE (rd.readFlushUntil (129, 1000) == 128);
+    REQUIRE (rd.readOverflows () == 1);
+    REQUIRE_THROWS (rd.consume (129));
+    rd.consume (128);
+    REQUIRE (rd.readFlush () == 1);
+    REQUIRE (rd.readByte () == 128);
+    
+    //a missing device leaves the port closed, it can be linked once it shows up
+    const std::string link = "./ttyRELAYTEST";
+    remove (link.c_str ());
+    
+    SerialPort missing (link, 9600, 1);
+    REQUIRE (missing.isOpen () == false);
+    REQUIRE (missing.writeByte (1) == true);
+    REQUIRE (missing.writeFlush () == 0);
+    REQUIRE (missing.bytesToWrite () == 0);
+    REQUIRE (missing.readFlushUntil (1, 1000) == 0);
+    REQUIRE (missing.reconnect () == false);
+    
+    REQUIRE (symlink (wr.getPath ().c_str (), link.c_str ()) == 0);
+    REQUIRE (missing.reconnect () == true);
+    REQUIRE (missing.isOpen () == true);
+    REQUIRE (remove (link.c_str ()) == 0);
+    
+    //the device appearing while the port waits for it is opened at once
+    int linked = -1;
+    std::thread plug ([&] {usleep (100000); linked = symlink (wr.getPath ().c_str (), link.c_str ());});
+    const long long begin = Clock::monotonicMs ();
+    SerialPort late (link, 9600, 3);
+    plug.join ();
+    
+    REQUIRE (linked == 0);
+    REQUIRE (late.isOpen () == true);
+    REQUIRE (Clock::monotonicMs () - begin < 1000);
+    REQUIRE (remove (link.c_str ()) == 0);
+    
+    //a device unplugged closes the port, it is linked again once it comes back
+    std::unique_ptr <PtyPeer> unplugged = std::make_unique <PtyPeer> ();
+    REQUIRE (symlink (unplugged->getPath ().c_str (), link.c_str ()) == 0);
+    
+    SerialPort hot (link, 9600, 1);
+    REQUIRE (hot.isOpen () == true);
+    REQUIRE (hot.lastRecoveryMs () == -1);
+    
+    unplugged.reset ();
+    REQUIRE (remove (link.c_str ()) == 0);
+    
+    REQUIRE (hot.readFlushUntil (1, 1000) == 0);
+    REQUIRE (hot.isOpen () == false);
+    REQUIRE (hot.disconnections () == 1);
+    REQUIRE (hot.reconnect () == false);
+    
+    REQUIRE (symlink (wr.getPath ().c_str (), link.c_str ()) == 0);
+    REQUIRE (hot.reconnect () == true);
+    REQUIRE (hot.lastRecoveryMs () >= 0);
+    REQUIRE (hot.totalDownMs () == hot.lastRecoveryMs ());
+    
+    REQUIRE (hot.writeByte (7) == true);
+    REQUIRE (hot.writeFlush () == 1);
+    REQUIRE (wr.readFlushUntil (1, 1000) == 1);
+    REQUIRE (wr.readByte () == 7);
+    REQUIRE (remove (link.c_str ()) == 0);
+    
+    //the hang up is noticed without any read or write
+    unplugged = std::make_unique <PtyPeer> ();
+    REQUIRE (symlink (unplugged->getPath ().c_str (), link.c_str ()) == 0);
+    REQUIRE (hot.reconnect () == true);
+    REQUIRE (hot.checkLink () == true);
+    
+    unplugged.reset ();
+    REQUIRE (hot.checkLink () == false);
+    REQUIRE (hot.disconnections () == 2);
+    REQUIRE (remove (link.c_str ()) == 0);
 }
 
 
 TEST_CASE("RelayDriver", "[serial]") 
 {
-    // Start socat in the background
-    REQUIRE (system("socat -d2 PTY,link=/tmp/ttyS10,raw,echo=0 PTY,link=/tmp/ttyS11,raw,echo=0 &") == 0);
-    sleep (1); // Give socat time to start
+    PtyPeer sprel;
+    SerialPort spcmp (sprel.getPath (), 9600);
     
-    SerialPort spcmp ("/tmp/ttyS10", 9600);
-    SerialPort sprel ("/tmp/ttyS11", 9600);
-    
-    RelayDriver urd (spcmp, 8, 1);
+    RelayBoard <LcusProtocol> urd (LcusProtocol (spcmp), 8, 100);
     sprel.readFlush ();
     while (sprel.bytesToRead ()) sprel.readByte (); //to clean the commands send by the driver to check the status of the relays
     
@@ -360,24 +599,27 @@ TEST_CASE("RelayDriver", "[serial]")
 
     REQUIRE (sprel.readFlush () == 0);        
     
-    //turn on and check relay 9 with extra unuseful feedback data
+    //the channels are numbered from 1 to 8
+    REQUIRE_THROWS (urd.sendCommand (9, RelayDriver::Command::ON_CHECK));
+    
+    //turn on and check relay 8 with extra unuseful feedback data
     REQUIRE (sprel.writeByte (0xA0) == true);
     REQUIRE (sprel.writeByte (0xA0) == true);
     REQUIRE (sprel.writeByte (0xA0) == true);
     REQUIRE (sprel.writeByte (0xA0) == true);
-    REQUIRE (sprel.writeByte (0x09) == true);
+    REQUIRE (sprel.writeByte (0x08) == true);
     REQUIRE (sprel.writeByte (0x01) == true);
-    REQUIRE (sprel.writeByte (0xAA) == true);    
+    REQUIRE (sprel.writeByte (0xA9) == true);    
     REQUIRE (sprel.writeFlush () == 7);
     
-    REQUIRE (urd.sendCommand (9, RelayDriver::Command::ON_CHECK) == RelayDriver::Command::ON);
+    REQUIRE (urd.sendCommand (8, RelayDriver::Command::ON_CHECK) == RelayDriver::Command::ON);
     REQUIRE (urd.lastError () == RelayDriver::Error::NO);
 
     REQUIRE (sprel.readFlush () == 4);
     REQUIRE (sprel.readByte () == 0xA0);
-    REQUIRE (sprel.readByte () == 0x09);
+    REQUIRE (sprel.readByte () == 0x08);
     REQUIRE (sprel.readByte () == 0x03);
-    REQUIRE (sprel.readByte () == 0xAC);      
+    REQUIRE (sprel.readByte () == 0xAB);      
     
     //turn off and check relay 8 with fewer bytes than required 
     REQUIRE (sprel.writeByte (0xA0) == true);
@@ -400,8 +642,211 @@ TEST_CASE("RelayDriver", "[serial]")
     REQUIRE (urd.recvCommand () == RelayDriver::Command::OFF);
     REQUIRE (urd.lastError () == RelayDriver::Error::NO);
 
-    //Kill the socat process
-    REQUIRE(system("pkill socat") == 0);
+    //probe relays 2, 5 and 7 at once, the answers come out of order with some noise, relay 7 does not answer
+    for (uint8_t b : std::initializer_list <uint8_t> {0x55, 0xA0, 0x05, 0x01, 0xA6, 0xA0, 0x02, 0x01, 0xA3}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 9);
+    
+    REQUIRE (urd.probeChannels (std::vector <uint8_t> {2, 5, 7}) == 2);
+    REQUIRE (urd.lastError () == RelayDriver::Error::NORECV);
+    
+    REQUIRE (sprel.readFlush () == 12);
+    REQUIRE (sprel.readByte () == 0xA0);
+    REQUIRE (sprel.readByte () == 0x02);
+    REQUIRE (sprel.readByte () == 0x05);
+    REQUIRE (sprel.readByte () == 0xA7);
+    while (sprel.bytesToRead ()) sprel.readByte ();
+    
+    //the probed states are used to check the following feedbacks
+    REQUIRE (sprel.writeByte (0xA0) == true);
+    REQUIRE (sprel.writeByte (0x05) == true);
+    REQUIRE (sprel.writeByte (0x01) == true);
+    REQUIRE (sprel.writeByte (0xA6) == true);
+    REQUIRE (sprel.writeFlush () == 4);
+    
+    REQUIRE (urd.sendCommand (5, RelayDriver::Command::CHECK) == RelayDriver::Command::ON);
+    REQUIRE (urd.lastError () == RelayDriver::Error::NO);
+    sprel.readFlush ();
+    while (sprel.bytesToRead ()) sprel.readByte ();
+    
+    //a noise looking like a header does not hide the following frame
+    const unsigned long checksumErrors = urd.frameErrors ();
+    for (uint8_t b : std::initializer_list <uint8_t> {0xA0, 0x13, 0xA0, 0x05, 0x01, 0xA6}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 6);
+    
+    REQUIRE (urd.recvCommand () == RelayDriver::Command::ON);
+    REQUIRE (urd.lastError () == RelayDriver::Error::NO);
+    
+    //many channels are commanded at once, the feedbacks come out of order and relay 4 does not answer
+    for (uint8_t b : std::initializer_list <uint8_t> {0xA0, 0x03, 0x00, 0xA3, 0x55, 0xA0, 0x01, 0x01, 0xA2}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 9);
+    
+    const std::vector <RelayDriver::Result> results = urd.sendCommands ({{1, RelayDriver::Command::ON_CHECK}, {2, RelayDriver::Command::OFF}, {3, RelayDriver::Command::OFF_CHECK}, {4, RelayDriver::Command::CHECK}, {6, RelayDriver::Command::NONE}});
+    REQUIRE (results.size () == 5);
+    REQUIRE (results [0].channel == 1);
+    REQUIRE (results [0].feedback == RelayDriver::Command::ON);
+    REQUIRE (results [0].error == RelayDriver::Error::NO);
+    REQUIRE (results [1].feedback == RelayDriver::Command::NONE);
+    REQUIRE (results [1].error == RelayDriver::Error::NO);
+    REQUIRE (results [2].feedback == RelayDriver::Command::OFF);
+    REQUIRE (results [3].feedback == RelayDriver::Command::ERROR);
+    REQUIRE (results [3].error == RelayDriver::Error::NORECV);
+    REQUIRE (results [4].error == RelayDriver::Error::WRNGCOM);
+    REQUIRE (urd.lastError () == RelayDriver::Error::WRNGCOM);
+    
+    REQUIRE (sprel.readFlushUntil (16, 1000) == 16);
+    REQUIRE (sprel.readByte () == 0xA0);
+    REQUIRE (sprel.readByte () == 0x01);
+    REQUIRE (sprel.readByte () == 0x03);
+    REQUIRE (sprel.readByte () == 0xA4);
+    while (sprel.bytesToRead ()) sprel.readByte ();
+    
+    REQUIRE_THROWS (urd.sendCommands ({{1, RelayDriver::Command::ON}, {1, RelayDriver::Command::OFF}}));
+    REQUIRE_THROWS (urd.sendCommands ({{9, RelayDriver::Command::ON}}));
+    
+    //the commands leaving a channel in its confirmed state are not sent until the verify interval elapses, then the state is only checked
+    Clock::startVirtual (1741593600);
+    urd.setVerifyInterval (300);
+    
+    for (uint8_t b : std::initializer_list <uint8_t> {0xA0, 0x03, 0x01, 0xA4}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 4);
+    REQUIRE (urd.sendCommands ({{3, RelayDriver::Command::ON_CHECK}, {2, RelayDriver::Command::ON}}) [0].feedback == RelayDriver::Command::ON);
+    REQUIRE (sprel.readFlushUntil (8, 1000) == 8);
+    while (sprel.bytesToRead ()) sprel.readByte ();
+    
+    const unsigned long sent = urd.sentFrames ();
+    const unsigned long suppressed = urd.suppressedFrames ();
+    Clock::advance (299000);
+    
+    const std::vector <RelayDriver::Result> cached = urd.sendCommands ({{3, RelayDriver::Command::ON_CHECK}, {2, RelayDriver::Command::ON}});
+    REQUIRE (cached [0].feedback == RelayDriver::Command::ON);
+    REQUIRE (cached [0].error == RelayDriver::Error::NO);
+    REQUIRE (cached [1].feedback == RelayDriver::Command::NONE);
+    REQUIRE (urd.suppressedFrames () == suppressed + 2);
+    REQUIRE (urd.sentFrames () == sent);
+    REQUIRE (sprel.readFlushUntil (1, 100) == 0);
+    
+    //a state change is always sent
+    REQUIRE (urd.sendCommands ({{2, RelayDriver::Command::OFF}}) [0].error == RelayDriver::Error::NO);
+    REQUIRE (urd.sentFrames () == sent + 1);
+    REQUIRE (sprel.readFlushUntil (4, 1000) == 4);
+    while (sprel.bytesToRead ()) sprel.readByte ();
+    
+    //the relay was turned off by hand, the check finds it
+    Clock::advance (2000);
+    for (uint8_t b : std::initializer_list <uint8_t> {0xA0, 0x03, 0x00, 0xA3}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 4);
+    REQUIRE (urd.sendCommands ({{3, RelayDriver::Command::ON_CHECK}}) [0].error == RelayDriver::Error::WRNGSTA);
+    REQUIRE (sprel.readFlushUntil (4, 1000) == 4);
+    REQUIRE (sprel.readByte () == 0xA0);
+    REQUIRE (sprel.readByte () == 0x03);
+    REQUIRE (sprel.readByte () == RelayDriver::Command::CHECK);
+    REQUIRE (sprel.readByte () == 0xA8);
+    
+    Clock::stopVirtual ();
+    REQUIRE (urd.frameErrors () == checksumErrors + 1);
+    
+    //a frame split among two reads is completed by the second one
+    REQUIRE (sprel.writeByte (0xA0) == true);
+    REQUIRE (sprel.writeByte (0x05) == true);
+    REQUIRE (sprel.writeFlush () == 2);
+    
+    REQUIRE (urd.recvCommand () == RelayDriver::Command::ERROR);
+    REQUIRE (urd.lastError () == RelayDriver::Error::NORECV);
+    
+    REQUIRE (sprel.writeByte (0x01) == true);
+    REQUIRE (sprel.writeByte (0xA6) == true);
+    REQUIRE (sprel.writeFlush () == 2);
+    
+    REQUIRE (urd.recvCommand () == RelayDriver::Command::ON);
+    REQUIRE (urd.lastError () == RelayDriver::Error::NO);
+    
+    //a Modbus RTU module on the same line, the probe reads all the coils at once
+    const uint8_t writeCoil [] = {0x01, 0x05, 0x00, 0x00, 0xFF, 0x00};
+    REQUIRE (ModbusProtocol::crc16 (writeCoil, 6) == 0x3A8C);
+    
+    RelayBoard <ModbusProtocol> mrd (ModbusProtocol (spcmp, 1), 4, 100);
+    REQUIRE (mrd.lastError () == RelayDriver::Error::NORECV);
+    REQUIRE (sprel.readFlushUntil (8, 1000) == 8);
+    for (uint8_t b : std::initializer_list <uint8_t> {0x01, 0x01, 0x00, 0x00, 0x00, 0x04, 0x3D, 0xC9}) REQUIRE (sprel.readByte () == b);
+    
+    //the coil is written, its echo paces the read of the state
+    for (uint8_t b : std::initializer_list <uint8_t> {0x01, 0x05, 0x00, 0x01, 0xFF, 0x00, 0xDD, 0xFA, 0x01, 0x01, 0x01, 0x01, 0x90, 0x48}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 14);
+    
+    REQUIRE (mrd.sendCommand (2, RelayDriver::Command::ON_CHECK) == RelayDriver::Command::ON);
+    REQUIRE (mrd.lastError () == RelayDriver::Error::NO);
+    REQUIRE (sprel.readFlushUntil (16, 1000) == 16);
+    for (uint8_t b : std::initializer_list <uint8_t> {0x01, 0x05, 0x00, 0x01, 0xFF, 0x00, 0xDD, 0xFA, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01, 0xAC, 0x0A}) REQUIRE (sprel.readByte () == b);
+    
+    //a batch reads the range of the channels with feedback, relay 3 was turned on by hand
+    for (uint8_t b : std::initializer_list <uint8_t> {0x01, 0x05, 0x00, 0x00, 0xFF, 0x00, 0x8C, 0x3A, 0x01, 0x01, 0x01, 0x05, 0x91, 0x8B}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 14);
+    
+    const std::vector <RelayDriver::Result> coils = mrd.sendCommands ({{1, RelayDriver::Command::ON_CHECK}, {3, RelayDriver::Command::CHECK}});
+    REQUIRE (coils [0].feedback == RelayDriver::Command::ON);
+    REQUIRE (coils [0].error == RelayDriver::Error::NO);
+    REQUIRE (coils [1].error == RelayDriver::Error::WRNGSTA);
+    REQUIRE (sprel.readFlushUntil (16, 1000) == 16);
+    for (uint8_t b : std::initializer_list <uint8_t> {0x01, 0x05, 0x00, 0x00, 0xFF, 0x00, 0x8C, 0x3A, 0x01, 0x01, 0x00, 0x00, 0x00, 0x03, 0x7C, 0x0B}) REQUIRE (sprel.readByte () == b);
+    
+    //a corrupted reply is dropped
+    for (uint8_t b : std::initializer_list <uint8_t> {0x01, 0x01, 0x01, 0x05, 0x91, 0x8C}) REQUIRE (sprel.writeByte (b) == true);
+    REQUIRE (sprel.writeFlush () == 6);
+    
+    REQUIRE (mrd.sendCommand (3, RelayDriver::Command::CHECK) == RelayDriver::Command::ERROR);
+    REQUIRE (mrd.lastError () == RelayDriver::Error::WRNGCRC);
+    REQUIRE (mrd.frameErrors () > 0);
+}
+
+TEST_CASE("RelayEmulator", "[serial]") 
+{
+    RelayEmulator board (4);
+    SerialPort port (board.getPath (), 9600);
+    
+    //the channels beyond the board do not answer
+    RelayBoard <LcusProtocol> urd (LcusProtocol (port), 6, 50);
+    REQUIRE (urd.lastError () == RelayDriver::Error::NORECV);
+    REQUIRE (board.receivedFrames () == 6);
+    
+    REQUIRE (urd.sendCommand (1, RelayDriver::Command::ON_CHECK) == RelayDriver::Command::ON);
+    REQUIRE (board.getState (1) == true);
+    
+    const std::vector <RelayDriver::Result> results = urd.sendCommands ({{2, RelayDriver::Command::ON}, {3, RelayDriver::Command::ON_CHECK}, {4, RelayDriver::Command::NEGATE_CHECK}});
+    REQUIRE (results [1].feedback == RelayDriver::Command::ON);
+    REQUIRE (results [2].feedback == RelayDriver::Command::ON);
+    board.waitIdle ();
+    REQUIRE (board.getState (2) == true);
+    REQUIRE (board.takeActions ().size () == 4);
+    
+    //a late reply is still collected within the answer wait
+    board.setLatency (20);
+    REQUIRE (urd.sendCommand (1, RelayDriver::Command::OFF_CHECK) == RelayDriver::Command::OFF);
+    board.setLatency (0);
+    
+    //a split reply is completed by the following read
+    board.setSplitReplies (true);
+    REQUIRE (urd.sendCommand (1, RelayDriver::Command::ON_CHECK) == RelayDriver::Command::ON);
+    board.setSplitReplies (false);
+    
+    //a dropped reply is not received, a corrupted one is reported as such
+    board.setDropEvery (1);
+    REQUIRE (urd.sendCommand (2, RelayDriver::Command::CHECK) == RelayDriver::Command::ERROR);
+    REQUIRE (urd.lastError () == RelayDriver::Error::NORECV);
+    board.setDropEvery (0);
+    
+    board.setCorruptEvery (1);
+    REQUIRE (urd.sendCommand (2, RelayDriver::Command::CHECK) == RelayDriver::Command::ERROR);
+    REQUIRE (urd.lastError () == RelayDriver::Error::WRNGCRC);
+    board.setCorruptEvery (0);
+    
+    //a stuck relay does not follow the command
+    board.setStuck (3, true);
+    REQUIRE (urd.sendCommand (3, RelayDriver::Command::OFF_CHECK) == RelayDriver::Command::ERROR);
+    REQUIRE (urd.lastError () == RelayDriver::Error::WRNGSTA);
+    REQUIRE (board.getState (3) == true);
+    
+    board.setStuck (3, false);
+    REQUIRE (urd.sendCommand (3, RelayDriver::Command::OFF_CHECK) == RelayDriver::Command::OFF);
 }
 
 TEST_CASE("CapacityReader", "[file]") 
@@ -457,10 +902,555 @@ TEST_CASE("CapacityReader", "[file]")
     
     REQUIRE (cr.readCapacity () == 100);   
     REQUIRE (cr.deltaCapacity () == 0);
+    REQUIRE (cr.isReadValid () == true);
     
     cw.close ();
+    
+    //a wrong content or a removed battery keep the last capacity read until it comes back
+    cw.open ("./capacity");
+    cw << "x\n";
+    cw.flush ();
+    
+    REQUIRE (cr.readCapacity () == 100);
+    REQUIRE (cr.isReadValid () == false);
+    REQUIRE (cr.deltaCapacity () == 0);
+    
+    cw.close ();
+    REQUIRE (remove ("./capacity") == 0);
+    
+    REQUIRE (cr.readCapacity () == 100);
+    REQUIRE (cr.isReadValid () == false);
+    
+    cw.open ("./capacity");
+    cw << "95\n";    
+    cw.flush ();
+    
+    REQUIRE (cr.readCapacity () == 95);
+    REQUIRE (cr.isReadValid () == true);
+    REQUIRE (cr.deltaCapacity () == -5);
+    
+    cw.close ();
+    
+    std::ofstream wrong ("./wrongcapacity");
+    wrong << "101\n";
+    wrong.close ();
+    
+    REQUIRE_THROWS (CapacityReader ("./wrongcapacity"));
+    REQUIRE_THROWS (CapacityReader ("./missingcapacity"));
 }     
 
+TEST_CASE("BatteryReader", "[file]") 
+{
+    REQUIRE (BatteryReader::onlinePath ("/sys/class/power_supply/BAT0/capacity", "AC") == "/sys/class/power_supply/AC/online");
+    REQUIRE (BatteryReader::capacityToString (55.0) == "55");
+    REQUIRE (BatteryReader::capacityToString (55.34) == "55.3");
+    REQUIRE (BatteryReader::capacityToString (-0.96) == "-1");
+    
+    REQUIRE (system ("rm -rf ./battery ./AC && mkdir -p ./battery ./AC") == 0);
+    
+    auto write = [] (const std::string& file, const std::string& value) 
+    {
+        std::ofstream f (file, std::ios::trunc); 
+        f << value << '\n';
+    };
+    
+    //only the integer capacity is available
+    write ("./battery/capacity", "55");
+    
+    BatteryReader br ("./battery/capacity", "./AC/online");
+    
+    REQUIRE (br.getSample ().capacity == Approx (55.0));
+    REQUIRE (br.getSample ().valid == true);
+    REQUIRE (br.getSample ().rateValid == false);
+    REQUIRE (br.getSample ().acOnline == -1);
+    REQUIRE (br.getSample ().status == BatterySample::Status::UNKNOWN);
+    
+    //the missing files are not looked for at every sample, only once the battery was lost and read again
+    write ("./battery/status", "Charging");
+    write ("./battery/energy_now", "27700000");
+    write ("./battery/energy_full", "50000000");
+    write ("./battery/power_now", "10000000");
+    write ("./AC/online", "1");
+    
+    br.readSample ();
+    REQUIRE (br.getSample ().capacity == Approx (55.0));
+    REQUIRE (br.getSample ().status == BatterySample::Status::UNKNOWN);
+    
+    write ("./battery/capacity", "x");
+    br.readSample ();
+    REQUIRE (br.getSample ().valid == false);
+    
+    write ("./battery/capacity", "55");
+    br.readSample ();
+    REQUIRE (br.getSample ().capacity == Approx (55.4));
+    REQUIRE (br.getSample ().status == BatterySample::Status::CHARGING);
+    REQUIRE (br.getSample ().rateValid == true);
+    REQUIRE (br.getSample ().rate * 3600.0 == Approx (20.0));
+    REQUIRE (br.getSample ().acOnline == 1);
+    REQUIRE (br.deltaCapacity () == Approx (0.4));
+    REQUIRE (br.toString () == "The current battery capacity is: 55.4%, status: charging, rate: 20%/h, charger power supply: online");
+    
+    //the charger unplugged
+    write ("./battery/status", "Discharging");
+    write ("./battery/energy_now", "27650000");
+    write ("./AC/online", "0");
+    
+    br.readSample ();
+    REQUIRE (br.getSample ().capacity == Approx (55.3));
+    REQUIRE (br.getSample ().rate * 3600.0 == Approx (-20.0));
+    REQUIRE (br.getSample ().acOnline == 0);
+    
+    //a fractional capacity far from the integer one is ignored
+    write ("./battery/energy_now", "40000000");
+    br.readSample ();
+    REQUIRE (br.getSample ().capacity == Approx (55.0));
+    
+    //the charge and current are used if the energy is not available
+    REQUIRE (system ("rm ./battery/energy_now ./battery/energy_full ./battery/power_now") == 0);
+    write ("./battery/capacity", "80");
+    write ("./battery/charge_now", "4030000");
+    write ("./battery/charge_full", "5000000");
+    write ("./battery/current_now", "1000000");
+    
+    BatteryReader bc ("./battery/capacity");
+    REQUIRE (bc.getSample ().capacity == Approx (80.6));
+    REQUIRE (bc.getSample ().rate * 3600.0 == Approx (-20.0));
+    REQUIRE (bc.getSample ().acOnline == -1);
+    
+    //a removed battery keeps the last capacity
+    write ("./battery/capacity", "x");
+    bc.readSample ();
+    REQUIRE (bc.getSample ().valid == false);
+    REQUIRE (bc.getSample ().capacity == Approx (80.6));
+    REQUIRE (bc.getSample ().rateValid == false);
+    
+    REQUIRE (system ("rm -rf ./battery ./AC") == 0);
+    
+    REQUIRE_THROWS (BatteryReader ("./battery/capacity"));
+}
+
+TEST_CASE("BatterySource", "[file]") 
+{
+    REQUIRE (system ("rm -rf ./BAT0 ./BAT1 ./AC && mkdir -p ./BAT0 ./BAT1 ./AC") == 0);
+    
+    auto write = [] (const std::string& file, const std::string& value) 
+    {
+        std::ofstream f (file, std::ios::trunc); 
+        f << value << '\n';
+    };
+    
+    //a small internal battery almost full and a large external one almost empty
+    write ("./BAT0/capacity", "90");
+    write ("./BAT0/energy_now", "21600000");
+    write ("./BAT0/energy_full", "24000000");
+    write ("./BAT0/power_now", "0");
+    write ("./BAT0/status", "Full");
+    write ("./BAT1/capacity", "10");
+    write ("./BAT1/energy_now", "7200000");
+    write ("./BAT1/energy_full", "72000000");
+    write ("./BAT1/power_now", "18000000");
+    write ("./BAT1/status", "Charging");
+    write ("./AC/online", "1");
+    
+    BatterySource bs ({"./BAT0/capacity", "./BAT1/capacity"}, "./AC/online");
+    
+    REQUIRE (bs.getPacks ().size () == 2);
+    REQUIRE (bs.getPaths () == std::vector <std::string> {"./BAT0/capacity", "./BAT1/capacity"});
+    REQUIRE (bs.getSample ().capacity == Approx (30.0));
+    REQUIRE (bs.getSample ().status == BatterySample::Status::CHARGING);
+    REQUIRE (bs.getSample ().rateValid == true);
+    REQUIRE (bs.getSample ().rate * 3600.0 == Approx (18.75));
+    REQUIRE (bs.getSample ().acOnline == 1);
+    REQUIRE (bs.getSample ().valid == true);
+    
+    write ("./BAT1/energy_now", "16800000");
+    write ("./BAT1/capacity", "23");
+    
+    bs.readSample ();
+    REQUIRE (bs.getSample ().capacity == Approx (40.0));
+    REQUIRE (bs.deltaCapacity () == Approx (10.0));
+    REQUIRE (bs.getPacks () [1].getSample ().capacity == Approx (23.3333));
+    
+    //without the energy of every battery the capacities are averaged
+    write ("./BAT1/energy_now", "x");
+    bs.readSample ();
+    REQUIRE (bs.getSample ().capacity == Approx (56.5));
+    REQUIRE (bs.getSample ().rateValid == false);
+    
+    //a removed battery is left out
+    write ("./BAT1/capacity", "x");
+    bs.readSample ();
+    REQUIRE (bs.getSample ().valid == true);
+    REQUIRE (bs.getSample ().capacity == Approx (90.0));
+    REQUIRE (bs.getSample ().status == BatterySample::Status::FULL);
+    
+    write ("./BAT0/capacity", "x");
+    bs.readSample ();
+    REQUIRE (bs.getSample ().valid == false);
+    REQUIRE (bs.getSample ().capacity == Approx (90.0));
+    
+    //a single battery is reported as it is
+    write ("./BAT0/capacity", "90");
+    BatterySource single ({"./BAT0/capacity"});
+    REQUIRE (single.getSample ().capacity == Approx (90.0));
+    REQUIRE (single.toString () == single.getPacks () [0].toString ());
+    
+    REQUIRE (system ("rm -rf ./BAT0 ./BAT1 ./AC") == 0);
+    
+    REQUIRE_THROWS (BatterySource ({}));
+    REQUIRE_THROWS (BatterySource ({"./BAT0/capacity"}));
+}
+
+TEST_CASE("SampleHistory", "[history]") 
+{
+    REQUIRE_THROWS (SampleHistory (0));
+    
+    SampleHistory sh (4);
+    SampleHistory::Record record {};
+    
+    REQUIRE (sh.capacity () == 4);
+    REQUIRE (sh.size () == 0);
+    REQUIRE (sh.last (record) == false);
+    REQUIRE (sh.snapshot ().empty ());
+    
+    BatterySample sample {};
+    sample.capacity = 55.5;
+    sample.status = BatterySample::Status::CHARGING;
+    sample.acOnline = 1;
+    sample.valid = true;
+    
+    sh.push (SampleHistory::toRecord (1000, sample));
+    REQUIRE (sh.size () == 1);
+    REQUIRE (sh.last (record) == true);
+    REQUIRE (record.wallMs == 1000);
+    REQUIRE (record.capacity == Approx (55.5));
+    REQUIRE (record.status == static_cast <int8_t> (BatterySample::Status::CHARGING));
+    REQUIRE (record.acOnline == 1);
+    REQUIRE (record.valid == true);
+    REQUIRE (record.rateValid == false);
+    
+    //the oldest records are overwritten
+    for (long long t = 2; t <= 6; ++ t) 
+    {
+        sample.capacity = static_cast <double> (t);
+        sh.push (SampleHistory::toRecord (t * 1000, sample));
+    }
+    
+    REQUIRE (sh.size () == 4);
+    
+    const std::vector <SampleHistory::Record> records = sh.snapshot ();
+    REQUIRE (records.size () == 4);
+    for (size_t i = 0; i < 4; ++ i) REQUIRE (records [i].wallMs == static_cast <long long> (i + 3) * 1000);
+    
+    SampleHistory::Record two [2];
+    REQUIRE (sh.snapshot (two, 2) == 2);
+    REQUIRE (two [0].capacity == Approx (5.0));
+    REQUIRE (two [1].capacity == Approx (6.0));
+    
+    //a reader on another thread always sees consistent and consecutive records while the writer goes on
+    SampleHistory shared (64);
+    std::atomic <bool> done {false};
+    bool consistent = true;
+    
+    std::thread reader ([&] 
+    {
+        SampleHistory::Record copy [64];
+        while (not done.load ())
+        {
+            const size_t n = shared.snapshot (copy, 64);
+            for (size_t i = 0; i < n; ++ i) 
+            {
+                if (copy [i].capacity != static_cast <double> (copy [i].wallMs) or copy [i].rate != - copy [i].capacity) consistent = false;
+                if (i and copy [i].wallMs != copy [i - 1].wallMs + 1) consistent = false;
+            }
+        }
+    });
+    
+    for (long long t = 1; t <= 200000; ++ t)
+    {
+        SampleHistory::Record r {};
+        r.wallMs = t;
+        r.capacity = static_cast <double> (t);
+        r.rate = - r.capacity;
+        shared.push (r);
+    }
+    
+    done.store (true);
+    reader.join ();
+    
+    REQUIRE (consistent == true);
+    REQUIRE (shared.last (record) == true);
+    REQUIRE (record.wallMs == 200000);
+}
+
+TEST_CASE("HistoryStore", "[history]") 
+{
+    remove ("./history");
+    
+    REQUIRE_THROWS (HistoryStore ("./history", true));
+    REQUIRE_THROWS (HistoryStore ("./missingdir/history"));
+    
+    //more records than a segment, one every minute
+    const long long start = 1741593600000LL;
+    const size_t records = HistoryStore::recordsPerSegment * 2 + 100;
+    
+    {
+        HistoryStore hs ("./history");
+        HistoryStore::Record record {};
+        
+        REQUIRE (hs.size () == 0);
+        REQUIRE (hs.last (record) == false);
+        
+        for (size_t i = 0; i < records; ++ i)
+        {
+            record.wallMs = start + static_cast <long long> (i) * 60000;
+            record.capacity = static_cast <float> (i % 100);
+            record.charger = i % 2;
+            hs.append (record);
+        }
+        
+        REQUIRE (hs.size () == records);
+    }
+    
+    //the records survive the restart and the new ones are appended
+    HistoryStore hs ("./history");
+    REQUIRE (hs.size () == records);
+    
+    HistoryStore::Record record {};
+    REQUIRE (hs.last (record) == true);
+    REQUIRE (record.wallMs == start + static_cast <long long> (records - 1) * 60000);
+    
+    //a time going backward is raised to the last one
+    record.wallMs = start;
+    record.capacity = 42.5f;
+    hs.append (record);
+    REQUIRE (hs.last (record) == true);
+    REQUIRE (record.wallMs == start + static_cast <long long> (records - 1) * 60000);
+    REQUIRE (record.capacity == Approx (42.5));
+    
+    //the queries cross the segments
+    std::vector <HistoryStore::Record> found;
+    REQUIRE (hs.query (start + (HistoryStore::recordsPerSegment - 5) * 60000LL, start + (HistoryStore::recordsPerSegment + 5) * 60000LL, found) == 10);
+    REQUIRE (found.front ().wallMs == start + (HistoryStore::recordsPerSegment - 5) * 60000LL);
+    REQUIRE (found.back ().wallMs == start + (HistoryStore::recordsPerSegment + 4) * 60000LL);
+    REQUIRE (found [1].capacity == Approx (static_cast <float> ((HistoryStore::recordsPerSegment - 4) % 100)));
+    
+    found.clear ();
+    REQUIRE (hs.query (start - 60000, start + 1, found) == 1);
+    REQUIRE (hs.query (0, start, found) == 0);
+    REQUIRE (hs.query (start + static_cast <long long> (records) * 60000, start + static_cast <long long> (records + 10) * 60000, found) == 0);
+    
+    found.clear ();
+    REQUIRE (hs.query (0, LLONG_MAX, found) == records + 1);
+    
+    //another process can read while the file is written
+    HistoryStore reader ("./history", true);
+    REQUIRE (reader.size () == records + 1);
+    REQUIRE_THROWS (reader.append (record));
+    
+    record.wallMs += 60000;
+    hs.append (record);
+    REQUIRE (reader.size () == records + 2);
+    REQUIRE (reader.last (record) == true);
+    REQUIRE (record.wallMs == start + static_cast <long long> (records) * 60000);
+    
+    std::ofstream wrong ("./wronghistory");
+    wrong << "not a history\n";
+    wrong.close ();
+    REQUIRE_THROWS (HistoryStore ("./wronghistory"));
+    
+    remove ("./history");
+    remove ("./wronghistory");
+}
+
+TEST_CASE("SessionJournal", "[history]") 
+{
+    remove ("./sessions");
+    
+    REQUIRE_THROWS (SessionJournal ("./sessions", true));
+    REQUIRE_THROWS (SessionJournal ("./missingdir/sessions"));
+    
+    const long long start = 1741593600000LL;
+    
+    {
+        SessionJournal sj ("./sessions");
+        
+        REQUIRE (sj.size () == 0);
+        REQUIRE (sj.isOpen () == false);
+        REQUIRE_THROWS (sj.closeSession (start, 50.0, -1.0, SessionJournal::Cause::MAX_THRESHOLD));
+        
+        sj.openSession (start, 20.5, 10.0, "a profile with a name longer than the record", SessionJournal::Cause::MIN_THRESHOLD);
+        REQUIRE (sj.isOpen () == true);
+        REQUIRE_THROWS (sj.openSession (start, 20.5, 10.0, "home", SessionJournal::Cause::USER_COMMAND));
+        
+        sj.closeSession (start + 3600000, 80.0, 40.5, SessionJournal::Cause::MAX_THRESHOLD);
+        REQUIRE (sj.isOpen () == false);
+        
+        //the session left open at exit is continued after the restart
+        sj.openSession (start + 7200000, 30.0, -1.0, "trip", SessionJournal::Cause::PROFILE_CHANGE);
+        REQUIRE (sj.size () == 2);
+    }
+    
+    SessionJournal sj ("./sessions");
+    REQUIRE (sj.size () == 2);
+    REQUIRE (sj.isOpen () == true);
+    
+    SessionJournal reader ("./sessions", true);
+    std::vector <SessionJournal::Record> found;
+    REQUIRE (reader.query (0, LLONG_MAX, found) == 2);
+    REQUIRE (found [0].startMs == start);
+    REQUIRE (found [0].endMs == start + 3600000);
+    REQUIRE (found [0].startCapacity == Approx (20.5));
+    REQUIRE (found [0].endCapacity == Approx (80.0));
+    REQUIRE (SessionJournal::energyDelivered (found [0]) == Approx (30.5));
+    REQUIRE (std::string (found [0].profile) == std::string ("a profile with a name longer than the record").substr (0, SessionJournal::profileNameSize - 1));
+    REQUIRE (SessionJournal::causeToString (found [0].startCause) == "min_threshold");
+    REQUIRE (SessionJournal::causeToString (found [0].endCause) == "max_threshold");
+    REQUIRE (found [1].endMs == 0);
+    REQUIRE (SessionJournal::energyDelivered (found [1]) < 0.0);
+    REQUIRE_THROWS (reader.closeSession (start, 50.0, -1.0, SessionJournal::Cause::EXIT));
+    
+    //a time going backward does not end the session before its start
+    sj.closeSession (start, 90.0, -1.0, SessionJournal::Cause::EXIT);
+    REQUIRE (sj.isOpen () == false);
+    
+    found.clear ();
+    REQUIRE (reader.query (start + 7200000, LLONG_MAX, found) == 1);
+    REQUIRE (found [0].endMs == start + 7200001);
+    REQUIRE (found [0].endCause == SessionJournal::Cause::EXIT);
+    REQUIRE (std::string (found [0].profile) == "trip");
+    REQUIRE (SessionJournal::energyDelivered (found [0]) < 0.0);
+    
+    found.clear ();
+    REQUIRE (reader.query (start + 3600000, start + 7200000, found) == 1);
+    REQUIRE (reader.query (0, start, found) == 0);
+    REQUIRE (reader.query (start + 7200002, LLONG_MAX, found) == 0);
+    
+    //a record partially written is dropped at the next start
+    std::ofstream partial ("./sessions", std::ios::app | std::ios::binary);
+    partial << "partial";
+    partial.close ();
+    {
+        SessionJournal sj2 ("./sessions");
+        REQUIRE (sj2.size () == 2);
+        REQUIRE (sj2.isOpen () == false);
+    }
+    
+    std::ofstream wrong ("./wrongsessions");
+    wrong << "not a journal\n";
+    wrong.close ();
+    REQUIRE_THROWS (SessionJournal ("./wrongsessions"));
+    
+    remove ("./sessions");
+    remove ("./wrongsessions");
+}
+
+TEST_CASE("RollupStore", "[history]") 
+{
+    REQUIRE (RollupStore::parseStep ("15m") == 900000);
+    REQUIRE (RollupStore::parseStep ("2h") == 7200000);
+    REQUIRE (RollupStore::parseStep ("1d") == 86400000);
+    REQUIRE (RollupStore::parseStep ("90") == 90000);
+    REQUIRE_THROWS (RollupStore::parseStep ("1w"));
+    REQUIRE_THROWS (RollupStore::parseStep ("-1h"));
+    REQUIRE_THROWS (RollupStore::parseStep ("h"));
+    
+    //Monday 2025-03-10 00:00:00 local time
+    struct tm date {};
+    date.tm_year = 125; date.tm_mon = 2; date.tm_mday = 10; date.tm_isdst = -1;
+    const long long start = static_cast <long long> (mktime (& date)) * 1000LL;
+    const long long hour = 3600000LL;
+    
+    REQUIRE (RollupStore::bucketStart (RollupStore::DAY, start + 5 * hour) == start);
+    REQUIRE (RollupStore::nextBucket (RollupStore::DAY, start) == start + 24 * hour);
+    REQUIRE (RollupStore::bucketStart (RollupStore::MINUTE, start + 61000) == start + 60000);
+    
+    REQUIRE (RollupStore::selectLevel (start, start + 48 * hour, 24 * hour) == RollupStore::DAY);
+    REQUIRE (RollupStore::selectLevel (start, start + 48 * hour, 2 * hour) == RollupStore::HOUR);
+    REQUIRE (RollupStore::selectLevel (start + hour, start + 48 * hour, 24 * hour) == RollupStore::HOUR);
+    REQUIRE (RollupStore::selectLevel (start + 60000, start + 48 * hour, hour) == RollupStore::MINUTE);
+    REQUIRE_THROWS (RollupStore::selectLevel (start, start + hour, 30000));
+    REQUIRE_THROWS (RollupStore::selectLevel (start, start, hour));
+    
+    remove ("./rollup");
+    
+    {
+        RollupStore rs ("./rollup");
+        
+        //two days sampled every minute: the charger is on every other hour, the profile changes every 12 hours
+        double capacity = 50.0;
+        for (long long i = 0; i < 2880; ++ i)
+        {
+            const bool charger = (i / 60) % 2 == 0;
+            rs.add (start + i * 60000, capacity, capacity / 2.0, charger, static_cast <size_t> ((i / 720) % 2), true);
+            capacity += charger ? 0.1 : -0.1;
+        }
+    }
+    
+    //the rollups survive the restart
+    const RollupStore rs ("./rollup", true);
+    
+    std::vector <RollupStore::Bucket> days = rs.query (start, start + 48 * hour, 24 * hour);
+    REQUIRE (days.size () == 2);
+    REQUIRE (days [0].startMs == start);
+    REQUIRE (days [0].samples == 1440);
+    REQUIRE (days [0].minCapacity == Approx (50.0).epsilon (0.001));
+    REQUIRE (days [0].maxCapacity == Approx (56.0).epsilon (0.001));
+    REQUIRE (days [0].sumCapacity / days [0].samples == Approx (53.0).epsilon (0.01));
+    REQUIRE (days [0].coveredSeconds == Approx (1439 * 60.0));
+    REQUIRE (days [0].chargingSeconds == Approx (720 * 60.0));
+    REQUIRE (days [0].profileSeconds [0] == Approx (720 * 60.0));
+    REQUIRE (days [0].profileSeconds [1] == Approx (719 * 60.0));
+    REQUIRE (days [0].chargedPercent == Approx (72.0).epsilon (0.001));
+    REQUIRE (days [0].dischargedPercent == Approx (71.9).epsilon (0.001));
+    REQUIRE (days [0].energyInWh == Approx (36.0).epsilon (0.001));
+    REQUIRE (days [0].energyOutWh == Approx (35.95).epsilon (0.001));
+    REQUIRE (days [1].samples == 1440);
+    REQUIRE (days [1].coveredSeconds == Approx (1440 * 60.0));
+    
+    //a year summary is a single bucket
+    std::vector <RollupStore::Bucket> year = rs.query (start, start + 365 * 24 * hour, 365 * 24 * hour);
+    REQUIRE (year.size () == 1);
+    REQUIRE (year [0].samples == 2880);
+    REQUIRE (year [0].chargingSeconds == Approx (1440 * 60.0));
+    
+    std::vector <RollupStore::Bucket> hours = rs.query (start, start + 2 * hour, hour);
+    REQUIRE (hours.size () == 2);
+    REQUIRE (hours [0].samples == 60);
+    REQUIRE (hours [0].chargingSeconds == Approx (59 * 60.0));
+    REQUIRE (hours [1].startMs == start + hour);
+    REQUIRE (hours [1].chargingSeconds == Approx (60.0));
+    REQUIRE (hours [1].maxCapacity == Approx (56.0).epsilon (0.001));
+    
+    //the minutes are used if the intervals do not begin at an hour
+    std::vector <RollupStore::Bucket> minutes = rs.query (start + 30 * 60000, start + 90 * 60000, 30 * 60000);
+    REQUIRE (minutes.size () == 2);
+    REQUIRE (minutes [0].samples == 30);
+    REQUIRE (minutes [0].chargingSeconds == Approx (30 * 60.0));
+    REQUIRE (minutes [1].chargingSeconds == Approx (60.0));
+    
+    //the time batguard was not running is not accounted
+    REQUIRE (rs.query (start - 24 * hour, start, hour).empty ());
+    {
+        RollupStore writer ("./rollup");
+        writer.add (start + 60 * hour, 50.0, -1.0, false, 0, true);
+        REQUIRE_THROWS (rs.query (start, start + hour, 0));
+    }
+    std::vector <RollupStore::Bucket> gap = rs.query (start + 60 * hour, start + 61 * hour, hour);
+    REQUIRE (gap.size () == 1);
+    REQUIRE (gap [0].coveredSeconds == Approx (3600.0));
+    REQUIRE (gap [0].energyInWh == Approx (0.0));
+    
+    std::ofstream wrong ("./wrongrollup");
+    wrong << "not a rollup\n";
+    wrong.close ();
+    REQUIRE_THROWS (RollupStore ("./wrongrollup"));
+    REQUIRE_THROWS (RollupStore ("./missingrollup", true));
+    
+    remove ("./rollup");
+    remove ("./wrongrollup");
+}
+
 TEST_CASE("LogWriter", "[file]") 
 {
     int index = 0;
@@ -617,6 +1607,18 @@ TEST_CASE("StateFile", "[file]")
     trim (line);
     REQUIRE (line == "home");
     
+    //only the changes not read or written by the state file itself are noticed
+    REQUIRE (rfm.isChangedOnFile () == false);
+    std::ofstream ("./runfile") << "#chargeron\n";
+    REQUIRE (rfm.isChangedOnFile () == true);
+    REQUIRE (rfm.write (cp.getProfileWithName ("home")) == StateFile::Error::NO);
+    REQUIRE (rfm.isChangedOnFile () == false);
+    
+    StateFile rfo ("./runfile", cp);
+    REQUIRE (rfo.isChangedOnFile () == true);
+    REQUIRE (rfo.read () == StateFile::Error::NO);
+    REQUIRE (rfo.isChangedOnFile () == false);
+    
     REQUIRE (rfm.read () == StateFile::Error::NO);    
     REQUIRE (rfm.chargerInit () == StateFile::State::LAST);
     REQUIRE (rfm.schedulerInit () == StateFile::State::LAST);
@@ -1000,5 +2002,423 @@ TEST_CASE("ProfileSchedules", "[schedule]")
     now.tm_hour = 21;
     now.tm_min = 31;            
     REQUIRE (sc.getScheduleTriggered (mktime (& now)) == nullptr);
-        
+    
+    struct tm next = now;
+    
+    now.tm_hour = 17;
+    now.tm_min = 30;
+    next.tm_hour = 18;
+    next.tm_min = 1;
+    REQUIRE (sc.getNextTransition (mktime (& now)) == mktime (& next));
+    
+    now.tm_hour = 20;
+    now.tm_min = 30;
+    next.tm_hour = 21;
+    next.tm_min = 1;
+    REQUIRE (sc.getNextTransition (mktime (& now)) == mktime (& next));
+    
+    now.tm_hour = 21;
+    now.tm_min = 40;
+    next.tm_mday = 21;
+    next.tm_hour = 12;
+    next.tm_min = 0;
+    REQUIRE (sc.getNextTransition (mktime (& now)) == mktime (& next));
+    REQUIRE (sc.getNextTransition (mktime (& now), 0) == 0);
+    
+    ProfileSchedules scm;
+    scm.addSchedule (ProfileSchedule (true, {false, false, false, false, false, false, false, false, false, false, false, true}, std::vector<bool> (31, true), {false, true, false, false, false, false, false}, HourMin ({8,30}), HourMin ({9,00}), cp.getProfileWithName ("trip")));
+    scm.setEnable (true);
+    
+    now.tm_mon = 10;
+    now.tm_mday = 20;
+    now.tm_hour = 10;
+    now.tm_min = 0;
+    next.tm_mon = 11;
+    next.tm_mday = 2;
+    next.tm_hour = 8;
+    next.tm_min = 30;
+    REQUIRE (scm.getNextTransition (mktime (& now)) == mktime (& next));
+    
+    next.tm_hour = 9;
+    next.tm_min = 1;
+    now.tm_mon = 11;
+    now.tm_mday = 2;
+    now.tm_hour = 8;
+    now.tm_min = 45;
+    REQUIRE (scm.getNextTransition (mktime (& now)) == mktime (& next));
+    
+    scm.setEnable (false);
+    REQUIRE (scm.getNextTransition (mktime (& now)) == 0);
 }    
+
+TEST_CASE("ChargeRateEstimator", "[rate]") 
+{
+    REQUIRE_THROWS (ChargeRateEstimator (0.0));
+    REQUIRE_THROWS (ChargeRateEstimator (1.5));
+    
+    ChargeRateEstimator re (0.5);
+    REQUIRE (re.hasRate (true) == false);
+    REQUIRE (re.hasRate (false) == false);
+    REQUIRE (re.secondsToReach (80, true) < 0.0);
+    
+    //charging 1% every 60 seconds, the equal readings do not measure any slope
+    re.addSample (50, 0, true);
+    re.addSample (50, 30, true);
+    REQUIRE (re.hasRate (true) == false);
+    re.addSample (51, 60, true);
+    REQUIRE (re.hasRate (true) == true);
+    REQUIRE (re.rate (true) * 60.0 == Approx (1.0));
+    REQUIRE (re.secondsToReach (61, true) == Approx (600.0));
+    
+    //a faster slope is smoothed with weight 0.5
+    re.addSample (54, 120, true);
+    REQUIRE (re.rate (true) * 60.0 == Approx (2.0));
+    REQUIRE (re.secondsToReach (50, true) < 0.0);
+    
+    //the charger change restarts the measure without mixing the states
+    re.addSample (53, 180, false);
+    REQUIRE (re.hasRate (false) == false);
+    re.addSample (51, 300, false);
+    REQUIRE (re.rate (false) * 60.0 == Approx (-1.0));
+    REQUIRE (re.secondsToReach (49, false) == Approx (120.0));
+    REQUIRE (re.rate (true) * 60.0 == Approx (2.0));
+}
+
+TEST_CASE("BatDevice adaptive polling", "[rate]") 
+{
+    REQUIRE (system ("rm -rf ./adaptive && mkdir ./adaptive") == 0);
+    RelayEmulator board (1);
+    SerialPort port (board.getPath (), 9600);
+    RelayBoard <LcusProtocol> relay (LcusProtocol (port), 1, 100);
+    LogWriter logWriter ("./adaptive/log", 1, 0, 1, 3);
+    
+    //discharging at 10% per hour from 55%, the min charge 50% is reached in 30 minutes
+    std::ofstream ("./adaptive/capacity") << "55\n";
+    std::ofstream ("./adaptive/status") << "Discharging\n";
+    std::ofstream ("./adaptive/energy_full") << "50000000\n";
+    std::ofstream ("./adaptive/energy_now") << "27500000\n";
+    
+    //the sleep of the first cycle, the rate comes from the battery since the estimator has no samples yet
+    auto firstSleep = [&] (const std::string& adaptive)
+    {
+        std::ofstream ("./adaptive/config") << "pollingtime = 120\nadaptivepolling = " << adaptive << "\nprofile = home, 50, 60, off\n";
+        BatDevice device ("", ConfigReader (BatDevice::configurationTemplate (), "./adaptive/config"), relay, logWriter, "./adaptive");
+        
+        const long long now = Clock::monotonicMs ();
+        device.endCycle (now, relay.sendCommands ({device.beginCycle ()}).front ());
+        const unsigned long timeout = device.msToNextCycle (now);
+        
+        //a power supply change makes the next cycle due at once
+        device.requestCycle ();
+        REQUIRE (device.msToNextCycle (now) == 0);
+        
+        return timeout;
+    };
+    
+    //half of the time to the threshold itself
+    std::ofstream ("./adaptive/power_now") << "5000000\n";
+    REQUIRE (firstSleep ("on, 10, 3600") == 900000);
+    REQUIRE (firstSleep ("on, 10, 600") == 600000);
+    REQUIRE (firstSleep ("on, 1000, 2000") == 1000000);
+    
+    //without any rate the polling time is used within the same bounds
+    REQUIRE (unlink ("./adaptive/power_now") == 0);
+    REQUIRE (firstSleep ("on, 10, 3600") == 120000);
+    REQUIRE (firstSleep ("on, 10, 60") == 60000);
+    REQUIRE (firstSleep ("on, 300, 600") == 300000);
+    
+    REQUIRE (system ("rm -rf ./adaptive") == 0);
+}
+
+TEST_CASE("Clock", "[clock]") 
+{
+    REQUIRE (Clock::isVirtual () == false);
+    REQUIRE (std::abs (Clock::wallTime () - time (nullptr)) <= 1);
+    
+    //Monday 2025-03-10 07:59:00
+    struct tm date {};
+    date.tm_year = 125; date.tm_mon = 2; date.tm_mday = 10; date.tm_hour = 7; date.tm_min = 59; date.tm_isdst = -1;
+    const time_t start = mktime (& date);
+    
+    Clock::startVirtual (start);
+    REQUIRE (Clock::isVirtual () == true);
+    REQUIRE (Clock::wallTime () == start);
+    REQUIRE (Clock::monotonicMs () == 0);
+    
+    Clock::advance (1500);
+    REQUIRE (Clock::wallMs () == start * 1000LL + 1500);
+    REQUIRE (Clock::monotonicMs () == 1500);
+    REQUIRE (ChargeRateEstimator::monotonicSeconds () == Approx (1.5));
+    
+    //the schedules read the virtual clock when the time is not given
+    ChargeProfiles cp;
+    cp.addProfile (ChargeProfile ("home", 50, 60, false));
+    cp.addProfile (ChargeProfile ("work", 70, 80, true));
+    
+    ProfileSchedules ps;
+    ps.addSchedule (ProfileSchedule (true, std::vector <bool> (12, true), std::vector <bool> (31, true), std::vector <bool> (7, true), HourMin ({8, 0}), HourMin ({17, 59}), cp.getProfileWithName ("work")));
+    ps.setEnable (true);
+    
+    REQUIRE (ps.getScheduleTriggered () == nullptr);
+    REQUIRE (ps.getNextTransition () == start + 60);
+    
+    Clock::advance (60000);
+    REQUIRE (ps.getScheduleTriggered () != nullptr);
+    REQUIRE (ps.getScheduleTriggered ()->profile->name == "work");
+    
+    Clock::stopVirtual ();
+    REQUIRE (Clock::isVirtual () == false);
+}
+
+TEST_CASE("UeventListener", "[uevent]") 
+{
+    REQUIRE (UeventListener::supplyName ("/sys/class/power_supply/BAT0/capacity") == "BAT0");
+    REQUIRE (UeventListener::supplyName ("BAT1/capacity") == "BAT1");
+    REQUIRE (UeventListener::supplyName ("capacity") == "");
+    
+    int sockets [2];
+    REQUIRE (socketpair (AF_UNIX, SOCK_DGRAM, 0, sockets) == 0);
+    
+    UeventListener ul (sockets [0]);
+    ul.watchSupply ("BAT0");
+    ul.watchSupply ("AC");
+    ul.watchSupply ("AC");
+    
+    REQUIRE (ul.getDescriptor () == sockets [0]);
+    REQUIRE (ul.readEvents ().empty ());
+    
+    //the fields are separated by | instead of the null character
+    auto inject = [&] (std::string payload) 
+    {
+        std::replace (payload.begin (), payload.end (), '|', '\0');
+        REQUIRE (send (sockets [1], payload.data (), payload.size (), 0) == static_cast <ssize_t> (payload.size ()));
+    };
+    
+    const std::string battery {"change@/devices/LNXSYSTM:00/PNP0C0A:00/power_supply/BAT0|ACTION=change|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=BAT0|POWER_SUPPLY_STATUS=Discharging|POWER_SUPPLY_CAPACITY=57|"};
+    inject (battery);
+    REQUIRE (ul.readEvents () == std::vector <std::string> {"BAT0"});
+    
+    //the same values do not wake up the loop again
+    inject (battery);
+    REQUIRE (ul.readEvents ().empty ());
+    
+    //the charger unplugged, many events are read at once and every supply is reported once
+    inject ("change@/devices/AC|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=AC|POWER_SUPPLY_ONLINE=0");
+    inject ("change@/devices/BAT0|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=BAT0|POWER_SUPPLY_CAPACITY=56|");
+    inject ("change@/devices/BAT0|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=BAT0|POWER_SUPPLY_STATUS=Charging|");
+    REQUIRE (ul.readEvents () == std::vector <std::string> {"AC", "BAT0"});
+    
+    //other supplies, subsystems or wrong values are ignored
+    inject ("change@/devices/BAT1|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=BAT1|POWER_SUPPLY_CAPACITY=10|");
+    inject ("change@/devices/BAT0|SUBSYSTEM=usb|POWER_SUPPLY_NAME=BAT0|POWER_SUPPLY_CAPACITY=10|");
+    inject ("change@/devices/BAT0|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=BAT0|POWER_SUPPLY_CAPACITY=x|");
+    inject ("change@/devices/BAT0|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=BAT0|POWER_SUPPLY_CAPACITY=56|POWER_SUPPLY_STATUS=Charging|");
+    REQUIRE (ul.readEvents ().empty ());
+    
+    ul.clearSupplies ();
+    inject ("change@/devices/AC|SUBSYSTEM=power_supply|POWER_SUPPLY_NAME=AC|POWER_SUPPLY_ONLINE=1");
+    REQUIRE (ul.readEvents ().empty ());
+    
+    close (sockets [1]);
+}
+
+TEST_CASE("EventLoop", "[loop]") 
+{
+    REQUIRE (system ("rm -rf ./loop && mkdir -p ./loop") == 0);
+    
+    EventLoop el;
+    REQUIRE (el.watchFile ("./loop/command") == true);
+    REQUIRE (el.watchFile ("./missingdir/command") == false);
+    
+    //the signals are blocked by the loop and read from its descriptor
+    el.setTimeout (10000);
+    REQUIRE (kill (getpid (), SIGHUP) == 0);
+    REQUIRE (el.wait () == EventLoop::Event::RELOAD);
+    
+    REQUIRE (kill (getpid (), SIGTERM) == 0);
+    REQUIRE (el.wait () == EventLoop::Event::TERMINATE);
+    
+    //the watched file is noticed even if it did not exist, the other files in its directory are not
+    std::ofstream ("./loop/other") << "trip\n";
+    std::ofstream ("./loop/command") << "trip\n";
+    REQUIRE (el.wait () == EventLoop::Event::FILECHANGE);
+    
+    const long long begin = Clock::monotonicMs ();
+    el.setTimeout (50);
+    REQUIRE (el.wait () == EventLoop::Event::TIMEOUT);
+    REQUIRE (Clock::monotonicMs () - begin >= 50);
+    
+    //the changes discarded do not wake up the loop
+    std::ofstream ("./loop/command") << "home\n";
+    el.discardFileChanges ();
+    el.setTimeout (0);
+    REQUIRE (el.wait () == EventLoop::Event::TIMEOUT);
+    
+    //the device is noticed when it shows up, not the other entries of its directory
+    REQUIRE (system ("mkdir -p ./loop/dev") == 0);
+    REQUIRE (el.watchDevice ("./loop/dev/tty") == true);
+    REQUIRE (el.watchDevice ("./loop/dev/tty") == true);
+    std::ofstream ("./loop/dev/other") << "x\n";
+    el.setTimeout (50);
+    REQUIRE (el.wait () == EventLoop::Event::TIMEOUT);
+    std::ofstream ("./loop/dev/tty") << "x\n";
+    REQUIRE (el.wait () == EventLoop::Event::FILECHANGE);
+    
+    //once the device is linked its directory is not watched anymore
+    el.unwatchDevice ();
+    std::ofstream ("./loop/dev/other") << "y\n";
+    std::ofstream ("./loop/dev/tty") << "y\n";
+    el.setTimeout (50);
+    REQUIRE (el.wait () == EventLoop::Event::TIMEOUT);
+    
+    //the nearest existing directory is watched if the device one is missing too
+    REQUIRE (el.watchDevice ("./loop/usb/tty") == true);
+    REQUIRE (system ("mkdir ./loop/usb") == 0);
+    REQUIRE (el.wait () == EventLoop::Event::FILECHANGE);
+    
+    //the directory shared with a command file keeps the command file events
+    REQUIRE (el.watchDevice ("./loop/tty") == true);
+    el.unwatchDevice ();
+    std::ofstream ("./loop/command") << "home\n";
+    REQUIRE (el.wait () == EventLoop::Event::FILECHANGE);
+    
+    el.clearWatches ();
+    std::ofstream ("./loop/command") << "trip\n";
+    el.setTimeout (50);
+    REQUIRE (el.wait () == EventLoop::Event::TIMEOUT);
+    
+    int pipeDescs [2];
+    REQUIRE (pipe (pipeDescs) == 0);
+    REQUIRE (el.watchDescriptor (pipeDescs [0]) == true);
+    REQUIRE (write (pipeDescs [1], "x", 1) == 1);
+    el.setTimeout (10000);
+    REQUIRE (el.wait () == EventLoop::Event::READABLE);
+    
+    close (pipeDescs [0]);
+    close (pipeDescs [1]);
+    REQUIRE (system ("rm -rf ./loop") == 0);
+}
+
+TEST_CASE("BatGuard reload", "[loop]") 
+{
+    REQUIRE (system ("rm -rf ./reload && mkdir -p ./reload/bat1 ./reload/bat2") == 0);
+    std::ofstream ("./reload/bat1/capacity") << "55\n";
+    std::ofstream ("./reload/bat2/capacity") << "55\n";
+    
+    //the signals sent to the process are left pending for the loop thread which reads them, all the threads must block them
+    sigset_t signals, previous;
+    sigemptyset (& signals);
+    sigaddset (& signals, SIGHUP);
+    sigaddset (& signals, SIGTERM);
+    REQUIRE (pthread_sigmask (SIG_BLOCK, & signals, & previous) == 0);
+    
+    RelayEmulator emulator (8);
+    
+    auto configure = [&] (const std::string& protocol, const std::string& secondName, uint8_t secondChannel)
+    {
+        std::ofstream config ("./reload/config");
+        config << "serialpath = " << emulator.getPath () << "\nserialtrials = 1\nrelayprotocol = " << protocol << "\nuevent = off\n";
+        config << "logpath = ./reload/log\nloglevel = 3\nlogflush = 3, 1\n";
+        for (const std::pair <std::string, int>& device : std::vector <std::pair <std::string, int>> {{"laptop", 1}, {secondName, secondChannel}})
+        {
+            config << "[" << device.first << "]\nrelaychannel = " << device.second << "\npollingtime = 60\n";
+            config << "batterypath = ./reload/bat" << device.second % 2 + 1 << "/capacity\n";
+            config << "commandfilepath = ./reload/" << device.first << ".command\nstatefilepath = ./reload/" << device.first << ".state\n";
+            config << "profile = home, 50, 60, off\nprofile = trip, 80, 90, on\n";
+        }
+    };
+    
+    //waits until the log contains the given text the given times
+    auto waitLog = [] (const std::string& text, size_t times)
+    {
+        for (long long end = Clock::monotonicMs () + 5000; Clock::monotonicMs () < end; std::this_thread::sleep_for (std::chrono::milliseconds (10)))
+        {
+            std::ifstream log ("./reload/log");
+            const std::string content {std::istreambuf_iterator <char> (log), std::istreambuf_iterator <char> ()};
+            size_t found = 0;
+            for (size_t p = content.find (text); p != std::string::npos; p = content.find (text, p + 1)) ++ found;
+            if (found >= times) return true;
+        }
+        return false;
+    };
+    
+    configure ("lcus", "cart", 2);
+    std::ofstream ("./reload/laptop.command") << "trip\n";
+    
+    BatGuard bg ("./reload/config");
+    
+    //the checks while the loop runs must not leave the test before the loop is stopped
+    std::thread loop ([&] {bg.start ();});
+    CHECK (waitLog ("The relay channels were probed", 1) == true);
+    
+    //a device removed, one added on a higher channel which requires to probe the relay again, the kept one adopts its state
+    configure ("lcus", "desk", 3);
+    CHECK (kill (getpid (), SIGHUP) == 0);
+    CHECK (waitLog ("The device cart is not defined anymore", 1) == true);
+    CHECK (waitLog ("The relay channels were probed", 2) == true);
+    CHECK (waitLog ("[laptop] The configuration was reloaded, the current profile is: (name: trip", 1) == true);
+    
+    //the protocol cannot change while running, the whole configuration is rejected
+    configure ("modbus", "cart", 2);
+    CHECK (kill (getpid (), SIGHUP) == 0);
+    CHECK (waitLog ("the relay protocol and the modbus address cannot be changed without restarting batguard", 1) == true);
+    
+    CHECK (kill (getpid (), SIGTERM) == 0);
+    loop.join ();
+    REQUIRE (pthread_sigmask (SIG_SETMASK, & previous, nullptr) == 0);
+    
+    REQUIRE_NOTHROW (bg.selectDevice ("laptop"));
+    REQUIRE_NOTHROW (bg.selectDevice ("desk"));
+    REQUIRE_THROWS (bg.selectDevice ("cart"));
+    
+    REQUIRE (system ("rm -rf ./reload") == 0);
+}
+
+TEST_CASE("Simulation", "[simulation]") 
+{
+    REQUIRE (system ("rm -rf ./simulation && mkdir ./simulation") == 0);
+    std::ofstream ("./simulation/config") << "loglevel = 2\npollingtime = 300\nuevent = off\nprofile = home, 50, 60, off\n";
+    
+    //the trace is not correct
+    std::ostringstream discarded;
+    std::ofstream ("./simulation/trace") << "2025-01-06 08:00, 55\n2025-01-06 08:00:00, 54\n";
+    REQUIRE_THROWS (Simulation ("./simulation/trace", discarded));
+    std::ofstream ("./simulation/trace") << "2025-01-06 08:00, 55\n2025-01-06 07:55, 54\n";
+    REQUIRE_THROWS (Simulation ("./simulation/trace", discarded));
+    std::ofstream ("./simulation/trace") << "2025-01-06 08:00, 55, 2\n";
+    REQUIRE_THROWS (Simulation ("./simulation/trace", discarded));
+    std::ofstream ("./simulation/trace") << "2025-01-06 08:00, 101\n";
+    REQUIRE_THROWS (Simulation ("./simulation/trace", discarded));
+    std::ofstream ("./simulation/trace") << "#time, capacity, ac\n";
+    REQUIRE_THROWS (Simulation ("./simulation/trace", discarded));
+    REQUIRE_THROWS (Simulation ("./simulation/missing", discarded));
+    REQUIRE (discarded.str ().empty ());
+    
+    //the times are local dates or seconds since the epoch, the ac is optional
+    std::ofstream ("./simulation/trace") << "#time, capacity, ac\n2025-01-06 08:00, 55, 0\n2025-01-06 08:30:00, 49\n" << Clock::parseTime ("2025-01-06 09:00") << ", 55, 1\n# plugged in the morning\n2025-01-06 09:30, 61, 1\n2025-01-06 10:00, 58, 0\n";
+    
+    //the relay changes are printed on the standard output
+    std::ostringstream actions;
+    std::streambuf* const standardOutput = std::cout.rdbuf (actions.rdbuf ());
+    try
+    {
+        BatGuard ("./simulation/config", "./simulation/trace").start ();
+    }
+    catch (...)
+    {
+        std::cout.rdbuf (standardOutput);
+        Clock::stopVirtual ();
+        throw;
+    }
+    std::cout.rdbuf (standardOutput);
+    Clock::stopVirtual ();
+    
+    REQUIRE (actions.str () == "time,channel,relay,capacity,ac\n2025-01-06 08:30:00,1,on,49,\n2025-01-06 09:30:00,1,off,61,1\n");
+    
+    std::ifstream log ("./simulation/trace.log");
+    const std::string content {std::istreambuf_iterator <char> (log), std::istreambuf_iterator <char> ()};
+    REQUIRE (content.find ("2025-01-06 08:30:00 | level: BASIC | message: Capacity: 49 went below the min threshold, the charger is turned on") != std::string::npos);
+    REQUIRE (content.find ("2025-01-06 09:30:00 | level: BASIC | message: Capacity: 61 went above the max threshold, the charger is turned off") != std::string::npos);
+    
+    REQUIRE (system ("rm -rf ./simulation") == 0);
+}